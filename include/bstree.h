@@ -1,11 +1,56 @@
 #ifndef BSTREE_H
 #define BSTREE_H
 
+#include<algorithm>
+#include<cassert>
+#include<cstddef>
 #include<cstdint>
+#include<initializer_list>
 #include<iterator>
+#include<limits>
+#include<memory>
+#include<numeric>
+#include<string>
 #include<type_traits>
+#include<vector>
+
+#if defined(__AVX2__)
+#include<immintrin.h>
+#elif defined(__SSE4_2__)
+#include<nmmintrin.h>
+#elif defined(__SSE2__)
+#include<emmintrin.h>
+#endif
+
+#if defined(__GNUC__)
+#define BST_PREFETCH(p) __builtin_prefetch(p)
+#else
+#define BST_PREFETCH(p) ((void)0)
+#endif
 
 namespace bst {
+
+template<typename Tree>
+class concurrent;
+
+template<typename Tree, std::size_t N>
+class sharded;
+
+template<typename Tree, std::size_t Slots = 64>
+class combining;
+
+template<typename Tree>
+class cached_ends;
+
+template<typename Tree>
+class frozen;
+
+template<typename Tree>
+class frozen_btree;
+
+template<typename Key, typename = void>
+struct key_prefix;
+
 namespace impl {
 
 struct NodeBase {
@@ -39,16 +84,499 @@ struct NodeBase {
     }
 };
 
-extern NodeBase* bst_first(NodeBase* node);
-extern NodeBase* bst_last(NodeBase* node);
-extern NodeBase* bst_prev(NodeBase* node);
-extern NodeBase* bst_next(NodeBase* node);
-extern NodeBase* rb_post_insert(NodeBase* node, NodeBase* root);
-extern NodeBase* avl_post_insert(NodeBase* node, NodeBase* root);
-extern NodeBase* wavl_post_insert(NodeBase* node, NodeBase* root);
-extern NodeBase* rb_erase(NodeBase* node, NodeBase* root);
-extern NodeBase* avl_erase(NodeBase* node, NodeBase* root);
-extern NodeBase* wavl_erase(NodeBase* node, NodeBase* root);
+// a node that also stores the size of its subtree, for the order-statistic queries
+struct CountedNodeBase : NodeBase {
+    std::size_t count;
+};
+
+// a node that also stores an order-preserving prefix of its key, see bstree::compare_node
+struct PrefixNodeBase : NodeBase {
+    std::uint64_t prefix;
+};
+
+// A link stored as the distance from itself to the linked hook in units of Scale bytes, 0
+// is null. It converts to and from Hook*, the algorithms only keep raw pointers in their
+// local variables: a copy elsewhere would no longer reach the hook, so there is none.
+template<typename Hook, typename Offset, int Scale>
+class RelativeLink {
+    Offset offset;
+public:
+    RelativeLink() = default;
+    RelativeLink(const RelativeLink&) = delete;
+    operator Hook*() const {
+        return offset == 0 ? nullptr : reinterpret_cast<Hook*>(reinterpret_cast<std::intptr_t>(this) + std::intptr_t(offset) * Scale);
+    }
+    template<typename T>
+    explicit operator T*() const {
+        return static_cast<T*>(static_cast<Hook*>(*this));
+    }
+    Hook* operator->() const {
+        return *this;
+    }
+    RelativeLink& operator=(Hook* p) {
+        auto d = p == nullptr ? 0 : (reinterpret_cast<std::intptr_t>(p) - reinterpret_cast<std::intptr_t>(this)) / Scale;
+        assert(Offset(d) == d && "the hooks of a tree are too far apart for the links");
+        offset = Offset(d);
+        return *this;
+    }
+    RelativeLink& operator=(const RelativeLink& other) {
+        return *this = static_cast<Hook*>(other);
+    }
+};
+
+// A hook whose links are distances between the hooks instead of addresses, the parent
+// distance shares its word with the tag. A tree of such nodes does not depend on where it
+// is in memory. A copied hook is unlinked, and assigning a hook leaves the target's links alone.
+template<typename Offset, int Scale>
+struct RelativeNodeBase {
+    using Word = typename std::make_unsigned<Offset>::type;
+    Word parent_with_tag;
+    RelativeLink<RelativeNodeBase, Offset, Scale> left;
+    RelativeLink<RelativeNodeBase, Offset, Scale> right;
+    RelativeNodeBase() = default;
+    RelativeNodeBase(const RelativeNodeBase&) : parent_with_tag(0) {
+        left = nullptr;
+        right = nullptr;
+    }
+    RelativeNodeBase& operator=(const RelativeNodeBase&) {
+        return *this;
+    }
+    RelativeNodeBase* parent() const {
+        auto offset = static_cast<Offset>(parent_with_tag & ~static_cast<Word>(3));
+        return offset == 0 ? nullptr : reinterpret_cast<RelativeNodeBase*>(reinterpret_cast<std::intptr_t>(this) + offset);
+    }
+    void set_parent(RelativeNodeBase* p) {
+        auto offset = p == nullptr ? 0 : reinterpret_cast<std::intptr_t>(p) - reinterpret_cast<std::intptr_t>(this);
+        assert(Offset(offset) == offset && "the hooks of a tree are too far apart for the links");
+        parent_with_tag = (parent_with_tag & static_cast<Word>(3)) | static_cast<Word>(offset);
+    }
+    int tag() const {
+        return parent_with_tag & static_cast<Word>(3);
+    }
+    void set_tag(int t) {
+        parent_with_tag = (parent_with_tag & ~static_cast<Word>(3)) | static_cast<Word>(t);
+    }
+};
+
+// 12 bytes for nodes allocated together, e.g. in one array: all the nodes of a tree must
+// lie within 2 GiB of each other
+using CompactNodeBase = RelativeNodeBase<std::int32_t, 4>;
+
+// as large as NodeBase, for trees kept in memory-mapped files or shared memory of any size
+using OffsetNodeBase = RelativeNodeBase<std::int64_t, 1>;
+
+// A child link that marks the child as a left or a right one whenever it is assigned.
+template<typename Hook, bool Left>
+class SideLink {
+    Hook* p;
+public:
+    SideLink() = default;
+    SideLink(const SideLink&) = delete;
+    operator Hook*() const {
+        return p;
+    }
+    template<typename T>
+    explicit operator T*() const {
+        return static_cast<T*>(p);
+    }
+    Hook* operator->() const {
+        return p;
+    }
+    SideLink& operator=(Hook* q) {
+        p = q;
+        if(q != nullptr) {
+            q->set_left_child(Left);
+        }
+        return *this;
+    }
+    SideLink& operator=(const SideLink& other) {
+        return *this = other.p;
+    }
+};
+
+// A hook aligned to 8 bytes, so that the parent word has a third free bit: it tells whether
+// the node is the left child of its parent. The links set it on every assignment, so the
+// rotations keep it, and iteration and erase find the side of a node without loading the
+// parent's child pointers. A copied hook is unlinked, as with RelativeNodeBase.
+struct alignas(8) SidedNodeBase {
+    using UP = std::uintptr_t;
+    UP parent_with_tag;
+    SideLink<SidedNodeBase, true> left;
+    SideLink<SidedNodeBase, false> right;
+    SidedNodeBase() = default;
+    SidedNodeBase(const SidedNodeBase&) : parent_with_tag(0) {
+        left = nullptr;
+        right = nullptr;
+    }
+    SidedNodeBase& operator=(const SidedNodeBase&) {
+        return *this;
+    }
+    SidedNodeBase* parent() const {
+        return reinterpret_cast<SidedNodeBase*>(parent_with_tag & ~static_cast<UP>(7));
+    }
+    void set_parent(SidedNodeBase* p) {
+        parent_with_tag &= static_cast<UP>(7);
+        parent_with_tag |= reinterpret_cast<UP>(p);
+    }
+    int tag() const {
+        return parent_with_tag & static_cast<UP>(3);
+    }
+    void set_tag(int t) {
+        parent_with_tag &= ~static_cast<UP>(3);
+        parent_with_tag |= static_cast<UP>(t);
+    }
+    // meaningless for the root
+    bool is_left_child() const {
+        return parent_with_tag & static_cast<UP>(4);
+    }
+    void set_left_child(bool l) {
+        parent_with_tag = (parent_with_tag & ~static_cast<UP>(4)) | (static_cast<UP>(l) << 2);
+    }
+};
+
+// A hook without a parent pointer, the tag is in the low bits of the left pointer. The
+// trees of such nodes keep the path from the root in a LeanPath instead.
+struct LeanNodeBase {
+    using UP = std::uintptr_t;
+    UP left_with_tag;
+    LeanNodeBase* right;
+    LeanNodeBase* left() const {
+        return reinterpret_cast<LeanNodeBase*>(left_with_tag & ~static_cast<UP>(3));
+    }
+    void set_left(LeanNodeBase* l) {
+        left_with_tag &= static_cast<UP>(3);
+        left_with_tag |= reinterpret_cast<UP>(l);
+    }
+    int tag() const {
+        return left_with_tag & static_cast<UP>(3);
+    }
+    void set_tag(int t) {
+        left_with_tag &= ~static_cast<UP>(3);
+        left_with_tag |= static_cast<UP>(t);
+    }
+};
+
+// The nodes from the root down to the last node of a search, and whether the search went
+// right from each of them. A red-black or WAVL tree of less than 2^64 nodes is less than 128
+// high, an AVL tree less than 96.
+struct LeanPath {
+    static const int capacity = 2 * 8 * sizeof(std::size_t);
+    LeanNodeBase* node[capacity];
+    bool right[capacity];
+    int depth;
+};
+
+// A child link loaded and stored as a relaxed atomic, so that readers that take no lock may
+// walk down the tree while a writer rebalances it. It costs a plain move on the common
+// targets, but the compiler can no longer merge or reorder the accesses to it.
+template<typename Hook>
+class AtomicLink {
+    Hook* p;
+public:
+    AtomicLink() = default;
+    AtomicLink(Hook* q) {
+        *this = q;
+    }
+    AtomicLink(const AtomicLink& other) {
+        *this = static_cast<Hook*>(other);
+    }
+    operator Hook*() const {
+#if defined(__GNUC__)
+        return __atomic_load_n(&p, __ATOMIC_RELAXED);
+#else
+        return *static_cast<Hook* const volatile*>(&p);
+#endif
+    }
+    template<typename T>
+    explicit operator T*() const {
+        return static_cast<T*>(static_cast<Hook*>(*this));
+    }
+    Hook* operator->() const {
+        return *this;
+    }
+    AtomicLink& operator=(Hook* q) {
+#if defined(__GNUC__)
+        __atomic_store_n(&p, q, __ATOMIC_RELAXED);
+#else
+        *static_cast<Hook* volatile*>(&p) = q;
+#endif
+        return *this;
+    }
+    AtomicLink& operator=(const AtomicLink& other) {
+        return *this = static_cast<Hook*>(other);
+    }
+};
+
+// A hook whose child links are atomic, for bst::concurrent; a tree of such nodes also keeps
+// its root in an AtomicLink. The parent word is only read by the writers, so it stays plain.
+// A copied hook is unlinked, as with RelativeNodeBase.
+struct AtomicNodeBase {
+    using UP = std::uintptr_t;
+    UP parent_with_tag;
+    AtomicLink<AtomicNodeBase> left;
+    AtomicLink<AtomicNodeBase> right;
+    AtomicNodeBase() = default;
+    AtomicNodeBase(const AtomicNodeBase&) : parent_with_tag(0), left(nullptr), right(nullptr) {}
+    AtomicNodeBase& operator=(const AtomicNodeBase&) {
+        return *this;
+    }
+    AtomicNodeBase* parent() const {
+        return reinterpret_cast<AtomicNodeBase*>(parent_with_tag & ~static_cast<UP>(3));
+    }
+    void set_parent(AtomicNodeBase* p) {
+        parent_with_tag &= static_cast<UP>(3);
+        parent_with_tag |= reinterpret_cast<UP>(p);
+    }
+    int tag() const {
+        return parent_with_tag & static_cast<UP>(3);
+    }
+    void set_tag(int t) {
+        parent_with_tag &= ~static_cast<UP>(3);
+        parent_with_tag |= static_cast<UP>(t);
+    }
+};
+
+// the left or the right child of a node; both links are read first, so the choice compiles
+// to a conditional move also when the two links have different types, as in SidedNodeBase
+template<typename Hook>
+inline Hook* child_of(const Hook* node, bool left) {
+    Hook* l = node->left;
+    Hook* r = node->right;
+    return left ? l : r;
+}
+
+// the hook type a node type is derived from
+template<typename NodeType>
+struct hook_of {
+    using type = typename std::conditional<std::is_base_of<CompactNodeBase, NodeType>::value, CompactNodeBase,
+                 typename std::conditional<std::is_base_of<OffsetNodeBase, NodeType>::value, OffsetNodeBase,
+                 typename std::conditional<std::is_base_of<SidedNodeBase, NodeType>::value, SidedNodeBase,
+                 typename std::conditional<std::is_base_of<AtomicNodeBase, NodeType>::value, AtomicNodeBase, NodeBase>::type>::type>::type>::type;
+};
+
+// the root slot of a tree, atomic for the hooks with atomic links
+template<typename Hook>
+struct root_of {
+    using type = Hook*;
+};
+
+template<>
+struct root_of<AtomicNodeBase> {
+    using type = AtomicLink<AtomicNodeBase>;
+};
+
+// selects the versions of the functions below that maintain CountedNodeBase::count
+struct count_nodes {};
+
+// selects the versions of the functions below that call update on every node whose
+// subtree has changed, bottom-up, so that it can recompute its aggregate from its children
+struct augment_callback {
+    void (*update)(NodeBase* node);
+};
+
+// The balancing functions of a scheme exported for Hook by src/bstree.cpp. Param is empty
+// for the plain version, or expands to the extra parameter that selects the counted or the
+// augmented one.
+#define BST_DECLARE_BALANCE(Hook, name, Param) \
+extern Hook* name##_post_insert(Hook* node, Hook* root Param); \
+extern Hook* name##_erase(Hook* node, Hook* root Param); \
+extern Hook* name##_build(Hook* head, std::size_t n Param); \
+extern Hook* name##_join(Hook* left, int hl, Hook* pivot, Hook* right, int hr, int& h Param); \
+extern Hook* name##_join2(Hook* left, int hl, Hook* right, int hr, int& h Param); \
+extern void name##_split(Hook* node, int where, Hook*& left, int& hl, Hook*& right, int& hr Param); \
+extern void name##_split_root(Hook* root, int h, Hook*& left, int& hl, Hook*& right, int& hr Param);
+
+// iteration and the plain balancing functions of every scheme for Hook
+#define BST_DECLARE_HOOK(Hook) \
+extern Hook* bst_first(Hook* node); \
+extern Hook* bst_last(Hook* node); \
+extern Hook* bst_prev(Hook* node); \
+extern Hook* bst_next(Hook* node); \
+extern int rb_height(Hook* root); \
+extern int avl_height(Hook* root); \
+extern int wavl_height(Hook* root); \
+BST_DECLARE_BALANCE(Hook, rb, ) \
+BST_DECLARE_BALANCE(Hook, avl, ) \
+BST_DECLARE_BALANCE(Hook, wavl, )
+
+#define BST_COUNTED , count_nodes
+#define BST_AUGMENTED , augment_callback aug
+
+BST_DECLARE_HOOK(NodeBase)
+// bring node to the root (semi_splay: closer to it) and return the new root
+extern NodeBase* splay(NodeBase* node, NodeBase* root);
+extern NodeBase* semi_splay(NodeBase* node, NodeBase* root);
+// unlink node, replacing it by its successor, without splaying
+extern NodeBase* splay_erase(NodeBase* node, NodeBase* root);
+BST_DECLARE_BALANCE(NodeBase, rb, BST_COUNTED)
+BST_DECLARE_BALANCE(NodeBase, avl, BST_COUNTED)
+BST_DECLARE_BALANCE(NodeBase, wavl, BST_COUNTED)
+BST_DECLARE_BALANCE(NodeBase, rb, BST_AUGMENTED)
+BST_DECLARE_BALANCE(NodeBase, avl, BST_AUGMENTED)
+BST_DECLARE_BALANCE(NodeBase, wavl, BST_AUGMENTED)
+BST_DECLARE_HOOK(CompactNodeBase)
+BST_DECLARE_HOOK(OffsetNodeBase)
+BST_DECLARE_HOOK(SidedNodeBase)
+BST_DECLARE_HOOK(AtomicNodeBase)
+// rebalance after linking path.node[depth - 1] as a leaf, return the new root
+extern LeanNodeBase* rb_post_insert(LeanPath& path, LeanNodeBase* root);
+extern LeanNodeBase* avl_post_insert(LeanPath& path, LeanNodeBase* root);
+extern LeanNodeBase* wavl_post_insert(LeanPath& path, LeanNodeBase* root);
+// unlink path.node[depth - 1], the path may be extended down to its successor
+extern LeanNodeBase* rb_erase(LeanPath& path, LeanNodeBase* root);
+extern LeanNodeBase* avl_erase(LeanPath& path, LeanNodeBase* root);
+extern LeanNodeBase* wavl_erase(LeanPath& path, LeanNodeBase* root);
+extern void fork_join(void (*f)(void*), void* a, void (*g)(void*), void* b);
+#undef BST_AUGMENTED
+#undef BST_COUNTED
+#undef BST_DECLARE_HOOK
+#undef BST_DECLARE_BALANCE
+
+inline int bit_length(std::size_t n) {
+    int h = 0;
+    for (; n != 0; n >>= 1)
+        ++h;
+    return h;
+}
+
+// the tag selecting the exported version of a function; an augment_with is passed as its
+// augment_callback, so the algorithm templates of bstree_inline.h, where they are visible,
+// do not match it better
+inline count_nodes exported(count_nodes tag) {
+    return tag;
+}
+inline augment_callback exported(augment_callback tag) {
+    return tag;
+}
+
+// The balancing operations of a scheme on nodes with the hook Hook, Aug is empty for plain
+// nodes, count_nodes for CountedNodeBase or an augment_with for a user-defined aggregate.
+// They call the functions exported by src/bstree.cpp; bstree_inline.h gives the same
+// members with the algorithms inlined.
+// The join-based algorithms carry the height of every subtree
+// along, in the measure of the balancing scheme: black height for red-black trees,
+// height for AVL, rank for WAVL. The recursion is forked onto the thread pool while
+// both subtrees are at least parallel_height high, which stands for a few thousand nodes.
+#define BST_BALANCE_OPS(name, null_h, parallel_h) \
+template<typename Hook, typename ... Aug> \
+struct name##_ops { \
+    static const int null_height = null_h; \
+    static const int parallel_height = parallel_h; \
+    static Hook* post_insert(Hook* node, Hook* root) { \
+        return name##_post_insert(node, root, exported(Aug())...); \
+    } \
+    static Hook* erase(Hook* node, Hook* root) { \
+        return name##_erase(node, root, exported(Aug())...); \
+    } \
+    static Hook* build(Hook* head, std::size_t n) { \
+        return name##_build(head, n, exported(Aug())...); \
+    } \
+    static int height(Hook* root) { \
+        return name##_height(root); \
+    } \
+    static Hook* join(Hook* left, int hl, Hook* pivot, Hook* right, int hr, int& h) { \
+        return name##_join(left, hl, pivot, right, hr, h, exported(Aug())...); \
+    } \
+    static Hook* join2(Hook* left, int hl, Hook* right, int hr, int& h) { \
+        return name##_join2(left, hl, right, hr, h, exported(Aug())...); \
+    } \
+    static void split(Hook* node, int where, Hook*& left, int& hl, Hook*& right, int& hr) { \
+        name##_split(node, where, left, hl, right, hr, exported(Aug())...); \
+    } \
+    static void split_root(Hook* root, int h, Hook*& left, int& hl, Hook*& right, int& hr) { \
+        name##_split_root(root, h, left, hl, right, hr, exported(Aug())...); \
+    } \
+};
+
+BST_BALANCE_OPS(rb, 0, 7)
+BST_BALANCE_OPS(avl, 0, 12)
+BST_BALANCE_OPS(wavl, -1, 12)
+#undef BST_BALANCE_OPS
+
+// the rebalancing of a scheme for the lean trees, along a LeanPath
+#define BST_LEAN_OPS(name) \
+struct lean_##name##_ops { \
+    static LeanNodeBase* post_insert(LeanPath& path, LeanNodeBase* root) { \
+        return name##_post_insert(path, root); \
+    } \
+    static LeanNodeBase* erase(LeanPath& path, LeanNodeBase* root) { \
+        return name##_erase(path, root); \
+    } \
+};
+
+BST_LEAN_OPS(rb)
+BST_LEAN_OPS(avl)
+BST_LEAN_OPS(wavl)
+#undef BST_LEAN_OPS
+
+// Binds an augmentation policy of the trees to the callback. Policy::update(node) recomputes
+// the aggregate of node from node and its children, either of which may be null. The size
+// of the subtree of a counted node is updated before.
+template<typename NodeType, typename Policy>
+struct augment_with : augment_callback {
+    augment_with() : augment_callback{&update_node} {}
+
+    static void update_node(NodeBase* node) {
+        update_count(node, std::is_base_of<CountedNodeBase, NodeType>());
+        Policy::update(*static_cast<NodeType*>(node));
+    }
+    static void propagate(NodeBase* node) {
+        for(; node != nullptr; node = node->parent()) {
+            update_node(node);
+        }
+    }
+
+private:
+    static std::size_t count_of(NodeBase* node) {
+        return node ? static_cast<CountedNodeBase*>(node)->count : 0;
+    }
+    static void update_count(NodeBase* node, std::true_type) {
+        static_cast<CountedNodeBase*>(node)->count = count_of(node->left) + count_of(node->right) + 1;
+    }
+    static void update_count(NodeBase*, std::false_type) {}
+};
+
+template<template<typename ...> class Ops, typename NodeType, typename Augment>
+struct select_ops {
+    using type = Ops<NodeBase, augment_with<NodeType, Augment>>;
+};
+
+template<template<typename ...> class Ops, typename NodeType>
+struct select_ops<Ops, NodeType, void> {
+    using type = typename std::conditional<std::is_base_of<CountedNodeBase, NodeType>::value,
+                                           Ops<NodeBase, count_nodes>, Ops<typename hook_of<NodeType>::type>>::type;
+};
+
+template<template<typename ...> class Ops, typename NodeType, typename Augment>
+using balance_ops_for = typename select_ops<Ops, NodeType, Augment>::type;
+
+// The Balance argument of a tree is void for the operations Ops of its scheme, otherwise a
+// class whose member template ops<Hook, Aug...> has the same members, e.g. bst::inline_rb.
+template<template<typename ...> class Ops, typename NodeType, typename Augment, typename Balance>
+struct select_balance {
+    using type = balance_ops_for<Balance::template ops, NodeType, Augment>;
+};
+
+template<template<typename ...> class Ops, typename NodeType, typename Augment>
+struct select_balance<Ops, NodeType, Augment, void> {
+    using type = balance_ops_for<Ops, NodeType, Augment>;
+};
+
+template<template<typename ...> class Ops, typename NodeType, typename Augment, typename Balance>
+using balance_policy_ops = typename select_balance<Ops, NodeType, Augment, Balance>::type;
+
+template<typename F>
+void call(void* f) {
+    (*static_cast<F*>(f))();
+}
+
+template<typename F, typename G>
+inline void fork_join(F& f, G& g) {
+    fork_join(&call<F>, &f, &call<G>, &g);
+}
+
+template<typename Tree, typename Dispose>
+class set_operation;
 
 template<typename Left, typename Right>
 class Tuple : Left {
@@ -62,13 +590,91 @@ public:
     const Right& right() const { return this->rr; }
 };
 
+template<typename T>
+struct to_void {
+    using type = void;
+};
+
+// A comparator that declares is_three_way, returning a signed integer negative, zero or
+// positive as its first argument is less than, equal to or greater than the second, is
+// three-way; any other is a less-than predicate, whatever it returns. ordering gives both
+// views of either kind: a lookup then needs one call of a three-way comparator per node
+// instead of two of a predicate.
+template<typename Compare, typename = void>
+struct is_three_way : std::false_type {};
+
+template<typename Compare>
+struct is_three_way<Compare, typename to_void<typename Compare::is_three_way>::type> : std::true_type {};
+
+template<typename Compare>
+struct three_way_less {
+    const Compare& comp;
+    template<typename A, typename B>
+    bool operator()(const A& a, const B& b) const { return comp(a, b) < 0; }
+};
+
+template<typename Compare, typename Key, bool = is_three_way<Compare>::value>
+struct ordering {
+    using less_type = const Compare&;
+    static const Compare& less(const Compare& comp) { return comp; }
+    template<typename A, typename B>
+    static int compare(const Compare& comp, const A& a, const B& b) {
+        return comp(a, b) ? -1 : comp(b, a) ? 1 : 0;
+    }
+};
+
+template<typename Compare, typename Key>
+struct ordering<Compare, Key, true> {
+    using less_type = three_way_less<Compare>;
+    static less_type less(const Compare& comp) { return less_type{comp}; }
+    template<typename A, typename B>
+    static auto compare(const Compare& comp, const A& a, const B& b) -> decltype(comp(a, b)) {
+        return comp(a, b);
+    }
+};
+
+// The prefix of a key as the comparator orders it: its member prefix(key) if it has one,
+// else key_prefix<Key> for std::less<Key>.
+template<typename Compare, typename Key, typename = void>
+struct prefix_of {
+    static_assert(std::is_same<Compare, std::less<Key>>::value, "prefix_node_hook needs std::less or a comparator with a prefix member");
+    template<typename K>
+    static std::uint64_t get(const Compare&, const K& value) {
+        return key_prefix<Key>()(value);
+    }
+};
+
+template<typename Compare, typename Key>
+struct prefix_of<Compare, Key, typename to_void<decltype(std::declval<const Compare&>().prefix(std::declval<const Key&>()))>::type> {
+    template<typename K>
+    static std::uint64_t get(const Compare& comp, const K& value) {
+        return comp.prefix(value);
+    }
+};
+
 template<typename NodeType, typename Key, typename GetKey, typename Compare>
 class bstree {
-    static_assert(std::is_convertible<NodeType*, NodeBase*>::value, "The node type is not a subclass of node_hook");
-    Tuple<GetKey, Tuple<Compare, NodeBase*>> data;
+    using Hook = typename hook_of<NodeType>::type;
+    static_assert(std::is_convertible<NodeType*, Hook*>::value, "The node type is not a subclass of node_hook");
+    Tuple<GetKey, Tuple<Compare, typename root_of<Hook>::type>> data;
+    template<typename Tree, typename Dispose>
+    friend class set_operation;
+    template<typename Tree>
+    friend class bst::concurrent;
+    template<typename Tree, std::size_t N>
+    friend class bst::sharded;
+    template<typename Tree, std::size_t Slots>
+    friend class bst::combining;
+    template<typename Tree>
+    friend class bst::cached_ends;
+    template<typename Tree>
+    friend class bst::frozen;
+    template<typename Tree>
+    friend class bst::frozen_btree;
 public:
     using node_type = NodeType;
     using node_pointer = node_type*;
+    using hook_type = Hook;
     using compare = Compare;
     using value_type = Key;
 
@@ -82,346 +688,2419 @@ public:
         return static_cast<node_pointer>(this->data.right().right());
     }
 
+    // Take over the nodes under r, which must already form a tree of the same kind and
+    // order, e.g. one kept with offset hooks in a file that has been mapped again.
+    void attach(node_pointer r) {
+        this->data.right().right() = r;
+    }
+
     bstree(const GetKey& key, const Compare& comp) : data(key, comp, nullptr) {}
 
     node_pointer search(const Key& value) const {
-        auto& key = this->data.left();
-        auto& comp = this->data.right().left();
-        auto p = static_cast<node_pointer>(this->root());
-        while(p != nullptr) {
-            if(comp(value, key(*p))) {
-                p = static_cast<node_pointer>(p->left);
-            } else if(comp(key(*p), value)) {
-                p = static_cast<node_pointer>(p->right);
-            } else return p;
-        }
-        return nullptr;
+        return search_by(value);
     }
     
     node_pointer lower_bound(const Key& value) const {
-        return lower_bound_impl(value, root(), this->data.right().left());
+        return lower_bound_by(value);
     }
 
     node_pointer upper_bound(const Key& value) const {
-        auto& comp = this->data.right().left();
-        return lower_bound_impl(value, root(), [&](const Key& l, const Key& r) { return !comp(r, l); });
+        return upper_bound_by(value);
     }
 
     // find nodes that 
     std::pair<node_pointer, node_pointer> search_range(const Key& lower, const Key& upper) const {
-        auto& key = this->data.left();
-        auto& comp = this->data.right().left();
-        auto p = static_cast<node_pointer>(this->root());
-        while(p != nullptr) {
-            if(comp(lower, key(*p)) && comp(upper, key(*p))) {
-                p = static_cast<node_pointer>(p->left);
-            } else if(comp(key(*p), lower) && comp(key(*p), upper)) {
-                p = static_cast<node_pointer>(p->right);
-            } else return {lower_bound_impl(lower, p, comp), lower_bound_impl(upper, p, comp)};
-        }
-        return {nullptr, nullptr};
+        return search_range_by(lower, upper);
+    }
 
+    // With a transparent Compare, one that defines is_transparent, the lookups also take a
+    // probe of any type that Compare orders against Key, e.g. a char buffer for std::string
+    // keys, without converting it to a Key first.
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    node_pointer search(const K& value) const {
+        return search_by(value);
+    }
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    node_pointer lower_bound(const K& value) const {
+        return lower_bound_by(value);
+    }
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    node_pointer upper_bound(const K& value) const {
+        return upper_bound_by(value);
+    }
+    template<typename L, typename U, typename C = Compare, typename = typename C::is_transparent>
+    std::pair<node_pointer, node_pointer> search_range(const L& lower, const U& upper) const {
+        return search_range_by(lower, upper);
     }
 
-protected:
-    template<typename COMP>
-    node_pointer lower_bound_impl(const Key& x, node_pointer p, COMP&& comp) const {
+    // The batched lookups walk groups of search_group lookups down the tree in lockstep,
+    // prefetching the next node of each, so that their cache misses overlap.
+    static const std::size_t search_group = 8;
+
+    // out[i] = search(keys[i]) for i < n
+    void search_many(const Key* keys, std::size_t n, node_pointer* out) const {
         auto& key = this->data.left();
-        node_pointer q = nullptr;
-        bool last_dir = false;
-        while(p != nullptr) {
-            q = p;
-            last_dir = comp(key(*p), x);
-            if(last_dir) {
-                p = static_cast<node_pointer>(p->right);
-            } else {
-                p = static_cast<node_pointer>(p->left);
+        node_pointer p[search_group];
+        for(std::size_t base = 0; base < n; base += search_group) {
+            std::size_t g = std::min(search_group, n - base);
+            for(std::size_t i = 0; i < g; ++i) {
+                p[i] = this->root();
+                out[base + i] = nullptr;
+            }
+            for(bool active = true; active; ) {
+                active = false;
+                for(std::size_t i = 0; i < g; ++i) {
+                    auto q = p[i];
+                    if(q == nullptr) {
+                        continue;
+                    }
+                    auto c = key_compare(keys[base + i], key(*q));
+                    if(c < 0) {
+                        q = static_cast<node_pointer>(q->left);
+                    } else if(c > 0) {
+                        q = static_cast<node_pointer>(q->right);
+                    } else {
+                        out[base + i] = q;
+                        q = nullptr;
+                    }
+                    if(q != nullptr) {
+                        BST_PREFETCH(q);
+                        active = true;
+                    }
+                    p[i] = q;
+                }
             }
         }
-        if(last_dir) {
-            return static_cast<node_pointer>(bst_next(q));
-        }
-        return q;
     }
 
-    void insert_bst(node_pointer node) {
+    // out[i] = lower_bound(keys[i]) for i < n
+    void lower_bound_many(const Key* keys, std::size_t n, node_pointer* out) const {
         auto& key = this->data.left();
-        auto& comp = this->data.right().left();
-        auto link = &(this->data.right().right());
-        node_pointer parent = nullptr;
-        while(*link != nullptr) {
-            parent = static_cast<node_pointer>(*link);
-            if(comp(key(*node), key(*parent))) { // allow duplicate
-                link = &(parent->left);
-            } else {
-                link = &(parent->right);
+        auto&& comp = key_less();
+        node_pointer p[search_group];
+        bool last_dir[search_group];
+        for(std::size_t base = 0; base < n; base += search_group) {
+            std::size_t g = std::min(search_group, n - base);
+            for(std::size_t i = 0; i < g; ++i) {
+                p[i] = this->root();
+                out[base + i] = nullptr;
+                last_dir[i] = false;
+            }
+            for(bool active = true; active; ) {
+                active = false;
+                for(std::size_t i = 0; i < g; ++i) {
+                    auto q = p[i];
+                    if(q == nullptr) {
+                        continue;
+                    }
+                    out[base + i] = q;
+                    last_dir[i] = comp(key(*q), keys[base + i]);
+                    q = static_cast<node_pointer>(child_of<Hook>(q, !last_dir[i]));
+                    if(q != nullptr) {
+                        BST_PREFETCH(q);
+                        active = true;
+                    }
+                    p[i] = q;
+                }
+            }
+            for(std::size_t i = 0; i < g; ++i) {
+                if(last_dir[i]) {
+                    out[base + i] = static_cast<node_pointer>(bst_next(out[base + i]));
+                }
             }
         }
-        node->left = node->right = nullptr;
-        node->set_parent(parent);
-        *link = node;
     }
 
-    bool insert_unique_bst(node_pointer node) {
-        auto& key = this->data.left();
-        auto& comp = this->data.right().left();
-        auto link = &(this->data.right().right());
-        node_pointer parent = nullptr;
-        while(*link != nullptr) {
-            parent = static_cast<node_pointer>(*link);
-            if(comp(key(*node), key(*parent))) { // not allow duplicate
-                link = &(parent->left);
-            } else if(comp(key(*parent), key(*node))) {
-                link = &(parent->right);
-            } else return false;
-        }
-        node->left = node->right = nullptr;
-        node->set_parent(parent);
-        *link = node;
-        return true;
+    // The order-statistic queries below need a node type derived from counted_node_hook,
+    // all of them run in O(log n).
+    std::size_t size() const {
+        return count_of(this->root());
     }
 
-    void set_root(NodeBase* r) {
-        this->data.right().right() = r;
+    // the k-th smallest node counting from 0, nullptr if k >= size()
+    node_pointer select(std::size_t k) const {
+        Hook* p = this->root();
+        while(p != nullptr) {
+            auto nl = count_of(p->left);
+            if(k < nl) {
+                p = p->left;
+            } else if(k > nl) {
+                k -= nl + 1;
+                p = p->right;
+            } else return static_cast<node_pointer>(p);
+        }
+        return nullptr;
     }
-};
 
-}
+    // the number of nodes before node, size() for nullptr (the end)
+    std::size_t rank(const node_type* node) const {
+        if(node == nullptr) {
+            return size();
+        }
+        const Hook* p = node;
+        std::size_t r = count_of(p->left);
+        for(const Hook* q = p->parent(); q != nullptr; p = q, q = q->parent()) {
+            if(q->right == p) {
+                r += count_of(q->left) + 1;
+            }
+        }
+        return r;
+    }
 
-template<typename NodeType, typename Key, typename GetKey, typename Compare = std::less<Key>>
-class rbtree : public impl::bstree<NodeType, Key, GetKey, Compare> {
-    using Base = impl::bstree<NodeType, Key, GetKey, Compare>;
-public:
-    using node_type = NodeType;
-    using node_pointer = node_type*;
-    using compare = Compare;
-    using value_type = Key;
+    // the number of nodes with keys in [lower, upper)
+    std::size_t count_range(const Key& lower, const Key& upper) const {
+        auto n = count_less(upper), m = count_less(lower);
+        return n > m ? n - m : 0;
+    }
+    template<typename L, typename U, typename C = Compare, typename = typename C::is_transparent>
+    std::size_t count_range(const L& lower, const U& upper) const {
+        auto n = count_less(upper), m = count_less(lower);
+        return n > m ? n - m : 0;
+    }
 
-    rbtree(const GetKey& key = GetKey(), const Compare& comp = Compare()) : Base(key, comp) {}
-    rbtree(const Compare& comp) : Base(GetKey(), comp) {}
+protected:
+    using ordering = impl::ordering<Compare, Key>;
 
-    void insert(node_pointer node) {
-        this->insert_bst(node);
-        this->set_root(rb_post_insert(node, this->root()));
+    // the comparator as a less-than predicate
+    auto key_less() const -> decltype(ordering::less(this->data.right().left())) {
+        return ordering::less(this->data.right().left());
     }
-    void insert_unique(node_pointer node) {
-        if (this->insert_unique_bst(node)) {
-            this->set_root(rb_post_insert(node, this->root()));
+    // negative, zero or positive as a is less than, equal to or greater than b
+    template<typename A, typename B>
+    auto key_compare(const A& a, const B& b) const -> decltype(ordering::compare(this->data.right().left(), a, b)) {
+        return ordering::compare(this->data.right().left(), a, b);
+    }
+
+    // A probe compares a value with the keys of nodes. On nodes derived from prefix_node_hook
+    // it compares the prefixes first and calls GetKey and Compare only when they are equal, so
+    // that the descent does not reach for keys kept outside the nodes.
+    template<typename K, bool = std::is_base_of<PrefixNodeBase, NodeType>::value>
+    struct probe {
+        const bstree& tree;
+        const K& value;
+        using result = decltype(ordering::compare(std::declval<const Compare&>(), std::declval<const K&>(),
+                                                  std::declval<const GetKey&>()(std::declval<const NodeType&>())));
+        probe(const bstree& t, const K& v) : tree(t), value(v) {}
+        // negative, zero or positive as value is less than, equal to or greater than the key of p
+        result compare(const node_type* p) const {
+            return tree.key_compare(value, tree.data.left()(*p));
+        }
+        // value is less than the key of p
+        bool before(const node_type* p) const {
+            return tree.key_less()(value, tree.data.left()(*p));
+        }
+        // the key of p is less than value
+        bool after(const node_type* p) const {
+            return tree.key_less()(tree.data.left()(*p), value);
+        }
+    };
+
+    template<typename K>
+    struct probe<K, true> {
+        const bstree& tree;
+        const K& value;
+        std::uint64_t prefix;
+        probe(const bstree& t, const K& v) : tree(t), value(v), prefix(t.prefix_of(v)) {}
+        int compare(const node_type* p) const {
+            if(prefix != p->prefix) {
+                return prefix < p->prefix ? -1 : 1;
+            }
+            auto c = tree.key_compare(value, tree.data.left()(*p));
+            return (c > 0) - (c < 0);
+        }
+        bool before(const node_type* p) const {
+            return prefix != p->prefix ? prefix < p->prefix : tree.key_less()(value, tree.data.left()(*p));
+        }
+        bool after(const node_type* p) const {
+            return prefix != p->prefix ? p->prefix < prefix : tree.key_less()(tree.data.left()(*p), value);
+        }
+    };
+
+    template<typename K>
+    probe<K> probe_for(const K& value) const {
+        return probe<K>(*this, value);
+    }
+
+    template<typename K>
+    std::uint64_t prefix_of(const K& value) const {
+        return impl::prefix_of<Compare, Key>::get(this->data.right().left(), value);
+    }
+
+    // store the prefix of the key of a node about to be linked
+    void keep_prefix(node_pointer node) const {
+        keep_prefix(node, std::is_base_of<PrefixNodeBase, NodeType>());
+    }
+    void keep_prefix(node_pointer, std::false_type) const {}
+    void keep_prefix(node_pointer node, std::true_type) const {
+        node->prefix = prefix_of(this->data.left()(*node));
+    }
+
+    // the lookups for a probe of type K, a Key or one Compare takes beside it
+    template<typename K>
+    node_pointer search_by(const K& value) const {
+        auto v = probe_for(value);
+        auto p = static_cast<node_pointer>(this->root());
+        while(p != nullptr) {
+            auto c = v.compare(p);
+            if(c < 0) {
+                p = static_cast<node_pointer>(p->left);
+            } else if(c > 0) {
+                p = static_cast<node_pointer>(p->right);
+            } else return p;
+        }
+        return nullptr;
+    }
+
+    template<typename K>
+    node_pointer lower_bound_by(const K& value) const {
+        auto v = probe_for(value);
+        return lower_bound_impl(root(), [&](node_pointer p) { return v.after(p); });
+    }
+
+    template<typename K>
+    node_pointer upper_bound_by(const K& value) const {
+        auto v = probe_for(value);
+        return lower_bound_impl(root(), [&](node_pointer p) { return !v.before(p); });
+    }
+
+    template<typename L, typename U>
+    std::pair<node_pointer, node_pointer> search_range_by(const L& lower, const U& upper) const {
+        auto vl = probe_for(lower);
+        auto vu = probe_for(upper);
+        auto p = static_cast<node_pointer>(this->root());
+        while(p != nullptr) {
+            auto cl = vl.compare(p);
+            auto cu = vu.compare(p);
+            if(cl < 0 && cu < 0) {
+                p = static_cast<node_pointer>(p->left);
+            } else if(cl > 0 && cu > 0) {
+                p = static_cast<node_pointer>(p->right);
+            } else return {lower_bound_impl(p, [&](node_pointer q) { return vl.after(q); }),
+                           lower_bound_impl(p, [&](node_pointer q) { return vu.after(q); })};
+        }
+        return {nullptr, nullptr};
+    }
+
+    static std::size_t count_of(const Hook* node) {
+        static_assert(std::is_base_of<CountedNodeBase, NodeType>::value, "The node type is not a subclass of counted_node_hook");
+        return node ? static_cast<const CountedNodeBase*>(node)->count : 0;
+    }
+
+    // the number of nodes with keys less than value
+    template<typename K>
+    std::size_t count_less(const K& value) const {
+        auto v = probe_for(value);
+        auto p = this->root();
+        std::size_t n = 0;
+        while(p != nullptr) {
+            if(v.after(p)) {
+                n += count_of(p->left) + 1;
+                p = static_cast<node_pointer>(p->right);
+            } else {
+                p = static_cast<node_pointer>(p->left);
+            }
+        }
+        return n;
+    }
+
+    // the first node in the subtree of p for which right is false, or the next node after it
+    template<typename F>
+    node_pointer lower_bound_impl(node_pointer p, F&& right) const {
+        node_pointer q = nullptr;
+        bool last_dir = false;
+        while(p != nullptr) {
+            q = p;
+            last_dir = right(p);
+            if(last_dir) {
+                p = static_cast<node_pointer>(p->right);
+            } else {
+                p = static_cast<node_pointer>(p->left);
+            }
+        }
+        if(last_dir) {
+            return static_cast<node_pointer>(bst_next(q));
+        }
+        return q;
+    }
+
+    void insert_bst(node_pointer node) {
+        auto&& k = this->data.left()(*node);
+        auto v = probe_for(k);
+        node_pointer parent = nullptr, p = this->root();
+        bool left = false;
+        while(p != nullptr) {
+            parent = p;
+            left = v.before(parent); // allow duplicate
+            p = static_cast<node_pointer>(child_of<Hook>(parent, left));
+        }
+        link_leaf(parent, left, node);
+    }
+
+    bool insert_unique_bst(node_pointer node) {
+        auto&& k = this->data.left()(*node);
+        auto v = probe_for(k);
+        node_pointer parent = nullptr, p = this->root();
+        bool left = false;
+        while(p != nullptr) {
+            parent = p;
+            auto c = v.compare(parent);
+            if(c < 0) { // not allow duplicate
+                left = true;
+            } else if(c > 0) {
+                left = false;
+            } else return false;
+            p = static_cast<node_pointer>(child_of<Hook>(parent, left));
+        }
+        link_leaf(parent, left, node);
+        return true;
+    }
+
+    // Link node as a leaf right before hint (nullptr for the end) or right after it, if its
+    // key belongs there; return false if it does not. Only the neighbors of hint are compared,
+    // but they are found by bst_last, bst_prev or bst_next, O(log n) pointer steps at worst.
+    template<bool Unique>
+    bool insert_hint_bst(node_pointer hint, node_pointer node) {
+        auto& key = this->data.left();
+        auto&& comp = key_less();
+        auto ordered = [&](Hook* a, Hook* b) {
+            auto pa = static_cast<node_pointer>(a), pb = static_cast<node_pointer>(b);
+            return Unique ? comp(key(*pa), key(*pb)) : !comp(key(*pb), key(*pa));
+        };
+        Hook* parent;
+        bool left;
+        Hook* prev = nullptr;
+        if(hint == nullptr || ordered(node, hint)) {
+            prev = (hint == nullptr) ? bst_last(this->root()) : bst_prev(hint);
+            if(prev != nullptr && !ordered(prev, node)) {
+                return false;
+            }
+            if(hint != nullptr && hint->left == nullptr) {
+                parent = hint;
+                left = true;
+            } else {
+                parent = prev;
+                left = false;
+            }
+        } else if(hint != nullptr && ordered(hint, node)) {
+            Hook* next = bst_next(hint);
+            if(next != nullptr && !ordered(node, next)) {
+                return false;
+            }
+            if(hint->right == nullptr) {
+                parent = hint;
+                left = false;
+            } else {
+                parent = next;
+                left = true;
+            }
+        } else return false;
+        link_leaf(parent, left, node);
+        return true;
+    }
+
+    // link node as the left or right child of parent, or as the root if parent is null
+    void link_leaf(Hook* parent, bool left, node_pointer node) {
+        keep_prefix(node);
+        node->left = nullptr;
+        node->right = nullptr;
+        node->set_parent(parent);
+        if(parent == nullptr) {
+            set_root(node);
+        } else if(left) {
+            parent->left = node;
+        } else {
+            parent->right = node;
+        }
+    }
+
+    void set_root(Hook* r) {
+        this->data.right().right() = r;
+    }
+
+    // Insert a batch of nodes: sort it, then merge it into the tree by the cheaper way for the
+    // ratio of their sizes. A tree of at most rebuild_ratio times as many nodes as the batch is
+    // flattened, merged with the batch in one linear pass and built again. A larger tree is
+    // descended once for the whole batch: the root is split off, the sorted batch is cut at
+    // its key by a binary search, each piece goes down its own subtree and the two are joined
+    // back, so one comparison at a node serves the whole piece below it. On equal keys the
+    // nodes of the tree come first and the batch keeps its order, as with a loop of insert.
+    template<typename Ops>
+    void insert_batch_tree(node_pointer* nodes, std::size_t count) {
+        auto& key = this->data.left();
+        auto&& comp = key_less();
+        auto less = [&](node_pointer a, node_pointer b) { return comp(key(*a), key(*b)); };
+        if(!std::is_sorted(nodes, nodes + count, less)) {
+            std::stable_sort(nodes, nodes + count, less);
+        }
+        std::vector<node_pointer> flat;
+        if(flatten(rebuild_ratio * count, flat)) {
+            std::vector<node_pointer> merged(flat.size() + count);
+            std::merge(flat.begin(), flat.end(), nodes, nodes + count, merged.begin(), less);
+            Hook* head = nullptr;
+            chain_nodes(merged.begin(), merged.end(), head);
+            this->set_root(Ops::build(head, merged.size()));
+            return;
+        }
+        int h = Ops::height(this->root());
+        this->set_root(insert_sorted<Ops>(this->root(), h, nodes, nodes + count));
+    }
+
+    static const std::size_t rebuild_ratio = 2;
+
+    // The nodes of the tree in order into out, false if there are more than limit. A path
+    // from the root of a red-black, AVL or WAVL tree of n nodes is at most 2 log2(n + 1) long,
+    // so a longer left spine rules the tree out before it is walked.
+    bool flatten(std::size_t limit, std::vector<node_pointer>& out) const {
+        Hook* p = this->root();
+        for(int depth = 2 * bit_length(limit) + 1; p != nullptr; p = p->left) {
+            if(--depth < 0) {
+                return false;
+            }
+        }
+        for(p = bst_first(this->root()); p != nullptr; p = bst_next(p)) {
+            if(out.size() == limit) {
+                return false;
+            }
+            out.push_back(static_cast<node_pointer>(p));
+        }
+        return true;
+    }
+
+    // Insert the sorted nodes [first, last) into the tree of root and height h, which is
+    // detached from any parent, return the new root and its height in h. Fewer than
+    // batch_split nodes go down one by one, as they would compare once per level anyway.
+    template<typename Ops>
+    Hook* insert_sorted(Hook* root, int& h, node_pointer* first, node_pointer* last) {
+        if(first == last) {
+            return root;
+        }
+        if(root == nullptr) {
+            Hook* head = nullptr;
+            root = Ops::build(head, chain_nodes(first, last, head));
+            h = Ops::height(root);
+            return root;
+        }
+        if(last - first < batch_split) {
+            for(; first != last; ++first) {
+                auto&& k = this->data.left()(**first);
+                auto v = probe_for(k);
+                Hook *parent = nullptr, *p = root;
+                bool left = false;
+                while(p != nullptr) {
+                    parent = p;
+                    left = v.before(static_cast<node_pointer>(p));
+                    p = child_of<Hook>(p, left);
+                }
+                link_leaf(parent, left, *first);
+                root = Ops::post_insert(*first, root);
+            }
+            h = Ops::height(root);
+            return root;
+        }
+        Hook *l, *r;
+        int hl, hr;
+        Ops::split_root(root, h, l, hl, r, hr);
+        auto pivot = static_cast<node_pointer>(root);
+        auto& key = this->data.left();
+        auto&& comp = key_less();
+        auto&& k = key(*pivot);
+        // the nodes equal to the pivot go after it
+        auto middle = std::partition_point(first, last, [&](node_pointer p) { return comp(key(*p), k); });
+        l = insert_sorted<Ops>(l, hl, first, middle);
+        r = insert_sorted<Ops>(r, hr, middle, last);
+        return Ops::join(l, hl, pivot, r, hr, h);
+    }
+
+    static const std::ptrdiff_t batch_split = 3;
+
+    // the last node on the search path of value, nodes with keys less than value are
+    // marked to go to the left part (where = -1), the others to the right part (where = 1)
+    node_pointer split_path(const Key& value, int& where) const {
+        auto& key = this->data.left();
+        auto&& comp = key_less();
+        auto p = this->root();
+        node_pointer q = nullptr;
+        while(p != nullptr) {
+            q = p;
+            if(comp(key(*p), value)) {
+                where = -1;
+                p = static_cast<node_pointer>(p->right);
+            } else {
+                where = 1;
+                p = static_cast<node_pointer>(p->left);
+            }
+        }
+        return q;
+    }
+
+    template<typename Ops, typename Tree>
+    std::pair<Tree, Tree> split_tree(const Key& value, const Tree& self) {
+        Hook *l = nullptr, *r = nullptr;
+        int where = 0, hl, hr;
+        auto node = this->split_path(value, where);
+        if(node != nullptr) {
+            Ops::split(node, where, l, hl, r, hr);
+        }
+        this->set_root(nullptr);
+        std::pair<Tree, Tree> res(self, self);
+        res.first.set_root(l);
+        res.second.set_root(r);
+        return res;
+    }
+
+    template<typename Ops>
+    void join_tree(bstree& left, node_pointer pivot, bstree& right) {
+        int h;
+        keep_prefix(pivot);
+        auto r = Ops::join(left.root(), Ops::height(left.root()), pivot, right.root(), Ops::height(right.root()), h);
+        left.set_root(nullptr);
+        right.set_root(nullptr);
+        this->set_root(r);
+    }
+
+    static node_pointer address_of(node_type& node) {
+        return &node;
+    }
+    static node_pointer address_of(node_pointer node) {
+        return node;
+    }
+
+    // chain the nodes in [first, last) through their right pointers for *_build,
+    // the iterator may yield either nodes or pointers to nodes
+    template<typename Iter>
+    std::size_t chain_nodes(Iter first, Iter last, Hook*& head) const {
+        std::size_t n = 0;
+        node_pointer prev = nullptr;
+        head = nullptr;
+        for(; first != last; ++first, ++n) {
+            node_pointer p = address_of(*first);
+            keep_prefix(p);
+            if(prev == nullptr) {
+                head = p;
+            } else {
+                prev->right = p;
+            }
+            prev = p;
+        }
+        if(prev != nullptr) {
+            prev->right = nullptr;
+        }
+        return n;
+    }
+};
+
+// std::min binds search_group to a reference, so it needs a definition before C++17
+template<typename NodeType, typename Key, typename GetKey, typename Compare>
+const std::size_t bstree<NodeType, Key, GetKey, Compare>::search_group;
+
+// Join-based union, intersection and difference of two trees of the same type, see
+// Blelloch et al., "Just Join for Parallel Ordered Sets". The nodes are relinked into
+// the result, every node that is dropped is passed to dispose.
+template<typename Tree, typename Dispose>
+class set_operation {
+    using node_pointer = typename Tree::node_pointer;
+    using key_type = typename Tree::value_type;
+    using ops = typename Tree::balance_ops;
+    using Hook = typename Tree::hook_type;
+
+    struct part {
+        Hook* root;
+        int height;
+    };
+
+    const Tree& tree;
+    Dispose& dispose;
+
+    bool parallel(const part& a, const part& b) const {
+        return a.height >= ops::parallel_height && b.height >= ops::parallel_height;
+    }
+
+    template<typename F, typename G>
+    void invoke(bool par, F&& f, G&& g) {
+        if(par) {
+            fork_join(f, g);
+        } else {
+            f();
+            g();
+        }
+    }
+
+    // take the root out of a tree, leaving its two subtrees
+    static node_pointer take_root(const part& a, part& l, part& r) {
+        ops::split_root(a.root, a.height, l.root, l.height, r.root, r.height);
+        return static_cast<node_pointer>(a.root);
+    }
+
+    // split a tree into the nodes less than x, the nodes greater than x, and return the
+    // node equal to x if there is one
+    node_pointer split(const part& a, const key_type& x, part& l, part& r) const {
+        auto& key = tree.data.left();
+        auto p = static_cast<node_pointer>(a.root);
+        node_pointer q = nullptr;
+        int where = 0;
+        while(p != nullptr) {
+            q = p;
+            auto c = tree.key_compare(x, key(*p));
+            if(c > 0) {
+                where = -1;
+                p = static_cast<node_pointer>(p->right);
+            } else if(c < 0) {
+                where = 1;
+                p = static_cast<node_pointer>(p->left);
+            } else {
+                where = 0;
+                break;
+            }
+        }
+        if(q == nullptr) {
+            l.root = r.root = nullptr;
+            l.height = r.height = ops::null_height;
+            return nullptr;
+        }
+        ops::split(q, where, l.root, l.height, r.root, r.height);
+        return (where == 0) ? q : nullptr;
+    }
+
+    void dispose_all(Hook* node) {
+        if(node != nullptr) {
+            Hook *l = node->left, *r = node->right;
+            dispose(static_cast<node_pointer>(node));
+            dispose_all(l);
+            dispose_all(r);
+        }
+    }
+
+    part join(const part& l, node_pointer pivot, const part& r) {
+        part res;
+        res.root = ops::join(l.root, l.height, pivot, r.root, r.height, res.height);
+        return res;
+    }
+
+    part join2(const part& l, const part& r) {
+        part res;
+        res.root = ops::join2(l.root, l.height, r.root, r.height, res.height);
+        return res;
+    }
+
+    part unite(const part& a, const part& b) {
+        if(a.root == nullptr) return b;
+        if(b.root == nullptr) return a;
+        part al, ar, bl, br, l, r;
+        auto pivot = take_root(a, al, ar);
+        auto dup = split(b, tree.data.left()(*pivot), bl, br);
+        invoke(parallel(a, b), [&]() { l = unite(al, bl); }, [&]() { r = unite(ar, br); });
+        if(dup != nullptr) {
+            dispose(dup);
+        }
+        return join(l, pivot, r);
+    }
+
+    part intersect(const part& a, const part& b) {
+        if(a.root == nullptr || b.root == nullptr) {
+            dispose_all(a.root);
+            dispose_all(b.root);
+            return part{nullptr, ops::null_height};
+        }
+        part al, ar, bl, br, l, r;
+        auto pivot = take_root(a, al, ar);
+        auto dup = split(b, tree.data.left()(*pivot), bl, br);
+        invoke(parallel(a, b), [&]() { l = intersect(al, bl); }, [&]() { r = intersect(ar, br); });
+        if(dup != nullptr) {
+            dispose(dup);
+            return join(l, pivot, r);
+        }
+        dispose(pivot);
+        return join2(l, r);
+    }
+
+    part subtract(const part& a, const part& b) {
+        if(a.root == nullptr || b.root == nullptr) {
+            dispose_all(b.root);
+            return a;
+        }
+        part al, ar, bl, br, l, r;
+        auto pivot = take_root(b, bl, br);
+        auto dup = split(a, tree.data.left()(*pivot), al, ar);
+        invoke(parallel(a, b), [&]() { l = subtract(al, bl); }, [&]() { r = subtract(ar, br); });
+        dispose(pivot);
+        if(dup != nullptr) {
+            dispose(dup);
+        }
+        return join2(l, r);
+    }
+
+    template<typename Op>
+    void run(Tree& a, Tree& b, Op op) {
+        part pa{a.root(), ops::height(a.root())}, pb{b.root(), ops::height(b.root())};
+        auto res = (this->*op)(pa, pb);
+        b.set_root(nullptr);
+        a.set_root(res.root);
+    }
+
+public:
+    set_operation(const Tree& t, Dispose& d) : tree(t), dispose(d) {}
+
+    void set_union(Tree& a, Tree& b) {
+        run(a, b, &set_operation::unite);
+    }
+    void set_intersection(Tree& a, Tree& b) {
+        run(a, b, &set_operation::intersect);
+    }
+    void set_difference(Tree& a, Tree& b) {
+        run(a, b, &set_operation::subtract);
+    }
+};
+
+struct ignore_node {
+    template<typename T>
+    void operator()(const T*) const {}
+};
+
+}
+
+template<typename NodeType, typename Key, typename GetKey, typename Compare = std::less<Key>, typename Augment = void,
+         typename Balance = void>
+class rbtree : public impl::bstree<NodeType, Key, GetKey, Compare> {
+    using Base = impl::bstree<NodeType, Key, GetKey, Compare>;
+public:
+    using node_type = NodeType;
+    using node_pointer = node_type*;
+    using compare = Compare;
+    using value_type = Key;
+    using balance_ops = impl::balance_policy_ops<impl::rb_ops, NodeType, Augment, Balance>;
+
+    rbtree(const GetKey& key = GetKey(), const Compare& comp = Compare()) : Base(key, comp) {}
+    rbtree(const Compare& comp) : Base(GetKey(), comp) {}
+
+    void insert(node_pointer node) {
+        this->insert_bst(node);
+        this->set_root(balance_ops::post_insert(node, this->root()));
+    }
+    // return false if there is already a node with the same key, node is not inserted then
+    bool insert_unique(node_pointer node) {
+        if (this->insert_unique_bst(node)) {
+            this->set_root(balance_ops::post_insert(node, this->root()));
+            return true;
+        }
+        return false;
+    }
+    // insert node next to hint (nullptr for the end) with O(1) comparisons if it belongs
+    // there, otherwise as insert does; finding the neighbor of the end or of the last node
+    // still walks the right spine, bst::cached_ends appends in O(1)
+    void insert(node_pointer hint, node_pointer node) {
+        if (!this->template insert_hint_bst<false>(hint, node)) {
+            this->insert_bst(node);
+        }
+        this->set_root(balance_ops::post_insert(node, this->root()));
+    }
+    bool insert_unique(node_pointer hint, node_pointer node) {
+        if (this->template insert_hint_bst<true>(hint, node) || this->insert_unique_bst(node)) {
+            this->set_root(balance_ops::post_insert(node, this->root()));
+            return true;
+        }
+        return false;
+    }
+    // insert the count nodes of the array, which is reordered on the way
+    void insert_batch(node_pointer* nodes, std::size_t count) {
+        this->template insert_batch_tree<balance_ops>(nodes, count);
+    }
+    void erase(node_pointer node) {
+        this->set_root(balance_ops::erase(node, this->root()));
+    }
+    // recompute the aggregates of node and its ancestors after node was changed in place
+    void update_path(node_pointer node) {
+        static_assert(!std::is_void<Augment>::value, "The tree has no augmentation policy");
+        impl::augment_with<NodeType, Augment>::propagate(node);
+    }
+    // replace the content with the nodes in [first, last), which must be sorted, in O(n)
+    template<typename Iter>
+    void build_sorted(Iter first, Iter last) {
+        typename Base::hook_type* head = nullptr;
+        auto n = this->chain_nodes(first, last, head);
+        this->set_root(balance_ops::build(head, n));
+    }
+    // move the nodes with keys less than value to the first tree and the others to the
+    // second one in O(log n), this tree becomes empty
+    std::pair<rbtree, rbtree> split(const Key& value) {
+        return this->template split_tree<balance_ops>(value, *this);
+    }
+    // replace the content with the nodes of left, pivot and the nodes of right in O(log n),
+    // no key in left is greater than pivot and no key in right is less than pivot;
+    // left and right become empty, either of them may be this tree
+    void join(rbtree& left, node_pointer pivot, rbtree& right) {
+        this->template join_tree<balance_ops>(left, pivot, right);
+    }
+};
+
+template<typename NodeType, typename Key, typename GetKey, typename Compare = std::less<Key>, typename Augment = void,
+         typename Balance = void>
+class avl : public impl::bstree<NodeType, Key, GetKey, Compare> {
+    using Base = impl::bstree<NodeType, Key, GetKey, Compare>;
+public:
+    using node_type = NodeType;
+    using node_pointer = node_type*;
+    using compare = Compare;
+    using value_type = Key;
+    using balance_ops = impl::balance_policy_ops<impl::avl_ops, NodeType, Augment, Balance>;
+
+    avl(const GetKey& key = GetKey(), const Compare& comp = Compare()) : Base(key, comp) {}
+    avl(const Compare& comp) : Base(GetKey(), comp) {}
+
+    void insert(node_pointer node) {
+        this->insert_bst(node);
+        this->set_root(balance_ops::post_insert(node, this->root()));
+    }
+    // return false if there is already a node with the same key, node is not inserted then
+    bool insert_unique(node_pointer node) {
+        if (this->insert_unique_bst(node)) {
+            this->set_root(balance_ops::post_insert(node, this->root()));
+            return true;
+        }
+        return false;
+    }
+    // insert node next to hint (nullptr for the end) with O(1) comparisons if it belongs
+    // there, otherwise as insert does; finding the neighbor of the end or of the last node
+    // still walks the right spine, bst::cached_ends appends in O(1)
+    void insert(node_pointer hint, node_pointer node) {
+        if (!this->template insert_hint_bst<false>(hint, node)) {
+            this->insert_bst(node);
+        }
+        this->set_root(balance_ops::post_insert(node, this->root()));
+    }
+    bool insert_unique(node_pointer hint, node_pointer node) {
+        if (this->template insert_hint_bst<true>(hint, node) || this->insert_unique_bst(node)) {
+            this->set_root(balance_ops::post_insert(node, this->root()));
+            return true;
+        }
+        return false;
+    }
+    // insert the count nodes of the array, which is reordered on the way
+    void insert_batch(node_pointer* nodes, std::size_t count) {
+        this->template insert_batch_tree<balance_ops>(nodes, count);
+    }
+    void erase(node_pointer node) {
+        this->set_root(balance_ops::erase(node, this->root()));
+    }
+    // recompute the aggregates of node and its ancestors after node was changed in place
+    void update_path(node_pointer node) {
+        static_assert(!std::is_void<Augment>::value, "The tree has no augmentation policy");
+        impl::augment_with<NodeType, Augment>::propagate(node);
+    }
+    // replace the content with the nodes in [first, last), which must be sorted, in O(n)
+    template<typename Iter>
+    void build_sorted(Iter first, Iter last) {
+        typename Base::hook_type* head = nullptr;
+        auto n = this->chain_nodes(first, last, head);
+        this->set_root(balance_ops::build(head, n));
+    }
+    // move the nodes with keys less than value to the first tree and the others to the
+    // second one in O(log n), this tree becomes empty
+    std::pair<avl, avl> split(const Key& value) {
+        return this->template split_tree<balance_ops>(value, *this);
+    }
+    // replace the content with the nodes of left, pivot and the nodes of right in O(log n),
+    // no key in left is greater than pivot and no key in right is less than pivot;
+    // left and right become empty, either of them may be this tree
+    void join(avl& left, node_pointer pivot, avl& right) {
+        this->template join_tree<balance_ops>(left, pivot, right);
+    }
+};
+
+template<typename NodeType, typename Key, typename GetKey, typename Compare = std::less<Key>, typename Augment = void,
+         typename Balance = void>
+class wavl : public impl::bstree<NodeType, Key, GetKey, Compare> {
+    using Base = impl::bstree<NodeType, Key, GetKey, Compare>;
+public:
+    using node_type = NodeType;
+    using node_pointer = node_type*;
+    using compare = Compare;
+    using value_type = Key;
+    using balance_ops = impl::balance_policy_ops<impl::wavl_ops, NodeType, Augment, Balance>;
+
+    wavl(const GetKey& key = GetKey(), const Compare& comp = Compare()) : Base(key, comp) {}
+    wavl(const Compare& comp) : Base(GetKey(), comp) {}
+
+    void insert(node_pointer node) {
+        this->insert_bst(node);
+        this->set_root(balance_ops::post_insert(node, this->root()));
+    }
+    // return false if there is already a node with the same key, node is not inserted then
+    bool insert_unique(node_pointer node) {
+        if (this->insert_unique_bst(node)) {
+            this->set_root(balance_ops::post_insert(node, this->root()));
+            return true;
+        }
+        return false;
+    }
+    // insert node next to hint (nullptr for the end) with O(1) comparisons if it belongs
+    // there, otherwise as insert does; finding the neighbor of the end or of the last node
+    // still walks the right spine, bst::cached_ends appends in O(1)
+    void insert(node_pointer hint, node_pointer node) {
+        if (!this->template insert_hint_bst<false>(hint, node)) {
+            this->insert_bst(node);
+        }
+        this->set_root(balance_ops::post_insert(node, this->root()));
+    }
+    bool insert_unique(node_pointer hint, node_pointer node) {
+        if (this->template insert_hint_bst<true>(hint, node) || this->insert_unique_bst(node)) {
+            this->set_root(balance_ops::post_insert(node, this->root()));
+            return true;
+        }
+        return false;
+    }
+    // insert the count nodes of the array, which is reordered on the way
+    void insert_batch(node_pointer* nodes, std::size_t count) {
+        this->template insert_batch_tree<balance_ops>(nodes, count);
+    }
+    void erase(node_pointer node) {
+        this->set_root(balance_ops::erase(node, this->root()));
+    }
+    // recompute the aggregates of node and its ancestors after node was changed in place
+    void update_path(node_pointer node) {
+        static_assert(!std::is_void<Augment>::value, "The tree has no augmentation policy");
+        impl::augment_with<NodeType, Augment>::propagate(node);
+    }
+    // replace the content with the nodes in [first, last), which must be sorted, in O(n)
+    template<typename Iter>
+    void build_sorted(Iter first, Iter last) {
+        typename Base::hook_type* head = nullptr;
+        auto n = this->chain_nodes(first, last, head);
+        this->set_root(balance_ops::build(head, n));
+    }
+    // move the nodes with keys less than value to the first tree and the others to the
+    // second one in O(log n), this tree becomes empty
+    std::pair<wavl, wavl> split(const Key& value) {
+        return this->template split_tree<balance_ops>(value, *this);
+    }
+    // replace the content with the nodes of left, pivot and the nodes of right in O(log n),
+    // no key in left is greater than pivot and no key in right is less than pivot;
+    // left and right become empty, either of them may be this tree
+    void join(wavl& left, node_pointer pivot, wavl& right) {
+        this->template join_tree<balance_ops>(left, pivot, right);
+    }
+};
+
+// A splay tree: search and insert bring the node to the root by rotations, so keys that
+// are accessed often stay near the top. To cut the writes, set_semi_splay(true) only halves
+// the depth of the path and set_splay_period(k) splays on every k-th access only. The
+// const search does not splay. Erase unlinks the node as in an unbalanced tree.
+template<typename NodeType, typename Key, typename GetKey, typename Compare = std::less<Key>>
+class splay : public impl::bstree<NodeType, Key, GetKey, Compare> {
+    using Base = impl::bstree<NodeType, Key, GetKey, Compare>;
+public:
+    using node_type = NodeType;
+    using node_pointer = node_type*;
+    using compare = Compare;
+    using value_type = Key;
+
+    splay(const GetKey& key = GetKey(), const Compare& comp = Compare()) : Base(key, comp), period(1), countdown(1), semi(false) {}
+    splay(const Compare& comp) : Base(GetKey(), comp), period(1), countdown(1), semi(false) {}
+
+    void set_semi_splay(bool s) {
+        semi = s;
+    }
+    void set_splay_period(unsigned k) {
+        period = countdown = k > 0 ? k : 1;
+    }
+
+    using Base::search;
+    node_pointer search(const Key& value) {
+        return splay_found(this->search_by(value));
+    }
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    node_pointer search(const K& value) {
+        return splay_found(this->search_by(value));
+    }
+    void insert(node_pointer node) {
+        this->insert_bst(node);
+        access(node);
+    }
+    // return false if there is already a node with the same key, node is not inserted then
+    bool insert_unique(node_pointer node) {
+        if (this->insert_unique_bst(node)) {
+            access(node);
+            return true;
+        }
+        return false;
+    }
+    void erase(node_pointer node) {
+        this->set_root(impl::splay_erase(node, this->root()));
+    }
+    // splay node, e.g. after it was found by lower_bound or an iterator
+    void access(node_pointer node) {
+        if (--countdown == 0) {
+            countdown = period;
+            this->set_root(semi ? impl::semi_splay(node, this->root()) : impl::splay(node, this->root()));
+        }
+    }
+
+private:
+    node_pointer splay_found(node_pointer node) {
+        if (node != nullptr) {
+            access(node);
+        }
+        return node;
+    }
+
+    unsigned period;
+    unsigned countdown;
+    bool semi;
+};
+
+namespace iter {
+    
+template<typename NodeType>
+class Iterator {
+    NodeType* NodePtr;
+public:
+    using difference_type = std::ptrdiff_t;
+    using value_type = NodeType;
+    using pointer = value_type*;
+    using reference = value_type&;
+    using iterator_category = std::bidirectional_iterator_tag;
+    explicit Iterator(NodeType* c) : NodePtr(c) {}
+    Iterator(const Iterator& c) : NodePtr(c.NodePtr) {}
+
+    Iterator& operator++() {
+        NodePtr = static_cast<NodeType*>(bst_next(NodePtr));
+        return *this;
+    }
+    Iterator& operator--() {
+        NodePtr = static_cast<NodeType*>(bst_prev(NodePtr));
+        return *this;
+    }
+    Iterator operator++(int) {
+        Iterator res (*this);
+        ++(*this);
+        return res;
+    }
+    Iterator operator--(int) {
+        Iterator res (*this);
+        --(*this);
+        return res;
+    }
+    bool operator==(const Iterator& other) const { return NodePtr == other.NodePtr; }
+    bool operator!=(const Iterator& other) const { return NodePtr != other.NodePtr; }
+    bool operator==(std::nullptr_t) const { return NodePtr == nullptr; }
+    bool operator!=(std::nullptr_t) const { return NodePtr != nullptr; }
+    reference operator*() const { return *NodePtr; }
+    pointer operator->() const { return NodePtr; }
+};
+
+
+template<typename NodeType>
+class ReverseIterator {
+    NodeType* NodePtr;
+public:
+    using difference_type = std::ptrdiff_t;
+    using value_type = NodeType;
+    using pointer = value_type*;
+    using reference = value_type&;
+    using iterator_category = std::bidirectional_iterator_tag;
+
+    explicit ReverseIterator(NodeType* c) : NodePtr(c) {}
+    ReverseIterator(const ReverseIterator& c) : NodePtr(c.NodePtr) {}
+
+    ReverseIterator& operator++() {
+        NodePtr = static_cast<NodeType*>(bst_prev(NodePtr));
+        return *this;
+    }
+    ReverseIterator& operator--() {
+        NodePtr = static_cast<NodeType*>(bst_next(NodePtr));
+        return *this;
+    }
+    ReverseIterator operator++(int) {
+        ReverseIterator res (*this);
+        ++(*this);
+        return res;
+    }
+    ReverseIterator operator--(int) {
+        ReverseIterator res (*this);
+        --(*this);
+        return res;
+    }
+    bool operator==(const ReverseIterator& other) const { return NodePtr == other.NodePtr; }
+    bool operator!=(const ReverseIterator& other) const { return NodePtr != other.NodePtr; }
+    bool operator==(std::nullptr_t) const { return NodePtr == nullptr; }
+    bool operator!=(std::nullptr_t) const { return NodePtr != nullptr; }
+    reference operator*() const { return *NodePtr; }
+    pointer operator->() const { return NodePtr; }
+};
+
+template<typename Iter>
+class FullRange {
+    Iter first;
+public:
+    explicit FullRange(const Iter& i) : first(i) {}
+    FullRange(const FullRange& r) : first(r.first) {}
+    Iter begin() const {
+        return first;
+    }
+    Iter end() const {
+        return Iter(nullptr);
+    }
+};
+
+template<typename Iter>
+class Range : public FullRange<Iter> {
+    Iter last;
+public:
+    explicit Range(Iter first, Iter last_) : FullRange<Iter>(first), last(last_) {}
+    Range(const Range& r) : FullRange<Iter>(r), last(r.last) {}
+    Iter end() const {
+        return last;
+    }
+};
+}
+
+
+using node_hook = impl::NodeBase;
+using counted_node_hook = impl::CountedNodeBase;
+using compact_node_hook = impl::CompactNodeBase;
+using offset_node_hook = impl::OffsetNodeBase;
+using lean_node_hook = impl::LeanNodeBase;
+using sided_node_hook = impl::SidedNodeBase;
+using prefix_node_hook = impl::PrefixNodeBase;
+using atomic_node_hook = impl::AtomicNodeBase;
+
+// The prefix kept in a prefix_node_hook: 8 bytes that order like the key, so a < b implies
+// key_prefix(a) <= key_prefix(b). Defined for integers and strings ordered by std::less,
+// other key types can specialize it, other orders give their comparator a prefix member.
+template<typename Key>
+struct key_prefix<Key, typename std::enable_if<std::is_integral<Key>::value>::type> {
+    std::uint64_t operator()(Key key) const {
+        return static_cast<std::uint64_t>(key) ^ (std::is_signed<Key>::value ? std::uint64_t(1) << 63 : 0);
+    }
+};
+
+// the first 8 bytes, big-endian and padded with zeros
+template<>
+struct key_prefix<std::string> {
+    std::uint64_t operator()(const std::string& key) const {
+        std::uint64_t prefix = 0;
+        for(std::size_t i = 0; i < 8 && i < key.size(); ++i) {
+            prefix |= std::uint64_t(static_cast<unsigned char>(key[i])) << (56 - 8 * i);
+        }
+        return prefix;
+    }
+};
+
+// set the number of threads used by the parallel algorithms, 0 for the hardware
+// concurrency; must not be called while any of them is running
+extern unsigned set_parallelism(unsigned threads);
+
+// The set operations relink the nodes of both trees into a, b becomes empty.
+// Keys are assumed to be unique in each tree. The nodes not in the result are passed
+// to dispose, which may be called concurrently from several threads.
+// union: for equal keys the node of a is kept
+template<typename Tree, typename Dispose = impl::ignore_node>
+inline void set_union(Tree& a, Tree& b, Dispose dispose = Dispose()) {
+    impl::set_operation<Tree, Dispose>(a, dispose).set_union(a, b);
+}
+
+// intersection: the nodes of a whose keys are in b
+template<typename Tree, typename Dispose = impl::ignore_node>
+inline void set_intersection(Tree& a, Tree& b, Dispose dispose = Dispose()) {
+    impl::set_operation<Tree, Dispose>(a, dispose).set_intersection(a, b);
+}
+
+// difference: the nodes of a whose keys are not in b
+template<typename Tree, typename Dispose = impl::ignore_node>
+inline void set_difference(Tree& a, Tree& b, Dispose dispose = Dispose()) {
+    impl::set_operation<Tree, Dispose>(a, dispose).set_difference(a, b);
+}
+
+template<typename BST>
+inline iter::FullRange<iter::Iterator<typename BST::node_type>> range(BST& bst) {
+    using it = iter::Iterator<typename BST::node_type>;
+    return iter::FullRange<it>(it(bst.first()));
+}
+
+template<typename BST>
+inline iter::FullRange<iter::Iterator<typename BST::node_type>> crange(const BST& bst) {
+    using it = iter::Iterator<const typename BST::node_type>;
+    return iter::FullRange<it>(it(bst.first()));
+}
+
+template<typename BST>
+inline iter::FullRange<iter::ReverseIterator<typename BST::node_type>> rrange(BST& bst) {
+    using it = iter::ReverseIterator<typename BST::node_type>;
+    return iter::FullRange<it>(it(bst.last()));
+}
+
+template<typename BST>
+inline iter::FullRange<iter::ReverseIterator<typename BST::node_type>> crrange(const BST& bst) {
+    using it = iter::ReverseIterator<const typename BST::node_type>;
+    return iter::FullRange<it>(it(bst.last()));
+}
+
+template<typename NodeType>
+inline iter::Range<iter::Iterator<NodeType>> range(NodeType* first, NodeType* last) {
+    typedef iter::Iterator<NodeType> it;
+    return iter::Range<it>(it(first), it(last));
+}
+
+template<typename NodeType>
+inline iter::Range<iter::Iterator<const NodeType>> crange(NodeType* first, NodeType* last) {
+    typedef iter::Iterator<const NodeType> it;
+    return iter::Range<it>(it(first), it(last));
+}
+
+template<typename NodeType>
+inline iter::Range<iter::Iterator<NodeType>> range(const std::pair<NodeType*,NodeType*>& r) {
+    return range(r.first, r.second);
+}
+
+template<typename NodeType>
+inline iter::Range<iter::Iterator<const NodeType>> crange(const std::pair<NodeType*,NodeType*>& r) {
+    return crange(r.first, r.second);
+}
+
+
+namespace impl {
+
+template<typename Key>
+struct IntervalNodeBase : NodeBase {
+    Key max_end;
+};
+
+// keeps the greatest end point of every subtree in max_end
+template<typename NodeType, typename GetHigh, typename Compare>
+struct max_end_policy {
+    static void update(NodeType& node) {
+        Compare comp;
+        node.max_end = GetHigh()(node);
+        for(auto child : {node.left, node.right}) {
+            if(child != nullptr && comp(node.max_end, static_cast<NodeType*>(child)->max_end)) {
+                node.max_end = static_cast<NodeType*>(child)->max_end;
+            }
+        }
+    }
+};
+
+// Visits the nodes whose intervals overlap [lo, hi), or contain lo for a stabbing query,
+// in the order of their lower end points. The subtrees whose max_end is not above lo are
+// skipped, and the walk stops at the first node whose lower end point is past the query.
+template<typename NodeType, typename Key, typename GetLow, typename GetHigh, typename Compare>
+class OverlapIterator {
+    NodeType* NodePtr;
+    Key lo, hi;
+    bool stabbing;
+
+    bool reaches(NodeBase* p) const {
+        return Compare()(lo, static_cast<NodeType*>(p)->max_end);
+    }
+    bool starts_before(NodeType* p) const {
+        auto low = GetLow()(*p);
+        return stabbing ? !Compare()(lo, low) : Compare()(low, hi);
+    }
+    // the first node with an upper end point above lo in the subtree of p, reaches(p) holds
+    NodeType* first_in(NodeBase* p) const {
+        for(;;) {
+            if(p->left != nullptr && reaches(p->left)) {
+                p = p->left;
+            } else if(Compare()(lo, GetHigh()(*static_cast<NodeType*>(p)))) {
+                return static_cast<NodeType*>(p);
+            } else {
+                p = p->right;
+            }
+        }
+    }
+    NodeType* check(NodeType* p) const {
+        return (p != nullptr && starts_before(p)) ? p : nullptr;
+    }
+    NodeType* next(NodeBase* p) const {
+        if(p->right != nullptr && reaches(p->right)) {
+            return check(first_in(p->right));
+        }
+        for(auto parent = p->parent(); parent != nullptr; p = parent, parent = p->parent()) {
+            if(parent->left == p) {
+                auto q = static_cast<NodeType*>(parent);
+                if(!starts_before(q)) {
+                    return nullptr;
+                }
+                if(Compare()(lo, GetHigh()(*q))) {
+                    return q;
+                }
+                if(parent->right != nullptr && reaches(parent->right)) {
+                    return check(first_in(parent->right));
+                }
+            }
+        }
+        return nullptr;
+    }
+
+public:
+    using difference_type = std::ptrdiff_t;
+    using value_type = NodeType;
+    using pointer = value_type*;
+    using reference = value_type&;
+    using iterator_category = std::forward_iterator_tag;
+
+    explicit OverlapIterator(std::nullptr_t) : NodePtr(nullptr), lo(), hi(), stabbing(false) {}
+    OverlapIterator(NodeType* root, const Key& l, const Key& h, bool point)
+        : NodePtr(nullptr), lo(l), hi(h), stabbing(point) {
+        if(root != nullptr && reaches(root)) {
+            NodePtr = check(first_in(root));
+        }
+    }
+
+    OverlapIterator& operator++() {
+        NodePtr = next(NodePtr);
+        return *this;
+    }
+    OverlapIterator operator++(int) {
+        OverlapIterator res (*this);
+        ++(*this);
+        return res;
+    }
+    bool operator==(const OverlapIterator& other) const { return NodePtr == other.NodePtr; }
+    bool operator!=(const OverlapIterator& other) const { return NodePtr != other.NodePtr; }
+    bool operator==(std::nullptr_t) const { return NodePtr == nullptr; }
+    bool operator!=(std::nullptr_t) const { return NodePtr != nullptr; }
+    reference operator*() const { return *NodePtr; }
+    pointer operator->() const { return NodePtr; }
+};
+
+}
+
+template<typename Key>
+using interval_node_hook = impl::IntervalNodeBase<Key>;
+
+// An interval tree over rbtree, avl or wavl: the nodes are ordered by the lower end points
+// of their half-open intervals [GetLow, GetHigh), and every node keeps the greatest upper end
+// point of its subtree. GetHigh and Compare must be default constructible. The overlap queries
+// cost O(log n) to the first result, and skip every subtree that holds no result afterwards.
+template<typename NodeType, typename Key, typename GetLow, typename GetHigh, typename Compare = std::less<Key>,
+         template<typename, typename, typename, typename, typename, typename ...> class Tree = wavl>
+class interval_tree : public Tree<NodeType, Key, GetLow, Compare, impl::max_end_policy<NodeType, GetHigh, Compare>> {
+    static_assert(std::is_base_of<impl::IntervalNodeBase<Key>, NodeType>::value, "The node type is not a subclass of interval_node_hook");
+    using Base = Tree<NodeType, Key, GetLow, Compare, impl::max_end_policy<NodeType, GetHigh, Compare>>;
+public:
+    using node_type = NodeType;
+    using node_pointer = node_type*;
+    using compare = Compare;
+    using value_type = Key;
+    using iterator = impl::OverlapIterator<NodeType, Key, GetLow, GetHigh, Compare>;
+
+    interval_tree(const GetLow& key = GetLow(), const Compare& comp = Compare()) : Base(key, comp) {}
+
+    // the nodes whose intervals overlap [lo, hi)
+    iter::FullRange<iterator> overlapping(const Key& lo, const Key& hi) const {
+        return iter::FullRange<iterator>(iterator(this->root(), lo, hi, false));
+    }
+
+    // the nodes whose intervals contain x
+    iter::FullRange<iterator> stabbing(const Key& x) const {
+        return iter::FullRange<iterator>(iterator(this->root(), x, x, true));
+    }
+};
+
+// A tree that also keeps its first and last node, so first(), last() and pop_front() are
+// O(1), as in a priority queue or a scheduler. A new node becomes the first one exactly when
+// it is linked as the left child of the current first node, which is checked between the
+// descent and the rebalancing; rotations do not change the order, erasing the first node
+// moves the cache to its successor, which is O(1) amortized. end() can be decremented.
+// It wraps the tree instead of linking a header node as the sentinel, so the hooks, the
+// balancing code and the nullptr end of the plain trees stay as they are.
+template<typename Tree>
+class cached_ends {
+public:
+    using tree_type = Tree;
+    using node_type = typename Tree::node_type;
+    using node_pointer = node_type*;
+    using value_type = typename Tree::value_type;
+    using balance_ops = typename Tree::balance_ops;
+
+    class iterator {
+        const cached_ends* owner;
+        node_pointer NodePtr;
+    public:
+        using difference_type = std::ptrdiff_t;
+        using value_type = node_type;
+        using pointer = value_type*;
+        using reference = value_type&;
+        using iterator_category = std::bidirectional_iterator_tag;
+
+        iterator(const cached_ends* o, node_pointer c) : owner(o), NodePtr(c) {}
+        iterator& operator++() {
+            NodePtr = static_cast<node_pointer>(impl::bst_next(NodePtr));
+            return *this;
+        }
+        // the end moves back to the last node
+        iterator& operator--() {
+            NodePtr = NodePtr == nullptr ? owner->last() : static_cast<node_pointer>(impl::bst_prev(NodePtr));
+            return *this;
+        }
+        iterator operator++(int) {
+            iterator res (*this);
+            ++(*this);
+            return res;
+        }
+        iterator operator--(int) {
+            iterator res (*this);
+            --(*this);
+            return res;
+        }
+        bool operator==(const iterator& other) const { return NodePtr == other.NodePtr; }
+        bool operator!=(const iterator& other) const { return NodePtr != other.NodePtr; }
+        reference operator*() const { return *NodePtr; }
+        pointer operator->() const { return NodePtr; }
+    };
+
+    template<typename ... Args>
+    explicit cached_ends(Args && ... args) : t(std::forward<Args>(args)...), head(nullptr), tail(nullptr) {}
+
+    node_pointer first() const {
+        return head;
+    }
+    node_pointer last() const {
+        return tail;
+    }
+    bool empty() const {
+        return head == nullptr;
+    }
+
+    void insert(node_pointer node) {
+        t.insert_bst(node);
+        linked(node);
+    }
+    // return false if there is already a node with the same key, node is not inserted then
+    bool insert_unique(node_pointer node) {
+        if(t.insert_unique_bst(node)) {
+            linked(node);
+            return true;
+        }
+        return false;
+    }
+    // as Tree::insert(hint, node), appending at the end (hint nullptr) takes O(1) before the
+    // rebalancing; a node that does not belong at the end goes down from the root at once,
+    // without the walk to the last node of the hinted insert of Tree
+    void insert(node_pointer hint, node_pointer node) {
+        bool placed = hint == nullptr ? append<false>(node) : t.template insert_hint_bst<false>(hint, node);
+        if(!placed) {
+            t.insert_bst(node);
+        }
+        linked(node);
+    }
+    bool insert_unique(node_pointer hint, node_pointer node) {
+        bool placed = hint == nullptr ? append<true>(node) : t.template insert_hint_bst<true>(hint, node);
+        if(placed || t.insert_unique_bst(node)) {
+            linked(node);
+            return true;
+        }
+        return false;
+    }
+    void erase(node_pointer node) {
+        if(node == head) {
+            head = static_cast<node_pointer>(impl::bst_next(node));
+        }
+        if(node == tail) {
+            tail = static_cast<node_pointer>(impl::bst_prev(node));
+        }
+        t.erase(node);
+    }
+    // erase and return the first node, nullptr if the tree is empty
+    node_pointer pop_front() {
+        auto node = head;
+        if(node != nullptr) {
+            erase(node);
+        }
+        return node;
+    }
+    node_pointer pop_back() {
+        auto node = tail;
+        if(node != nullptr) {
+            erase(node);
+        }
+        return node;
+    }
+
+    // the operations on many nodes find the ends again in O(log n)
+    void insert_batch(node_pointer* nodes, std::size_t count) {
+        t.insert_batch(nodes, count);
+        reset();
+    }
+    template<typename Iter>
+    void build_sorted(Iter first, Iter last) {
+        t.build_sorted(first, last);
+        reset();
+    }
+
+    // move the nodes with keys less than value into the returned tree in O(log n)
+    Tree split_front(const value_type& value) {
+        auto parts = t.split(value);
+        t = parts.second;
+        reset();
+        return parts.first;
+    }
+    // put the nodes of front and pivot before the nodes of this tree in O(log n), the inverse
+    // of split_front; no key in front is greater than pivot and no key here is less than it
+    void join_front(Tree& front, node_pointer pivot) {
+        t.join(front, pivot, t);
+        reset();
+    }
+    // move all the nodes into the returned tree
+    Tree release() {
+        Tree res = t;
+        t.set_root(nullptr);
+        reset();
+        return res;
+    }
+
+    node_pointer search(const value_type& value) const {
+        return t.search(value);
+    }
+    node_pointer lower_bound(const value_type& value) const {
+        return t.lower_bound(value);
+    }
+    node_pointer upper_bound(const value_type& value) const {
+        return t.upper_bound(value);
+    }
+    template<typename K, typename C = typename Tree::compare, typename = typename C::is_transparent>
+    node_pointer search(const K& value) const {
+        return t.search(value);
+    }
+    template<typename K, typename C = typename Tree::compare, typename = typename C::is_transparent>
+    node_pointer lower_bound(const K& value) const {
+        return t.lower_bound(value);
+    }
+    template<typename K, typename C = typename Tree::compare, typename = typename C::is_transparent>
+    node_pointer upper_bound(const K& value) const {
+        return t.upper_bound(value);
+    }
+
+    iterator begin() const {
+        return iterator(this, head);
+    }
+    iterator end() const {
+        return iterator(this, nullptr);
+    }
+
+    // the underlying tree for queries, changing it bypasses the cached ends
+    const Tree& tree() const {
+        return t;
+    }
+
+private:
+    Tree t;
+    node_pointer head;
+    node_pointer tail;
+
+    // link node as the right child of the last node if its key belongs there
+    template<bool Unique>
+    bool append(node_pointer node) {
+        auto& key = t.data.left();
+        auto&& comp = t.key_less();
+        if(tail == nullptr || (Unique ? !comp(key(*tail), key(*node)) : comp(key(*node), key(*tail)))) {
+            return false;
+        }
+        t.keep_prefix(node);
+        node->left = node->right = nullptr;
+        node->set_parent(tail);
+        tail->right = node;
+        return true;
+    }
+
+    // node was linked as a leaf, rebalance
+    void linked(node_pointer node) {
+        auto parent = node->parent();
+        if(parent == nullptr || (parent == head && parent->left == node)) {
+            head = node;
+        }
+        if(parent == nullptr || (parent == tail && parent->right == node)) {
+            tail = node;
+        }
+        t.set_root(balance_ops::post_insert(node, t.root()));
+    }
+
+    void reset() {
+        head = t.first();
+        tail = t.last();
+    }
+};
+
+
+namespace impl {
+
+template<typename Time>
+struct TimerNodeBase : NodeBase {
+    Time expiry;
+    // a node that is not scheduled links to itself
+    TimerNodeBase() {
+        right = this;
+    }
+};
+
+template<typename NodeType, typename Time>
+struct GetExpiry {
+    const Time& operator()(const NodeType& node) const {
+        return node.expiry;
+    }
+};
+
+}
+
+template<typename Time = std::uint64_t>
+using timer_hook = impl::TimerNodeBase<Time>;
+
+// Timers ordered by their expiry on a wavl tree with the first node cached. expire_until
+// detaches all the expired timers with one split instead of erasing them one by one, a WAVL
+// erase still costs O(1) amortized rotations when a timer is canceled. Timers with the same
+// expiry run in the order they were scheduled.
+template<typename NodeType, typename Time = std::uint64_t, typename Compare = std::less<Time>>
+class timer_queue {
+    static_assert(std::is_base_of<impl::TimerNodeBase<Time>, NodeType>::value, "The node type is not a subclass of timer_hook");
+public:
+    using node_type = NodeType;
+    using node_pointer = node_type*;
+    using tree_type = wavl<NodeType, Time, impl::GetExpiry<NodeType, Time>, Compare>;
+
+    explicit timer_queue(const Compare& c = Compare()) : comp(c), queue(impl::GetExpiry<NodeType, Time>(), c) {}
+
+    static bool scheduled(const node_type* node) {
+        return node->right != node;
+    }
+    bool empty() const {
+        return queue.empty();
+    }
+    // the timer that expires first, nullptr if there is none
+    node_pointer first() const {
+        return queue.first();
+    }
+
+    // Schedule a timer that is not scheduled, reschedule is the call for a live one: linking
+    // a node twice corrupts the tree. Deadlines mostly come in ascending order, so try the end
+    // first.
+    void schedule(node_pointer node, const Time& expiry) {
+        assert(!scheduled(node) && "the timer is already scheduled, use reschedule");
+        link(node, expiry);
+    }
+    // return false if the timer was not scheduled
+    bool cancel(node_pointer node) {
+        if(!scheduled(node)) {
+            return false;
+        }
+        queue.erase(node);
+        node->right = node;
+        return true;
+    }
+    // a later expiry that keeps the timer before the next one is set in place
+    void reschedule(node_pointer node, const Time& expiry) {
+        if(scheduled(node)) {
+            auto next = static_cast<node_pointer>(impl::bst_next(node));
+            if(!comp(expiry, node->expiry) && (next == nullptr || comp(expiry, next->expiry))) {
+                node->expiry = expiry;
+                return;
+            }
+            queue.erase(node);
+        }
+        link(node, expiry);
+    }
+
+    // Detach the timers that expire not after now and call f(node) on each in order, return
+    // their number. All of them are unscheduled before the first call, so f may cancel any of
+    // them, which returns false, schedule its node again and change the timers that did not
+    // expire, but not schedule the expired timers after its node, they are still linked in a
+    // list through their left pointers.
+    template<typename F>
+    std::size_t expire_until(const Time& now, F f) {
+        auto first = queue.first();
+        if(first == nullptr || comp(now, first->expiry)) {
+            return 0;
+        }
+        auto pivot = queue.upper_bound(now);
+        tree_type expired = pivot == nullptr ? queue.release() : queue.split_front(pivot->expiry);
+        // an in-order walk with a stack, which is done with the links of a node before it is
+        // marked and appended to the list; a WAVL tree is at most twice as high as a perfectly
+        // balanced one
+        impl::NodeBase* stack[2 * 8 * sizeof(std::size_t)];
+        std::size_t depth = 0;
+        for(impl::NodeBase* p = expired.root(); p != nullptr; p = p->left) {
+            stack[depth++] = p;
+        }
+        impl::NodeBase* head = nullptr;
+        impl::NodeBase** tail = &head;
+        while(depth > 0) {
+            auto node = stack[--depth];
+            for(impl::NodeBase* p = node->right; p != nullptr; p = p->left) {
+                stack[depth++] = p;
+            }
+            node->right = node;
+            *tail = node;
+            tail = &node->left;
+        }
+        *tail = nullptr;
+        std::size_t n = 0;
+        for(auto p = head; p != nullptr; ++n) {
+            auto node = static_cast<node_pointer>(p);
+            p = p->left;
+            f(node);
+        }
+        return n;
+    }
+
+private:
+    void link(node_pointer node, const Time& expiry) {
+        node->expiry = expiry;
+        queue.insert(nullptr, node);
+    }
+
+    Compare comp;
+    cached_ends<tree_type> queue;
+};
+
+
+// A tree of nodes derived from lean_node_hook, which have no parent pointer: 16 bytes per
+// hook and no parent stores in the rotations. Insert and erase go down from the root by key
+// and keep the path for the rebalancing, so a node is erased by its key, and the iterator
+// keeps a stack of the nodes still to visit. Equal keys are allowed, erase takes any of them.
+// Ops is impl::lean_rb_ops, lean_avl_ops or lean_wavl_ops, see the aliases below.
+template<typename NodeType, typename Key, typename GetKey, typename Compare, typename Ops>
+class lean_tree {
+    static_assert(std::is_base_of<impl::LeanNodeBase, NodeType>::value, "The node type is not a subclass of lean_node_hook");
+    using Hook = impl::LeanNodeBase;
+    impl::Tuple<GetKey, impl::Tuple<Compare, Hook*>> data;
+public:
+    using node_type = NodeType;
+    using node_pointer = node_type*;
+    using compare = Compare;
+    using value_type = Key;
+
+    // a forward iterator, the left spine of each right subtree is on its stack
+    class iterator {
+        Hook* stack[impl::LeanPath::capacity];
+        int depth;
+        void push_left(Hook* p) {
+            for(; p != nullptr; p = p->left()) {
+                stack[depth++] = p;
+            }
+        }
+    public:
+        using difference_type = std::ptrdiff_t;
+        using value_type = node_type;
+        using pointer = value_type*;
+        using reference = value_type&;
+        using iterator_category = std::forward_iterator_tag;
+
+        explicit iterator(Hook* root) : depth(0) {
+            push_left(root);
+        }
+        iterator(const iterator& other) : depth(other.depth) {
+            std::copy(other.stack, other.stack + depth, stack);
+        }
+        iterator& operator++() {
+            push_left(stack[--depth]->right);
+            return *this;
+        }
+        iterator operator++(int) {
+            iterator res (*this);
+            ++(*this);
+            return res;
+        }
+        bool operator==(const iterator& other) const {
+            return depth == other.depth && (depth == 0 || stack[depth - 1] == other.stack[depth - 1]);
+        }
+        bool operator!=(const iterator& other) const { return !(*this == other); }
+        reference operator*() const { return *static_cast<node_pointer>(stack[depth - 1]); }
+        pointer operator->() const { return static_cast<node_pointer>(stack[depth - 1]); }
+    };
+
+    lean_tree(const GetKey& key = GetKey(), const Compare& comp = Compare()) : data(key, comp, nullptr) {}
+    lean_tree(const Compare& comp) : data(GetKey(), comp, nullptr) {}
+
+    node_pointer root() const {
+        return static_cast<node_pointer>(this->data.right().right());
+    }
+    bool empty() const {
+        return root() == nullptr;
+    }
+    node_pointer first() const {
+        Hook* p = root();
+        while(p != nullptr && p->left() != nullptr) {
+            p = p->left();
+        }
+        return static_cast<node_pointer>(p);
+    }
+    node_pointer last() const {
+        Hook* p = root();
+        while(p != nullptr && p->right != nullptr) {
+            p = p->right;
+        }
+        return static_cast<node_pointer>(p);
+    }
+    iterator begin() const {
+        return iterator(root());
+    }
+    iterator end() const {
+        return iterator(nullptr);
+    }
+
+    node_pointer search(const Key& value) const {
+        return search_by(value);
+    }
+    // the first node not less than value
+    node_pointer lower_bound(const Key& value) const {
+        return lower_bound_by(value);
+    }
+    // the first node greater than value
+    node_pointer upper_bound(const Key& value) const {
+        return upper_bound_by(value);
+    }
+    // with a transparent Compare, as in bstree
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    node_pointer search(const K& value) const {
+        return search_by(value);
+    }
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    node_pointer lower_bound(const K& value) const {
+        return lower_bound_by(value);
+    }
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    node_pointer upper_bound(const K& value) const {
+        return upper_bound_by(value);
+    }
+
+    void insert(node_pointer node) {
+        impl::LeanPath path;
+        descend<false>(this->data.left()(*node), path);
+        link(node, path);
+    }
+    // return false if there is already a node with the same key, node is not inserted then
+    bool insert_unique(node_pointer node) {
+        impl::LeanPath path;
+        if(descend<true>(this->data.left()(*node), path)) {
+            return false;
+        }
+        link(node, path);
+        return true;
+    }
+    // unlink a node with the key value and return it, nullptr if there is none
+    node_pointer erase(const Key& value) {
+        return erase_by(value);
+    }
+    template<typename K, typename C = Compare, typename = typename C::is_transparent>
+    node_pointer erase(const K& value) {
+        return erase_by(value);
+    }
+
+private:
+    template<typename K>
+    node_pointer search_by(const K& value) const {
+        auto& key = this->data.left();
+        auto&& comp = key_less();
+        auto p = root();
+        while(p != nullptr) {
+            if(comp(value, key(*p))) {
+                p = static_cast<node_pointer>(p->left());
+            } else if(comp(key(*p), value)) {
+                p = static_cast<node_pointer>(p->right);
+            } else return p;
         }
+        return nullptr;
     }
-    void erase(node_pointer node) {
-        this->set_root(rb_erase(node, this->root()));
+
+    template<typename K>
+    node_pointer lower_bound_by(const K& value) const {
+        auto& key = this->data.left();
+        auto&& comp = key_less();
+        node_pointer res = nullptr;
+        for(auto p = root(); p != nullptr; ) {
+            if(comp(key(*p), value)) {
+                p = static_cast<node_pointer>(p->right);
+            } else {
+                res = p;
+                p = static_cast<node_pointer>(p->left());
+            }
+        }
+        return res;
     }
-};
 
-template<typename NodeType, typename Key, typename GetKey, typename Compare = std::less<Key>>
-class avl : public impl::bstree<NodeType, Key, GetKey, Compare> {
-    using Base = impl::bstree<NodeType, Key, GetKey, Compare>;
-public:
-    using node_type = NodeType;
-    using node_pointer = node_type*;
-    using compare = Compare;
-    using value_type = Key;
+    template<typename K>
+    node_pointer upper_bound_by(const K& value) const {
+        auto& key = this->data.left();
+        auto&& comp = key_less();
+        node_pointer res = nullptr;
+        for(auto p = root(); p != nullptr; ) {
+            if(comp(value, key(*p))) {
+                res = p;
+                p = static_cast<node_pointer>(p->left());
+            } else {
+                p = static_cast<node_pointer>(p->right);
+            }
+        }
+        return res;
+    }
 
-    avl(const GetKey& key = GetKey(), const Compare& comp = Compare()) : Base(key, comp) {}
-    avl(const Compare& comp) : Base(GetKey(), comp) {}
+    template<typename K>
+    node_pointer erase_by(const K& value) {
+        impl::LeanPath path;
+        if(!descend<true>(value, path)) {
+            return nullptr;
+        }
+        auto node = static_cast<node_pointer>(path.node[path.depth - 1]);
+        set_root(Ops::erase(path, root()));
+        return node;
+    }
 
-    void insert(node_pointer node) {
-        this->insert_bst(node);
-        this->set_root(avl_post_insert(node, this->root()));
+    // Record the path from the root to where value is or would be linked. With Stop the walk
+    // ends at a node with the key value and returns true, otherwise equal keys go right.
+    template<bool Stop, typename K>
+    bool descend(const K& value, impl::LeanPath& path) const {
+        auto& key = this->data.left();
+        auto&& comp = key_less();
+        int depth = 0;
+        for(auto p = root(); p != nullptr; ++depth) {
+            path.node[depth] = p;
+            bool right = !comp(value, key(*p));
+            if(Stop && right && !comp(key(*p), value)) {
+                path.depth = depth + 1;
+                return true;
+            }
+            path.right[depth] = right;
+            // both children are loaded, so that the choice needs no branch
+            auto left_child = p->left(), right_child = p->right;
+            p = static_cast<node_pointer>(right ? right_child : left_child);
+        }
+        path.depth = depth;
+        return false;
     }
-    void insert_unique(node_pointer node) {
-        if (this->insert_unique_bst(node)) {
-            this->set_root(avl_post_insert(node, this->root()));
+
+    void link(node_pointer node, impl::LeanPath& path) {
+        node->left_with_tag = 0;
+        node->right = nullptr;
+        if(path.depth == 0) {
+            set_root(node);
+        } else if(path.right[path.depth - 1]) {
+            path.node[path.depth - 1]->right = node;
+        } else {
+            path.node[path.depth - 1]->set_left(node);
         }
+        path.node[path.depth++] = node;
+        set_root(Ops::post_insert(path, root()));
     }
-    void erase(node_pointer node) {
-        this->set_root(avl_erase(node, this->root()));
+
+    auto key_less() const -> decltype(impl::ordering<Compare, Key>::less(this->data.right().left())) {
+        return impl::ordering<Compare, Key>::less(this->data.right().left());
+    }
+
+    void set_root(Hook* r) {
+        this->data.right().right() = r;
     }
 };
 
 template<typename NodeType, typename Key, typename GetKey, typename Compare = std::less<Key>>
-class wavl : public impl::bstree<NodeType, Key, GetKey, Compare> {
-    using Base = impl::bstree<NodeType, Key, GetKey, Compare>;
+using lean_rbtree = lean_tree<NodeType, Key, GetKey, Compare, impl::lean_rb_ops>;
+template<typename NodeType, typename Key, typename GetKey, typename Compare = std::less<Key>>
+using lean_avl = lean_tree<NodeType, Key, GetKey, Compare, impl::lean_avl_ops>;
+template<typename NodeType, typename Key, typename GetKey, typename Compare = std::less<Key>>
+using lean_wavl = lean_tree<NodeType, Key, GetKey, Compare, impl::lean_wavl_ops>;
+
+
+// A read-only snapshot of a tree: the keys are copied into an array in Eytzinger order (the
+// children of k at 2k and 2k+1, as in a binary heap) beside the pointers to their nodes.
+// lower_bound walks the array without branches and prefetches the cache line of the
+// descendants 4 levels down, so the misses of a lookup overlap. The snapshot is not
+// updated when the tree changes, the nodes must outlive it.
+template<typename Tree>
+class frozen {
 public:
-    using node_type = NodeType;
+    using node_type = typename Tree::node_type;
     using node_pointer = node_type*;
-    using compare = Compare;
-    using value_type = Key;
+    using value_type = typename Tree::value_type;
+    using compare = typename Tree::compare;
 
-    wavl(const GetKey& key = GetKey(), const Compare& comp = Compare()) : Base(key, comp) {}
-    wavl(const Compare& comp) : Base(GetKey(), comp) {}
+    explicit frozen(const Tree& tree) : comp(tree.data.right().left()) {
+        std::vector<node_pointer> sorted;
+        for(auto p = tree.first(); p != nullptr; p = static_cast<node_pointer>(impl::bst_next(p))) {
+            sorted.push_back(p);
+        }
+        n = sorted.size();
+        // keys[0] is unused, keys[Block] starts a cache line when the key size divides it
+        storage.resize(n + 1 + Block);
+        align();
+        nodes.resize(n + 1, nullptr);
+        std::size_t i = 0;
+        fill(tree.data.left(), sorted, i, 1);
+    }
+    // a copy of the keys has its own alignment in the new storage
+    frozen(const frozen& other) : comp(other.comp), n(other.n), storage(other.storage.size()), nodes(other.nodes) {
+        align();
+        auto keys = other.storage.begin() + other.offset;
+        std::copy(keys, keys + n + 1, storage.begin() + offset);
+    }
+    frozen(frozen&&) = default;
+    frozen& operator=(const frozen& other) {
+        return *this = frozen(other);
+    }
+    frozen& operator=(frozen&&) = default;
 
-    void insert(node_pointer node) {
-        this->insert_bst(node);
-        this->set_root(wavl_post_insert(node, this->root()));
+    std::size_t size() const {
+        return n;
     }
-    void insert_unique(node_pointer node) {
-        if (this->insert_unique_bst(node)) {
-            this->set_root(wavl_post_insert(node, this->root()));
-        }
+
+    // the node of the first key not less than value, nullptr if there is none
+    node_pointer lower_bound(const value_type& value) const {
+        return nodes[descend(value, less())];
     }
-    void erase(node_pointer node) {
-        this->set_root(wavl_erase(node, this->root()));
+    // the node of the first key greater than value
+    node_pointer upper_bound(const value_type& value) const {
+        auto c = less();
+        return nodes[descend(value, [&](const value_type& l, const value_type& r) { return !c(r, l); })];
+    }
+    node_pointer search(const value_type& value) const {
+        auto c = less();
+        std::size_t k = descend(value, c);
+        return (k != 0 && !c(value, key(k))) ? nodes[k] : nullptr;
     }
-};
 
-namespace iter {
-    
-template<typename NodeType>
-class Iterator {
-    NodeType* NodePtr;
-public:
-    using difference_type = std::ptrdiff_t;
-    using value_type = NodeType;
-    using pointer = value_type*;
-    using reference = value_type&;
-    using iterator_category = std::bidirectional_iterator_tag;
-    explicit Iterator(NodeType* c) : NodePtr(c) {}
-    Iterator(const Iterator& c) : NodePtr(c.NodePtr) {}
+private:
+    using ordering = impl::ordering<compare, value_type>;
+    static const std::size_t Block = sizeof(value_type) < 64 ? 64 / sizeof(value_type) : 1;
 
-    Iterator& operator++() {
-        NodePtr = static_cast<NodeType*>(bst_next(NodePtr));
-        return *this;
+    // the comparator as a less-than predicate
+    typename ordering::less_type less() const {
+        return ordering::less(comp);
     }
-    Iterator& operator--() {
-        NodePtr = static_cast<NodeType*>(bst_prev(NodePtr));
-        return *this;
+
+    // keys[Block] starts at a 64-byte boundary in storage when the key size divides it
+    void align() {
+        auto misaligned = reinterpret_cast<std::uintptr_t>(storage.data()) % 64;
+        offset = (64 % sizeof(value_type) == 0 && misaligned % sizeof(value_type) == 0) ? (64 - misaligned) % 64 / sizeof(value_type) : 0;
     }
-    Iterator operator++(int) {
-        Iterator res (*this);
-        ++(*this);
-        return res;
+
+    const value_type& key(std::size_t k) const {
+        return storage[offset + k];
     }
-    Iterator operator--(int) {
-        Iterator res (*this);
-        --(*this);
-        return res;
+
+    // the Eytzinger subtree at k takes the next nodes in order
+    template<typename GetKey>
+    void fill(const GetKey& get_key, const std::vector<node_pointer>& sorted, std::size_t& i, std::size_t k) {
+        if(k > n) {
+            return;
+        }
+        fill(get_key, sorted, i, 2 * k);
+        storage[offset + k] = get_key(*sorted[i]);
+        nodes[k] = sorted[i++];
+        fill(get_key, sorted, i, 2 * k + 1);
     }
-    bool operator==(const Iterator& other) const { return NodePtr == other.NodePtr; }
-    bool operator!=(const Iterator& other) const { return NodePtr != other.NodePtr; }
-    bool operator==(std::nullptr_t) const { return NodePtr == nullptr; }
-    bool operator!=(std::nullptr_t) const { return NodePtr != nullptr; }
-    reference operator*() const { return *NodePtr; }
-    pointer operator->() const { return NodePtr; }
+
+    // Go left while value is not greater than the key (less(key, value) is false), right
+    // otherwise, until past the leaves. The last left turn was at the answer: strip the
+    // trailing right turns (1 bits) and the left turn (0 bit) from the index.
+    template<typename Less>
+    std::size_t descend(const value_type& value, Less less) const {
+        const value_type* keys = storage.data() + offset;
+        std::size_t k = 1;
+        while(k <= n) {
+            BST_PREFETCH(keys + std::min(k * Block, n));
+            k = 2 * k + less(keys[k], value);
+        }
+#if defined(__GNUC__)
+        return k >> (__builtin_ctzll(~static_cast<unsigned long long>(k)) + 1);
+#else
+        while(k & 1) {
+            k >>= 1;
+        }
+        return k >> 1;
+#endif
+    }
+
+    compare comp;
+    std::size_t n;
+    std::size_t offset;
+    std::vector<value_type> storage;
+    std::vector<node_pointer> nodes;
 };
 
+template<typename Tree>
+frozen<Tree> freeze(const Tree& tree) {
+    return frozen<Tree>(tree);
+}
 
-template<typename NodeType>
-class ReverseIterator {
-    NodeType* NodePtr;
-public:
-    using difference_type = std::ptrdiff_t;
-    using value_type = NodeType;
-    using pointer = value_type*;
-    using reference = value_type&;
-    using iterator_category = std::bidirectional_iterator_tag;
 
-    explicit ReverseIterator(NodeType* c) : NodePtr(c) {}
-    ReverseIterator(const ReverseIterator& c) : NodePtr(c.NodePtr) {}
+namespace impl {
 
-    ReverseIterator& operator++() {
-        NodePtr = static_cast<NodeType*>(bst_prev(NodePtr));
-        return *this;
+// The keys of a frozen_btree node as stored and the number of them less than a probe.
+// Integral keys are stored as signed integers of their size, unsigned ones with the sign bit
+// flipped so that the signed comparisons of SIMD order them; 8-bit keys are compared with
+// SSE2, 16 and 32-bit keys with SSE2 or AVX2, 64-bit keys with SSE4.2 or AVX2. The other
+// keys, or any key without these instruction sets, are counted by a plain loop.
+template<typename Key, std::size_t Size = std::is_integral<Key>::value ? sizeof(Key) : 0>
+struct BTreeKeys {
+    using stored = Key;
+    static stored store(Key key) {
+        return key;
     }
-    ReverseIterator& operator--() {
-        NodePtr = static_cast<NodeType*>(bst_next(NodePtr));
-        return *this;
+    static unsigned rank(const stored* node, stored x) {
+        unsigned r = 0;
+        for(int i = 0; i < 16; ++i) {
+            r += node[i] < x;
+        }
+        return r;
     }
-    ReverseIterator operator++(int) {
-        ReverseIterator res (*this);
-        ++(*this);
-        return res;
+};
+
+template<typename Key, typename Stored>
+struct BTreeSignedKeys {
+    using stored = Stored;
+    static stored store(Key key) {
+        using U = typename std::make_unsigned<Stored>::type;
+        U sign = std::is_signed<Key>::value ? 0 : static_cast<U>(~(static_cast<U>(-1) >> 1));
+        return static_cast<stored>(static_cast<U>(static_cast<U>(key) ^ sign));
     }
-    ReverseIterator operator--(int) {
-        ReverseIterator res (*this);
-        --(*this);
-        return res;
+    static unsigned scalar_rank(const stored* node, stored x) {
+        unsigned r = 0;
+        for(int i = 0; i < 16; ++i) {
+            r += node[i] < x;
+        }
+        return r;
     }
-    bool operator==(const ReverseIterator& other) const { return NodePtr == other.NodePtr; }
-    bool operator!=(const ReverseIterator& other) const { return NodePtr != other.NodePtr; }
-    bool operator==(std::nullptr_t) const { return NodePtr == nullptr; }
-    bool operator!=(std::nullptr_t) const { return NodePtr != nullptr; }
-    reference operator*() const { return *NodePtr; }
-    pointer operator->() const { return NodePtr; }
 };
 
-template<typename Iter>
-class FullRange {
-    Iter first;
-public:
-    explicit FullRange(const Iter& i) : first(i) {}
-    FullRange(const FullRange& r) : first(r.first) {}
-    Iter begin() const {
-        return first;
+template<typename Key>
+struct BTreeKeys<Key, 1> : BTreeSignedKeys<Key, std::int8_t> {
+    static unsigned rank(const std::int8_t* node, std::int8_t x) {
+#if defined(__SSE2__)
+        __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(x), _mm_load_si128(reinterpret_cast<const __m128i*>(node)));
+        return __builtin_popcount(_mm_movemask_epi8(less));
+#else
+        return BTreeKeys::scalar_rank(node, x);
+#endif
     }
-    Iter end() const {
-        return Iter(nullptr);
+};
+
+template<typename Key>
+struct BTreeKeys<Key, 2> : BTreeSignedKeys<Key, std::int16_t> {
+    static unsigned rank(const std::int16_t* node, std::int16_t x) {
+#if defined(__AVX2__)
+        __m256i less = _mm256_cmpgt_epi16(_mm256_set1_epi16(x), _mm256_load_si256(reinterpret_cast<const __m256i*>(node)));
+        return __builtin_popcount(_mm256_movemask_epi8(less)) / 2;
+#elif defined(__SSE2__)
+        __m128i probe = _mm_set1_epi16(x);
+        __m128i lo = _mm_cmpgt_epi16(probe, _mm_load_si128(reinterpret_cast<const __m128i*>(node)));
+        __m128i hi = _mm_cmpgt_epi16(probe, _mm_load_si128(reinterpret_cast<const __m128i*>(node + 8)));
+        return __builtin_popcount(_mm_movemask_epi8(_mm_packs_epi16(lo, hi)));
+#else
+        return BTreeKeys::scalar_rank(node, x);
+#endif
     }
 };
 
-template<typename Iter>
-class Range : public FullRange<Iter> {
-    Iter last;
-public:
-    explicit Range(Iter first, Iter last_) : FullRange<Iter>(first), last(last_) {}
-    Range(const Range& r) : FullRange<Iter>(r), last(r.last) {}
-    Iter end() const {
-        return last;
+template<typename Key>
+struct BTreeKeys<Key, 4> : BTreeSignedKeys<Key, std::int32_t> {
+    static unsigned rank(const std::int32_t* node, std::int32_t x) {
+#if defined(__AVX2__)
+        __m256i probe = _mm256_set1_epi32(x);
+        __m256i lo = _mm256_cmpgt_epi32(probe, _mm256_load_si256(reinterpret_cast<const __m256i*>(node)));
+        __m256i hi = _mm256_cmpgt_epi32(probe, _mm256_load_si256(reinterpret_cast<const __m256i*>(node + 8)));
+        unsigned mask = _mm256_movemask_ps(_mm256_castsi256_ps(lo)) | (_mm256_movemask_ps(_mm256_castsi256_ps(hi)) << 8);
+        return __builtin_popcount(mask);
+#elif defined(__SSE2__)
+        __m128i probe = _mm_set1_epi32(x);
+        unsigned mask = 0;
+        for(int i = 0; i < 4; ++i) {
+            __m128i less = _mm_cmpgt_epi32(probe, _mm_load_si128(reinterpret_cast<const __m128i*>(node + 4 * i)));
+            mask |= _mm_movemask_ps(_mm_castsi128_ps(less)) << (4 * i);
+        }
+        return __builtin_popcount(mask);
+#else
+        return BTreeKeys::scalar_rank(node, x);
+#endif
     }
 };
+
+template<typename Key>
+struct BTreeKeys<Key, 8> : BTreeSignedKeys<Key, std::int64_t> {
+    static unsigned rank(const std::int64_t* node, std::int64_t x) {
+#if defined(__AVX2__)
+        __m256i probe = _mm256_set1_epi64x(x);
+        unsigned mask = 0;
+        for(int i = 0; i < 4; ++i) {
+            __m256i less = _mm256_cmpgt_epi64(probe, _mm256_load_si256(reinterpret_cast<const __m256i*>(node + 4 * i)));
+            mask |= _mm256_movemask_pd(_mm256_castsi256_pd(less)) << (4 * i);
+        }
+        return __builtin_popcount(mask);
+#elif defined(__SSE4_2__)
+        __m128i probe = _mm_set1_epi64x(x);
+        unsigned mask = 0;
+        for(int i = 0; i < 8; ++i) {
+            __m128i less = _mm_cmpgt_epi64(probe, _mm_load_si128(reinterpret_cast<const __m128i*>(node + 2 * i)));
+            mask |= _mm_movemask_pd(_mm_castsi128_pd(less)) << (2 * i);
+        }
+        return __builtin_popcount(mask);
+#else
+        return BTreeKeys::scalar_rank(node, x);
+#endif
+    }
+};
+
 }
 
+// A read-only snapshot of a tree with integral keys ordered by std::less, laid out as a
+// static B-tree of 16 keys per node: a node of 32-bit keys is one cache line, of 64-bit keys
+// two, the children of node k are the nodes k * 17 + 1 to k * 17 + 17 and a search reads one
+// node per level, log17(n) nodes in all. A node is ranked against the probe with SIMD
+// compares where available. As with frozen, the nodes of the tree must outlive the snapshot.
+template<typename Tree>
+class frozen_btree {
+public:
+    using node_type = typename Tree::node_type;
+    using node_pointer = node_type*;
+    using value_type = typename Tree::value_type;
+    static_assert(std::is_integral<value_type>::value, "frozen_btree needs integral keys");
+    static_assert(std::is_same<typename Tree::compare, std::less<value_type>>::value, "frozen_btree needs keys ordered by std::less");
 
-using node_hook = impl::NodeBase;
+    explicit frozen_btree(const Tree& tree) {
+        std::vector<node_pointer> sorted;
+        for(auto p = tree.first(); p != nullptr; p = static_cast<node_pointer>(impl::bst_next(p))) {
+            sorted.push_back(p);
+        }
+        n = sorted.size();
+        blocks = (n + B - 1) / B;
+        // slots past the last key hold the greatest key, which no probe is greater than
+        storage.resize(blocks * B + Align, std::numeric_limits<stored>::max());
+        align();
+        nodes.resize(blocks * B + 1, nullptr);
+        std::size_t i = 0;
+        fill(tree.data.left(), sorted, i, 0);
+    }
+    // a copy of the keys has its own alignment in the new storage
+    frozen_btree(const frozen_btree& other) : n(other.n), blocks(other.blocks), storage(other.storage.size()), nodes(other.nodes) {
+        align();
+        auto keys = other.storage.begin() + other.offset;
+        std::copy(keys, keys + blocks * B, storage.begin() + offset);
+    }
+    frozen_btree(frozen_btree&&) = default;
+    frozen_btree& operator=(const frozen_btree& other) {
+        return *this = frozen_btree(other);
+    }
+    frozen_btree& operator=(frozen_btree&&) = default;
 
-template<typename BST>
-inline iter::FullRange<iter::Iterator<typename BST::node_type>> range(BST& bst) {
-    using it = iter::Iterator<typename BST::node_type>;
-    return iter::FullRange<it>(it(bst.first()));
-}
+    std::size_t size() const {
+        return n;
+    }
 
-template<typename BST>
-inline iter::FullRange<iter::Iterator<typename BST::node_type>> crange(const BST& bst) {
-    using it = iter::Iterator<const typename BST::node_type>;
-    return iter::FullRange<it>(it(bst.first()));
-}
+    // the node of the first key not less than value, nullptr if there is none
+    node_pointer lower_bound(const value_type& value) const {
+        return nodes[lower_index(Keys::store(value))];
+    }
+    node_pointer search(const value_type& value) const {
+        stored x = Keys::store(value);
+        std::size_t res = lower_index(x);
+        return key(res) == x ? nodes[res] : nullptr;
+    }
 
-template<typename BST>
-inline iter::FullRange<iter::ReverseIterator<typename BST::node_type>> rrange(BST& bst) {
-    using it = iter::ReverseIterator<typename BST::node_type>;
-    return iter::FullRange<it>(it(bst.last()));
-}
+    // lower_bound of keys[0..count) into out, 8 lookups at a time go down in lockstep and
+    // prefetch their next nodes, so the cache misses of a group overlap; each lookup ranks
+    // its own node as lower_bound does, the probes of a group are not compared in one vector
+    void lower_bound_many(const value_type* keys, std::size_t count, node_pointer* out) const {
+        lookup_many<false>(keys, count, out);
+    }
+    void search_many(const value_type* keys, std::size_t count, node_pointer* out) const {
+        lookup_many<true>(keys, count, out);
+    }
 
-template<typename BST>
-inline iter::FullRange<iter::ReverseIterator<typename BST::node_type>> crrange(const BST& bst) {
-    using it = iter::ReverseIterator<const typename BST::node_type>;
-    return iter::FullRange<it>(it(bst.last()));
-}
+private:
+    using Keys = impl::BTreeKeys<value_type>;
+    using stored = typename Keys::stored;
+    static const std::size_t B = 16;
+    static const std::size_t Align = 64 / sizeof(stored) > 0 ? 64 / sizeof(stored) : 1;
 
-template<typename NodeType>
-inline iter::Range<iter::Iterator<NodeType>> range(NodeType* first, NodeType* last) {
-    typedef iter::Iterator<NodeType> it;
-    return iter::Range<it>(it(first), it(last));
-}
+    // the keys start at the first 64-byte boundary in storage, for the aligned loads of rank
+    void align() {
+        auto misaligned = reinterpret_cast<std::uintptr_t>(storage.data()) % 64;
+        offset = (64 - misaligned) % 64 / sizeof(stored);
+    }
 
-template<typename NodeType>
-inline iter::Range<iter::Iterator<const NodeType>> crange(NodeType* first, NodeType* last) {
-    typedef iter::Iterator<const NodeType> it;
-    return iter::Range<it>(it(first), it(last));
-}
+    const stored* block(std::size_t k) const {
+        return storage.data() + offset + k * B;
+    }
+    const stored& key(std::size_t index) const {
+        return storage[offset + index];
+    }
+    void prefetch(std::size_t k) const {
+        const char* p = reinterpret_cast<const char*>(block(k));
+        for(std::size_t line = 0; line < B * sizeof(stored); line += 64) {
+            BST_PREFETCH(p + line);
+        }
+    }
 
-template<typename NodeType>
-inline iter::Range<iter::Iterator<NodeType>> range(const std::pair<NodeType*,NodeType*>& r) {
-    return range(r.first, r.second);
-}
+    // The slot of the first key not less than x, blocks * B if there is none. The last
+    // node on the way with a key not less than x holds the answer.
+    std::size_t lower_index(stored x) const {
+        std::size_t res = blocks * B;
+        for(std::size_t k = 0; k < blocks; ) {
+            unsigned i = Keys::rank(block(k), x);
+            if(i < B) {
+                res = k * B + i;
+            }
+            k = k * (B + 1) + i + 1;
+        }
+        return res;
+    }
 
-template<typename NodeType>
-inline iter::Range<iter::Iterator<const NodeType>> crange(const std::pair<NodeType*,NodeType*>& r) {
-    return crange(r.first, r.second);
+    template<bool Exact>
+    void lookup_many(const value_type* keys, std::size_t count, node_pointer* out) const {
+        const std::size_t Group = 8;
+        for(std::size_t base = 0; base < count; base += Group) {
+            std::size_t m = std::min(Group, count - base);
+            stored x[Group];
+            std::size_t k[Group], res[Group];
+            for(std::size_t j = 0; j < m; ++j) {
+                x[j] = Keys::store(keys[base + j]);
+                k[j] = 0;
+                res[j] = blocks * B;
+            }
+            for(bool active = blocks > 0; active; ) {
+                active = false;
+                for(std::size_t j = 0; j < m; ++j) {
+                    if(k[j] >= blocks) {
+                        continue;
+                    }
+                    unsigned i = Keys::rank(block(k[j]), x[j]);
+                    if(i < B) {
+                        res[j] = k[j] * B + i;
+                    }
+                    k[j] = k[j] * (B + 1) + i + 1;
+                    if(k[j] < blocks) {
+                        prefetch(k[j]);
+                        active = true;
+                    }
+                }
+            }
+            for(std::size_t j = 0; j < m; ++j) {
+                out[base + j] = (!Exact || key(res[j]) == x[j]) ? nodes[res[j]] : nullptr;
+            }
+        }
+    }
+
+    // the subtree of block k takes the next keys in order, children before and after each key
+    template<typename GetKey>
+    void fill(const GetKey& get_key, const std::vector<node_pointer>& sorted, std::size_t& i, std::size_t k) {
+        if(k >= blocks) {
+            return;
+        }
+        for(std::size_t j = 0; j <= B; ++j) {
+            fill(get_key, sorted, i, k * (B + 1) + j + 1);
+            if(j < B && i < n) {
+                storage[offset + k * B + j] = Keys::store(get_key(*sorted[i]));
+                nodes[k * B + j] = sorted[i++];
+            }
+        }
+    }
+
+    std::size_t n;
+    std::size_t blocks;
+    std::size_t offset;
+    std::vector<stored> storage;
+    std::vector<node_pointer> nodes;
+};
+
+template<typename Tree>
+frozen_btree<Tree> freeze_btree(const Tree& tree) {
+    return frozen_btree<Tree>(tree);
 }
 
 }
 #endif
-
-
@@ -0,0 +1,733 @@
+#ifndef BSTREE_CONCURRENT_H
+#define BSTREE_CONCURRENT_H
+
+#include<atomic>
+#include<memory>
+#include<mutex>
+#include<thread>
+#include"bstree.h"
+
+// Front-ends for trees shared by several threads: concurrent for lock-free readers beside
+// serialized writers, sharded for key ranges behind their own locks and combining for many
+// writers. They live apart from bstree.h, which then needs no threading headers.
+
+namespace bst {
+
+// A tree shared by many readers that take no lock and writers serialized by a mutex, which
+// is a sequence lock: the version is odd while a writer changes the tree. The nodes derive
+// from atomic_node_hook, whose child links and the root are relaxed atomics on both sides, so
+// a reader walks down from the root while the writer relinks the nodes; the parent words and
+// the tags are only touched by writers. A reader retries if the version was odd or has
+// changed, or if the walk grows longer than any valid path, so a transiently cyclic path
+// cannot hold it; after max_attempts it takes the mutex. The results are exact at some moment
+// of the call. Erased nodes must stay readable memory, with their keys unchanged, while
+// readers may still be walking through them, and the keys of linked nodes must not change.
+template<typename Tree>
+class concurrent {
+    static_assert(std::is_same<typename Tree::hook_type, impl::AtomicNodeBase>::value, "concurrent needs nodes derived from atomic_node_hook");
+public:
+    using tree_type = Tree;
+    using node_type = typename Tree::node_type;
+    using node_pointer = node_type*;
+    using value_type = typename Tree::value_type;
+
+    template<typename ... Args>
+    explicit concurrent(Args && ... args) : tree(std::forward<Args>(args)...), version(0) {}
+
+    void insert(node_pointer node) {
+        write([&](Tree& t) { t.insert(node); });
+    }
+    // false if a node with an equal key is present, the node is then left unlinked
+    bool insert_unique(node_pointer node) {
+        bool inserted;
+        write([&](Tree& t) { inserted = t.insert_unique(node); });
+        return inserted;
+    }
+    void erase(node_pointer node) {
+        write([&](Tree& t) { t.erase(node); });
+    }
+
+    // run f(tree) as a writer, f may change the tree in any way
+    template<typename F>
+    void write(F f) {
+        std::lock_guard<std::mutex> lock(writer);
+        auto v = version.load(std::memory_order_relaxed);
+        version.store(v + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        f(tree);
+        version.store(v + 2, std::memory_order_release);
+    }
+
+    node_pointer search(const value_type& value) const {
+        node_pointer res;
+        read([&]() { return this->search_walk(value, res); });
+        return res;
+    }
+
+    node_pointer lower_bound(const value_type& value) const {
+        node_pointer res;
+        read([&]() { return this->lower_bound_walk(value, res); });
+        return res;
+    }
+
+    // the first node not less than lower and the first node not less than upper
+    std::pair<node_pointer, node_pointer> search_range(const value_type& lower, const value_type& upper) const {
+        std::pair<node_pointer, node_pointer> res;
+        read([&]() { return this->lower_bound_walk(lower, res.first) && this->lower_bound_walk(upper, res.second); });
+        return res;
+    }
+
+    // the tree itself, for phases without concurrent writers
+    Tree& unsafe_tree() {
+        return tree;
+    }
+
+private:
+    static const int max_depth = 128;
+    static const int max_attempts = 16;
+
+    Tree tree;
+    mutable std::mutex writer;
+    std::atomic<unsigned> version;
+
+    template<typename Walk>
+    void read(Walk walk) const {
+        for(int attempt = 0; attempt < max_attempts; ++attempt) {
+            auto v = version.load(std::memory_order_acquire);
+            if(v & 1) {
+                std::this_thread::yield();
+                continue;
+            }
+            bool done = walk();
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if(done && version.load(std::memory_order_relaxed) == v) {
+                return;
+            }
+        }
+        std::lock_guard<std::mutex> lock(writer);
+        walk();
+    }
+
+    bool search_walk(const value_type& value, node_pointer& res) const {
+        auto& key = tree.data.left();
+        impl::AtomicNodeBase* p = tree.data.right().right();
+        res = nullptr;
+        for(int depth = 0; p != nullptr; ++depth) {
+            if(depth == max_depth) {
+                return false;
+            }
+            auto q = static_cast<node_pointer>(p);
+            auto c = tree.key_compare(value, key(*q));
+            if(c < 0) {
+                p = q->left;
+            } else if(c > 0) {
+                p = q->right;
+            } else {
+                res = q;
+                break;
+            }
+        }
+        return true;
+    }
+
+    // the last node on the path where it goes to the left
+    bool lower_bound_walk(const value_type& value, node_pointer& res) const {
+        auto& key = tree.data.left();
+        auto&& comp = tree.key_less();
+        impl::AtomicNodeBase* p = tree.data.right().right();
+        res = nullptr;
+        for(int depth = 0; p != nullptr; ++depth) {
+            if(depth == max_depth) {
+                return false;
+            }
+            auto q = static_cast<node_pointer>(p);
+            if(comp(key(*q), value)) {
+                p = q->right;
+            } else {
+                res = q;
+                p = q->left;
+            }
+        }
+        return true;
+    }
+};
+
+
+// N trees, each with its own lock, holding consecutive ranges of the key space: shard i takes
+// the keys in [bounds[i - 1], bounds[i]). The operations on a key lock only its shard. The
+// bounds are immutable arrays swapped by repartition() while it holds all the locks, so the
+// routing needs no lock of its own: it picks a shard, locks it and checks that the epoch of
+// the bounds is still the same. A router counts itself in the reader count of its epoch while
+// it reads the bounds, and repartition() frees the old array once that count drops to zero.
+// Iterating is not safe against concurrent writers.
+// repartition() is called by the user, or by the writers after auto_repartition(factor, period):
+// every period inserts into a shard, its writer checks skewed(factor) once it has released the
+// lock and repartitions if so. Either way repartition() holds the locks of all the shards for
+// the whole rebuild, so the writers to every shard stall meanwhile: O(N log n) with counted
+// nodes, but a walk of all n nodes otherwise.
+template<typename Tree, std::size_t N>
+class sharded {
+public:
+    using tree_type = Tree;
+    using node_type = typename Tree::node_type;
+    using node_pointer = node_type*;
+    using value_type = typename Tree::value_type;
+
+    class iterator {
+        const sharded* owner;
+        std::size_t index;
+        node_pointer NodePtr;
+    public:
+        using difference_type = std::ptrdiff_t;
+        using value_type = node_type;
+        using pointer = value_type*;
+        using reference = value_type&;
+        using iterator_category = std::forward_iterator_tag;
+
+        explicit iterator(std::nullptr_t) : owner(nullptr), index(N), NodePtr(nullptr) {}
+        iterator(const sharded* s, std::size_t i) : owner(s), index(i), NodePtr(nullptr) {
+            skip_empty();
+        }
+        iterator& operator++() {
+            NodePtr = static_cast<node_pointer>(impl::bst_next(NodePtr));
+            if(NodePtr == nullptr) {
+                ++index;
+                skip_empty();
+            }
+            return *this;
+        }
+        iterator operator++(int) {
+            iterator res (*this);
+            ++(*this);
+            return res;
+        }
+        bool operator==(const iterator& other) const { return NodePtr == other.NodePtr; }
+        bool operator!=(const iterator& other) const { return NodePtr != other.NodePtr; }
+        reference operator*() const { return *NodePtr; }
+        pointer operator->() const { return NodePtr; }
+    private:
+        void skip_empty() {
+            for(; index < N && NodePtr == nullptr; ++index) {
+                NodePtr = owner->shards[index].tree.first();
+                if(NodePtr != nullptr) {
+                    break;
+                }
+            }
+        }
+    };
+
+    sharded() : sharded(std::vector<value_type>()) {}
+
+    // at most N - 1 ascending keys, the shards after the last bound stay empty until repartition()
+    explicit sharded(const std::vector<value_type>& b)
+        : owned(new std::vector<value_type>(b.begin(), b.begin() + std::min(b.size(), N - 1))), bounds(owned.get()), epoch(0) {
+        readers[0] = readers[1] = 0;
+        for(auto& s : shards) {
+            s.size = 0;
+            s.inserted = 0;
+            s.since = 0;
+        }
+    }
+
+    // Let the writers repartition when skewed(factor), checked every period inserts into a shard
+    // (0 turns it off, the default). A repartition is skipped until 1/N of the size at the
+    // previous one has been inserted since, so keys repeated too often to be spread cannot make
+    // every check rebuild the shards, while a window of ascending keys of steady size still
+    // moves the bounds along. Set it before the writers start.
+    void auto_repartition(double factor, std::size_t period) {
+        skew_factor = factor;
+        check_period = period;
+    }
+
+    void insert(node_pointer node) {
+        bool check = with_shard(key_of(*node), [&](shard& s) {
+            s.tree.insert(node);
+            ++s.size;
+            return count_inserts(s, 1);
+        });
+        if(check) {
+            check_skew();
+        }
+    }
+    bool insert_unique(node_pointer node) {
+        bool check = false;
+        bool inserted = with_shard(key_of(*node), [&](shard& s) {
+            bool inserted = s.tree.insert_unique(node);
+            s.size += inserted;
+            check = count_inserts(s, inserted);
+            return inserted;
+        });
+        if(check) {
+            check_skew();
+        }
+        return inserted;
+    }
+    void erase(node_pointer node) {
+        with_shard(key_of(*node), [&](shard& s) {
+            s.tree.erase(node);
+            --s.size;
+        });
+    }
+    node_pointer search(const value_type& value) const {
+        return const_cast<sharded*>(this)->with_shard(value, [&](shard& s) {
+            return s.tree.search(value);
+        });
+    }
+
+    // sort the batch, cut it at the bounds and insert the pieces into their shards in parallel
+    void insert_batch(node_pointer* nodes, std::size_t count) {
+        auto&& comp = shards[0].tree.key_less();
+        std::stable_sort(nodes, nodes + count, [&](node_pointer a, node_pointer b) {
+            return comp(key_of(*a), key_of(*b));
+        });
+        std::size_t start[N + 1];
+        start[0] = 0;
+        auto e = enter();
+        auto b = bounds.load(std::memory_order_acquire);
+        for(std::size_t i = 0; i < N; ++i) {
+            start[i + 1] = count;
+            if(i < b->size()) {
+                auto& bound = (*b)[i];
+                start[i + 1] = std::lower_bound(nodes + start[i], nodes + count, bound, [&](node_pointer a, const value_type& v) {
+                    return comp(key_of(*a), v);
+                }) - nodes;
+            }
+        }
+        leave(e);
+        batch(nodes, start, e, 0, N);
+    }
+
+    std::size_t size() const {
+        std::size_t n = 0;
+        for(auto& s : shards) {
+            std::lock_guard<std::mutex> lock(s.lock);
+            n += s.size;
+        }
+        return n;
+    }
+
+    // whether the largest shard holds more than factor times its fair share
+    bool skewed(double factor = 2.0) const {
+        std::size_t since = 0;
+        return skewed(factor, since);
+    }
+
+    // Move the bounds to the N-quantiles of the keys. All the shards are joined into one tree
+    // and split at the new bounds; with counted nodes the quantiles are found by select in
+    // O(log n), otherwise by walking the nodes once.
+    void repartition() {
+        for(auto& s : shards) {
+            s.lock.lock();
+        }
+        Tree all = shards[0].tree;
+        all.set_root(nullptr);
+        std::size_t total = 0;
+        for(auto& s : shards) {
+            total += s.size;
+            auto pivot = s.tree.first();
+            if(pivot != nullptr) {
+                s.tree.erase(pivot);
+                all.join(all, pivot, s.tree);
+            }
+            s.size = 0;
+            s.since = 0;
+        }
+
+        std::unique_ptr<const std::vector<value_type>> old(std::move(owned));
+        std::unique_ptr<std::vector<value_type>> b(new std::vector<value_type>());
+        std::size_t less[N];
+        quantiles(all, total, *b, less, std::is_base_of<impl::CountedNodeBase, node_type>());
+        std::size_t taken = 0;
+        for(std::size_t i = 0; i < b->size(); ++i) {
+            auto parts = all.split((*b)[i]);
+            shards[i].tree = parts.first;
+            shards[i].size = less[i] - taken;
+            taken = less[i];
+            all = parts.second;
+        }
+        shards[b->size()].tree = all;
+        shards[b->size()].size = total - taken;
+        last_total = total;
+
+        // routers that may still read the old bounds entered before the epoch moved on
+        bounds.store(b.get());
+        owned = std::move(b);
+        auto e = epoch.fetch_add(1);
+        while(readers[e & 1].load() != 0) {
+            std::this_thread::yield();
+        }
+        for(auto& s : shards) {
+            s.lock.unlock();
+        }
+    }
+
+    iterator begin() const {
+        return iterator(this, 0);
+    }
+    iterator end() const {
+        return iterator(nullptr);
+    }
+    iter::FullRange<iterator> range() const {
+        return iter::FullRange<iterator>(begin());
+    }
+
+    // the tree of shard i, for phases without concurrent writers
+    Tree& unsafe_shard(std::size_t i) {
+        return shards[i].tree;
+    }
+
+private:
+    struct alignas(64) shard {
+        mutable std::mutex lock;
+        Tree tree;
+        std::size_t size;
+        // inserts since the last check of auto_repartition and since the last repartition
+        std::size_t inserted;
+        std::size_t since;
+    };
+
+    shard shards[N];
+    std::unique_ptr<const std::vector<value_type>> owned;
+    std::atomic<const std::vector<value_type>*> bounds;
+    // bumped by repartition(), readers[e & 1] counts the routers reading the bounds of epoch e
+    std::atomic<unsigned> epoch;
+    std::atomic<std::size_t> readers[2];
+    double skew_factor = 2.0;
+    std::size_t check_period = 0;
+    // the size at the last repartition, written under all the locks
+    std::size_t last_total = 0;
+    // set by the writer that checks the skew, the others go on
+    std::atomic<bool> checking {false};
+
+    auto key_of(const node_type& node) const -> decltype(shards[0].tree.data.left()(node)) {
+        return shards[0].tree.data.left()(node);
+    }
+
+    // since is the number of inserts since the last repartition
+    bool skewed(double factor, std::size_t& since) const {
+        std::size_t n = 0, largest = 0;
+        for(auto& s : shards) {
+            std::lock_guard<std::mutex> lock(s.lock);
+            n += s.size;
+            since += s.since;
+            largest = std::max(largest, s.size);
+        }
+        return largest > factor * n / N + 1;
+    }
+
+    // count inserts into the locked shard s, true when it is time to check the skew
+    bool count_inserts(shard& s, std::size_t n) {
+        s.inserted += n;
+        s.since += n;
+        if(check_period == 0 || s.inserted < check_period) {
+            return false;
+        }
+        s.inserted = 0;
+        return true;
+    }
+
+    // called with no shard locked
+    void check_skew() {
+        if(checking.exchange(true)) {
+            return;
+        }
+        std::size_t since = 0;
+        if(skewed(skew_factor, since)) {
+            std::size_t last;
+            {
+                std::lock_guard<std::mutex> lock(shards[0].lock);
+                last = last_total;
+            }
+            if(since >= last / N) {
+                repartition();
+            }
+        }
+        checking.store(false);
+    }
+
+    std::size_t index(const std::vector<value_type>& b, const value_type& value) const {
+        auto&& comp = shards[0].tree.key_less();
+        return std::upper_bound(b.begin(), b.end(), value, comp) - b.begin();
+    }
+
+    // count a router in the readers of the current epoch, which it returns; the bounds it
+    // loads afterwards stay alive until leave
+    unsigned enter() {
+        for(;;) {
+            auto e = epoch.load();
+            readers[e & 1].fetch_add(1);
+            if(epoch.load() == e) {
+                return e;
+            }
+            readers[e & 1].fetch_sub(1);
+        }
+    }
+    void leave(unsigned e) {
+        readers[e & 1].fetch_sub(1, std::memory_order_release);
+    }
+
+    // run f on the locked shard of value, retrying if a repartition moved the bounds meanwhile
+    template<typename F>
+    auto with_shard(const value_type& value, F f) -> decltype(f(shards[0])) {
+        for(;;) {
+            auto e = enter();
+            auto& s = shards[index(*bounds.load(std::memory_order_acquire), value)];
+            leave(e);
+            std::lock_guard<std::mutex> lock(s.lock);
+            if(epoch.load(std::memory_order_relaxed) == e) {
+                return f(s);
+            }
+        }
+    }
+
+    // the shards in [lo, hi), forked in halves
+    void batch(node_pointer* nodes, const std::size_t* start, unsigned e, std::size_t lo, std::size_t hi) {
+        if(hi - lo > 1) {
+            auto mid = lo + (hi - lo) / 2;
+            auto f = [&]() { this->batch(nodes, start, e, lo, mid); };
+            auto g = [&]() { this->batch(nodes, start, e, mid, hi); };
+            impl::fork_join(f, g);
+            return;
+        }
+        auto n = start[lo + 1] - start[lo];
+        if(n == 0) {
+            return;
+        }
+        auto& s = shards[lo];
+        std::unique_lock<std::mutex> lock(s.lock);
+        if(epoch.load(std::memory_order_relaxed) == e) {
+            s.tree.insert_batch(nodes + start[lo], n);
+            s.size += n;
+            bool check = count_inserts(s, n);
+            lock.unlock();
+            if(check) {
+                check_skew();
+            }
+            return;
+        }
+        // repartitioned meanwhile
+        lock.unlock();
+        for(auto i = start[lo]; i < start[lo + 1]; ++i) {
+            insert(nodes[i]);
+        }
+    }
+
+    // the i-th bound is the key of the node at position total * (i + 1) / N, less[i] is
+    // the number of nodes with smaller keys
+    void quantiles(Tree& all, std::size_t total, std::vector<value_type>& b, std::size_t* less, std::true_type) {
+        for(std::size_t i = 0; i + 1 < N && total > 0; ++i) {
+            b.push_back(key_of(*all.select(total * (i + 1) / N)));
+            less[i] = all.rank(all.lower_bound(b.back()));
+        }
+    }
+
+    void quantiles(Tree& all, std::size_t total, std::vector<value_type>& b, std::size_t* less, std::false_type) {
+        auto&& comp = shards[0].tree.key_less();
+        std::size_t pos = 0, run = 0, i = 0;
+        node_pointer prev = nullptr;
+        for(auto p = all.first(); p != nullptr && i + 1 < N; prev = p, p = static_cast<node_pointer>(impl::bst_next(p)), ++pos) {
+            // run is the position of the first node with the key of p
+            if(prev == nullptr || comp(key_of(*prev), key_of(*p))) {
+                run = pos;
+            }
+            // positions that coincide, when total < N or the keys repeat, each take a bound
+            while(i + 1 < N && pos >= total * (i + 1) / N) {
+                b.push_back(key_of(*p));
+                less[i] = run;
+                ++i;
+            }
+        }
+    }
+};
+
+
+// A flat-combining front-end: a thread that finds the lock free applies its operation
+// directly, as with a mutex. Otherwise it posts the operation into a free slot and waits; the
+// thread holding the lock is the combiner, it collects the operations of all the slots,
+// applies them to the tree and marks them done, so the tree is written by one thread at a
+// time without a lock handoff per operation. The inserts of a round are applied as one
+// insert_batch, the unique inserts in key order with the previous one as the hint. A waiter
+// spins on its slot for a bounded number of rounds, then yields between its checks.
+// More than Slots threads may post at a time, the extra ones wait for a free slot.
+template<typename Tree, std::size_t Slots>
+class combining {
+public:
+    using tree_type = Tree;
+    using node_type = typename Tree::node_type;
+    using node_pointer = node_type*;
+    using value_type = typename Tree::value_type;
+
+    template<typename ... Args>
+    explicit combining(Args && ... args) : tree(std::forward<Args>(args)...), busy(false), pending(0) {
+        for(auto& s : slots) {
+            s.state.store(FREE, std::memory_order_relaxed);
+        }
+    }
+
+    void insert(node_pointer node) {
+        post(INSERT, node);
+    }
+    // return false if there is already a node with the same key
+    bool insert_unique(node_pointer node) {
+        return post(INSERT_UNIQUE, node);
+    }
+    void erase(node_pointer node) {
+        post(ERASE, node);
+    }
+
+    // run f(tree) as the combiner, e.g. for lookups
+    template<typename F>
+    auto read(F f) -> decltype(f(std::declval<Tree&>())) {
+        while(!try_lock()) {
+            std::this_thread::yield();
+        }
+        struct release {
+            combining& c;
+            ~release() { c.combine(); c.unlock(); }
+        } guard{*this};
+        return f(tree);
+    }
+    node_pointer search(const value_type& value) {
+        return read([&](Tree& t) { return t.search(value); });
+    }
+
+    // the tree, only for phases without concurrent operations
+    Tree& unsafe_tree() {
+        return tree;
+    }
+
+private:
+    enum { FREE, CLAIMED, PENDING, DONE };
+    enum { INSERT, INSERT_UNIQUE, ERASE };
+    // the checks of its slot a waiter spins for before it yields between them
+    static const int spin_limit = 64;
+
+    struct alignas(64) slot {
+        std::atomic<int> state;
+        int op;
+        bool result;
+        node_pointer node;
+    };
+
+    Tree tree;
+    // the combiner lock, waiters read it before they try to take it
+    alignas(64) std::atomic<bool> busy;
+    // the number of posted operations not yet collected, so that the combiner skips the
+    // slots when there are none
+    alignas(64) std::atomic<std::size_t> pending;
+    slot slots[Slots];
+    // scratch space of the combiner
+    std::vector<slot*> posted;
+    std::vector<node_pointer> batch;
+
+    bool try_lock() {
+        return !busy.load(std::memory_order_relaxed) && !busy.exchange(true, std::memory_order_acquire);
+    }
+    void unlock() {
+        busy.store(false, std::memory_order_release);
+    }
+
+    bool post(int op, node_pointer node) {
+        if(try_lock()) {
+            bool res = apply(op, node);
+            combine();
+            unlock();
+            return res;
+        }
+        auto& s = claim();
+        s.op = op;
+        s.node = node;
+        pending.fetch_add(1, std::memory_order_relaxed);
+        s.state.store(PENDING, std::memory_order_release);
+        for(int spins = 0; s.state.load(std::memory_order_acquire) != DONE; ++spins) {
+            if(try_lock()) {
+                combine();
+                unlock();
+            } else if(spins >= spin_limit) {
+                std::this_thread::yield();
+            }
+        }
+        bool res = s.result;
+        s.state.store(FREE, std::memory_order_release);
+        return res;
+    }
+
+    slot& claim() {
+        std::size_t i = std::hash<std::thread::id>()(std::this_thread::get_id()) % Slots;
+        for(;; i = (i + 1) % Slots) {
+            int expected = FREE;
+            if(slots[i].state.load(std::memory_order_relaxed) == FREE &&
+               slots[i].state.compare_exchange_strong(expected, CLAIMED, std::memory_order_acquire)) {
+                return slots[i];
+            }
+            if(i + 1 == Slots) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    bool apply(int op, node_pointer node) {
+        if(op == INSERT) {
+            tree.insert(node);
+        } else if(op == INSERT_UNIQUE) {
+            return tree.insert_unique(node);
+        } else {
+            tree.erase(node);
+        }
+        return true;
+    }
+
+    // a few rounds over the slots while operations are posted
+    void combine() {
+        for(int round = 0; round < 4 && pending.load(std::memory_order_relaxed) != 0; ++round) {
+            posted.clear();
+            for(auto& s : slots) {
+                if(s.state.load(std::memory_order_acquire) == PENDING) {
+                    posted.push_back(&s);
+                }
+            }
+            if(posted.empty()) {
+                return;
+            }
+            pending.fetch_sub(posted.size(), std::memory_order_relaxed);
+            apply_posted();
+            for(auto s : posted) {
+                s->state.store(DONE, std::memory_order_release);
+            }
+        }
+    }
+
+    // erases first, the operations of a round are concurrent so any order is valid
+    void apply_posted() {
+        auto& key = tree.data.left();
+        auto&& comp = tree.key_less();
+        batch.clear();
+        for(auto s : posted) {
+            s->result = true;
+            if(s->op == ERASE) {
+                tree.erase(s->node);
+            } else if(s->op == INSERT) {
+                batch.push_back(s->node);
+            }
+        }
+        if(!batch.empty()) {
+            tree.insert_batch(batch.data(), batch.size());
+        }
+        auto unique = std::partition(posted.begin(), posted.end(), [](slot* s) {
+            return s->op == INSERT_UNIQUE;
+        });
+        std::sort(posted.begin(), unique, [&](slot* a, slot* b) {
+            return comp(key(*a->node), key(*b->node));
+        });
+        node_pointer hint = nullptr;
+        for(auto it = posted.begin(); it != unique; ++it) {
+            (*it)->result = tree.insert_unique(hint, (*it)->node);
+            if((*it)->result) {
+                hint = static_cast<node_pointer>(impl::bst_next((*it)->node));
+            }
+        }
+    }
+};
+
+}
+#endif
@@ -0,0 +1,1313 @@
+#ifndef BSTREE_INLINE_H
+#define BSTREE_INLINE_H
+
+#include"bstree.h"
+
+// The rebalancing algorithms behind the functions exported by src/bstree.cpp, as templates
+// on the hook and the augmentation. Including this header also gives the inline_*_ops
+// policies, which make rbtree, avl and wavl call them directly, so that they can be inlined
+// and specialized in the including translation unit.
+
+/* The red-black tree code is modified from linux kernel
+ */
+
+namespace bst {
+namespace impl {
+
+// Augmentation policies. The algorithms call update(node) whenever the children of node
+// change, propagate(node) to recompute node and its ancestors, and link(node) for a new
+// leaf, before it is rebalanced. NoAugment compiles away.
+struct NoAugment {
+    template<typename Node>
+    void update(Node*) const {}
+    template<typename Node>
+    void propagate(Node*) const {}
+    template<typename Node>
+    void link(Node*) const {}
+};
+
+struct CountAugment {
+    static std::size_t count(NodeBase* node) {
+        return node ? static_cast<CountedNodeBase*>(node)->count : 0;
+    }
+    void update(NodeBase* node) const {
+        static_cast<CountedNodeBase*>(node)->count = count(node->left) + count(node->right) + 1;
+    }
+    void propagate(NodeBase* node) const {
+        for (; node; node = node->parent())
+            update(node);
+    }
+    void link(NodeBase* node) const {
+        static_cast<CountedNodeBase*>(node)->count = 1;
+        for (node = node->parent(); node; node = node->parent())
+            ++static_cast<CountedNodeBase*>(node)->count;
+    }
+};
+
+// a user-defined aggregate, recomputed through a function pointer
+struct CallbackAugment {
+    void (*fn)(NodeBase*);
+    void update(NodeBase* node) const {
+        fn(node);
+    }
+    void propagate(NodeBase* node) const {
+        for (; node; node = node->parent())
+            fn(node);
+    }
+    void link(NodeBase* node) const {
+        propagate(node);
+    }
+};
+
+const int RED     = 0;
+const int BLACK   = 3;
+const int LEFT    = 3; // left  higher
+const int RIGHT   = 2; // right higher
+const int BALANCE = 0;
+const int WEAK    = 3;
+const int WLEFT   = 1;
+const int WRIGHT  = 2;
+
+
+// whether a node with this parent is its left child; a SidedNodeBase knows it without the parent
+template<typename Node>
+inline bool is_left_child(const Node* node, const Node* parent) {
+    return parent->left == node;
+}
+inline bool is_left_child(const SidedNodeBase* node, const SidedNodeBase*) {
+    return node->is_left_child();
+}
+
+template<typename Node>
+inline void replace_node_as_left_child(Node* newnode, Node* parent) {
+    parent->left = newnode;
+}
+template<typename Node>
+inline void replace_node_as_right_child(Node* newnode, Node* parent) {
+    parent->right = newnode;
+}
+
+template<typename Node>
+inline void replace_node(Node* oldnode, Node* newnode, Node* parent, Node*& root) {
+    if (parent) {
+        if (is_left_child(oldnode, parent)) {
+            replace_node_as_left_child(newnode, parent);
+        } else  {
+            replace_node_as_right_child(newnode, parent);
+        }
+    } else {
+        root = newnode;
+    }
+}
+
+
+template<typename Node, typename Aug>
+inline void rotate_left_as_left_child(Node* node, Aug aug) {
+    Node* right = node->right;
+    auto parent = node->parent();
+    node->right = right->left;
+    if (right->left)
+        right->left->set_parent(node);
+    right->left = node;
+    right->set_parent(parent);
+    replace_node_as_left_child(right, parent);
+    node->set_parent(right);
+    aug.update(node);
+    aug.update(right);
+}
+
+template<typename Node, typename Aug>
+inline void rotate_right_as_right_child(Node* node, Aug aug) {
+    Node* left = node->left;
+    auto parent = node->parent();
+    node->left = left->right;
+    if (left->right) 
+        left->right->set_parent(node);
+    left->right = node;
+    left->set_parent(parent);
+    replace_node_as_right_child(left, parent);
+    node->set_parent(left);
+    aug.update(node);
+    aug.update(left);
+}
+
+template<typename Node, typename Aug>
+inline void rotate_left(Node* node, Node*& root, Aug aug) {
+    Node* right = node->right;
+    auto parent = node->parent();
+    node->right = right->left;
+    if (right->left)
+        right->left->set_parent(node);
+    right->set_parent(parent);
+    replace_node(node, right, parent, root);
+    right->left = node;
+    node->set_parent(right);
+    aug.update(node);
+    aug.update(right);
+}
+
+template<typename Node, typename Aug>
+inline void rotate_right(Node* node, Node*& root, Aug aug) {
+    Node* left = node->left;
+    auto parent = node->parent();
+    node->left = left->right;
+    if (left->right) 
+        left->right->set_parent(node);
+    left->set_parent(parent);
+    replace_node(node, left, parent, root);
+    left->right = node;
+    node->set_parent(left);
+    aug.update(node);
+    aug.update(left);
+}
+
+// fix the red-red violations above a red node, the color of the root is left to the caller
+template<typename Node, typename Aug>
+inline Node* rb_insert_rebalance(Node* node, Node* root, Aug aug) {
+    Node *parent, *gparent;
+
+    while ((parent = node->parent()) && parent->tag() == RED) {
+        gparent = parent->parent();
+
+        if (parent == gparent->left) {
+            {
+                Node *uncle = gparent->right;
+                if (uncle && uncle->tag() == RED) {
+                    uncle->set_tag(BLACK);
+                    parent->set_tag(BLACK);
+                    gparent->set_tag(RED);
+                    node = gparent;
+                    continue;
+                }
+            }
+
+            if (parent->right == node) {
+                Node *tmp;
+                rotate_left_as_left_child(parent, aug);
+                tmp = parent;
+                parent = node;
+                node = tmp;
+            }
+
+            parent->set_tag(BLACK);
+            gparent->set_tag(RED);
+            rotate_right(gparent, root, aug);
+        } else {
+            {
+                Node *uncle = gparent->left;
+                if (uncle && uncle->tag() == RED) {
+                    uncle->set_tag(BLACK);
+                    parent->set_tag(BLACK);
+                    gparent->set_tag(RED);
+                    node = gparent;
+                    continue;
+                }
+            }
+
+            if (parent->left == node) {
+                Node *tmp;
+                rotate_right_as_right_child(parent, aug);
+                tmp = parent;
+                parent = node;
+                node = tmp;
+            }
+
+            parent->set_tag(BLACK);
+            gparent->set_tag(RED);
+            rotate_left(gparent, root, aug);
+        }
+    }
+    return root;
+}
+
+template<typename Node, typename Aug>
+inline Node* rb_post_insert(Node* node, Node* root, Aug aug) {
+    node->set_tag(RED);
+    aug.link(node);
+    root = rb_insert_rebalance(node, root, aug);
+    root->set_tag(BLACK);
+    return root;
+}
+
+template<typename Node, typename Aug>
+inline Node *rb_post_erase(Node *node, Node *parent, Node *root, Aug aug) {
+    Node *other;
+
+    while ((!node || node->tag() == BLACK) && node != root) {
+        if (parent->left == node) {
+            other = parent->right;
+            if (other->tag() == RED) {
+                other->set_tag(BLACK);
+                parent->set_tag(RED);
+                rotate_left(parent, root, aug);
+                other = parent->right;
+            }
+            if ((!other->left || other->left->tag() == BLACK) && (!other->right || other->right->tag() == BLACK)) {
+                other->set_tag(RED);
+                node = parent;
+                parent = node->parent();
+            } else {
+                if (!other->right || other->right->tag() == BLACK) {
+                    Node *o_left;
+                    if ((o_left = other->left))
+                        o_left->set_tag(BLACK);
+                    other->set_tag(RED);
+                    rotate_right_as_right_child(other, aug);
+                    other = parent->right;
+                }
+                other->set_tag(parent->tag());
+                parent->set_tag(BLACK);
+                if (other->right)
+                    other->right->set_tag(BLACK);
+                rotate_left(parent, root, aug);
+                node = root;
+                break;
+            }
+        } else {
+            other = parent->left;
+            if (other->tag() == RED) {
+                other->set_tag(BLACK);
+                parent->set_tag(RED);
+                rotate_right(parent, root, aug);
+                other = parent->left;
+            }
+            if ((!other->left || other->left->tag() == BLACK) && (!other->right || other->right->tag() == BLACK)) {
+                other->set_tag(RED);
+                node = parent;
+                parent = node->parent();
+            } else {
+                if (!other->left || other->left->tag() == BLACK) {
+                    Node *o_right;
+                    if ((o_right = other->right))
+                        o_right->set_tag(BLACK);
+                    other->set_tag(RED);
+                    rotate_left_as_left_child(other, aug);
+                    other = parent->left;
+                }
+                other->set_tag(parent->tag());
+                parent->set_tag(BLACK);
+                if (other->left)
+                    other->left->set_tag(BLACK);
+                rotate_right(parent, root, aug);
+                node = root;
+                break;
+            }
+        }
+    }
+    if (node)
+        node->set_tag(BLACK);
+    return root;
+}
+
+// The subtree of node has grown one higher, fix the balance upwards. When joining, the grown
+// node may be balanced, then a single rotation does not restore the height and the loop goes on.
+// *grew tells whether the height of the whole tree has changed.
+template<bool Joining, typename Node, typename Aug>
+inline Node* avl_insert_rebalance(Node* node, Node* root, bool* grew, Aug aug) {
+    if (Joining)
+        *grew = false;
+    for (Node* parent = node->parent(); parent; node = parent, parent = node->parent()) {
+        auto tag = parent->tag();
+        if(node == parent->left) { // left child
+            if(tag == LEFT) {
+                auto node_tag = node->tag();
+                if(node_tag == RIGHT) {
+                    Node* tmp = node->right;
+                    auto tmp_tag = tmp->tag();
+                    rotate_left_as_left_child(node, aug);
+                    parent->set_tag((tmp_tag == LEFT) ? RIGHT : BALANCE);
+                    node->set_tag((tmp_tag == RIGHT) ? LEFT : BALANCE);
+                    tmp->set_tag(BALANCE);
+                } else {
+                    parent->set_tag((node_tag == LEFT) ? BALANCE : LEFT);
+                    node->set_tag((node_tag == LEFT) ? BALANCE : RIGHT);
+                }
+
+                rotate_right(parent, root, aug);
+                if (Joining && node_tag == BALANCE) {
+                    parent = node; // node has taken the place of parent
+                    continue;
+                }
+                return root;
+
+            } else if (tag == BALANCE) {
+                parent->set_tag(LEFT);
+
+            } else {
+                parent->set_tag(BALANCE);
+                return root;
+            }
+        } else {                   // right child
+            if(tag == RIGHT) {
+                auto node_tag = node->tag();
+                if(node_tag == LEFT) {
+                    Node* tmp = node->left;
+                    auto tmp_tag = tmp->tag();
+                    rotate_right_as_right_child(node, aug);
+                    parent->set_tag((tmp_tag == RIGHT) ? LEFT : BALANCE);
+                    node->set_tag((tmp_tag == LEFT) ? RIGHT : BALANCE);
+                    tmp->set_tag(BALANCE);
+                } else {
+                    parent->set_tag((node_tag == RIGHT) ? BALANCE : RIGHT);
+                    node->set_tag((node_tag == RIGHT) ? BALANCE : LEFT);
+                }
+
+                rotate_left(parent, root, aug);
+                if (Joining && node_tag == BALANCE) {
+                    parent = node; // node has taken the place of parent
+                    continue;
+                }
+                return root;
+
+            } else if (tag == BALANCE) {
+                parent->set_tag(RIGHT);
+
+            } else {
+                parent->set_tag(BALANCE);
+                return root;
+            }
+        }
+    }
+    if (Joining)
+        *grew = true;
+    return root;
+}
+
+template<typename Node, typename Aug>
+inline Node* avl_post_insert(Node* node, Node* root, Aug aug) {
+    node->set_tag(BALANCE);
+    aug.link(node);
+    return avl_insert_rebalance<false>(node, root, nullptr, aug);
+}
+
+template<typename Node, typename Aug>
+inline Node* avl_post_erase(Node* node, Node *parent, Node* root, bool left_child, Aug aug) {
+    for(;;) {
+        auto tag = parent->tag();
+        if(left_child) { // left child
+            if(tag == RIGHT) {
+                Node* sibling = parent->right;
+                auto sibling_tag = sibling->tag();
+                if(sibling_tag == LEFT) {
+                    Node* tmp = sibling->left;
+                    auto tmp_tag = tmp->tag();
+                    rotate_right_as_right_child(sibling, aug);
+                    parent->set_tag((tmp_tag == RIGHT) ? LEFT : BALANCE);
+                    sibling->set_tag((tmp_tag == LEFT) ? RIGHT : BALANCE);
+                    tmp->set_tag(BALANCE);
+                    node = tmp;
+                } else {
+                    parent->set_tag((sibling_tag == BALANCE) ? RIGHT : BALANCE);
+                    sibling->set_tag((sibling_tag == BALANCE) ? LEFT : BALANCE);
+                    node = sibling;
+                }
+
+                rotate_left(parent, root, aug);
+                if(sibling_tag == BALANCE) {
+                    return root;
+                }
+
+            } else if (tag == BALANCE) {
+                parent->set_tag(RIGHT);
+                return root;
+
+            } else {
+                parent->set_tag(BALANCE);
+                node = parent;
+            }
+        } else {                   // right child
+            if(tag == LEFT) {
+                Node* sibling = parent->left;
+                auto sibling_tag = sibling->tag();
+                if(sibling_tag == RIGHT) {
+                    Node* tmp = sibling->right;
+                    auto tmp_tag = tmp->tag();
+                    rotate_left_as_left_child(sibling, aug);
+                    parent->set_tag((tmp_tag == LEFT) ? RIGHT : BALANCE);
+                    sibling->set_tag((tmp_tag == RIGHT) ? LEFT : BALANCE);
+                    tmp->set_tag(BALANCE);
+                    node = tmp;
+                } else {
+                    parent->set_tag((sibling_tag == BALANCE) ? LEFT : BALANCE);
+                    sibling->set_tag((sibling_tag == BALANCE) ? RIGHT : BALANCE);
+                    node = sibling;
+                }
+
+                rotate_right(parent, root, aug);
+                if(sibling_tag == BALANCE) {
+                    return root;
+                }
+
+            } else if (tag == BALANCE) {
+                parent->set_tag(LEFT);
+                return root;
+
+            } else {
+                parent->set_tag(BALANCE);
+                node = parent;
+            }
+        }
+        parent = node->parent();
+        if(parent == nullptr) {
+            break;
+        }
+        left_child = is_left_child(node, parent);
+    }
+    return root;
+}
+
+// the rank of node has increased by 1, see avl_insert_rebalance
+template<bool Joining, typename Node, typename Aug>
+inline Node* wavl_insert_rebalance(Node* node, Node* root, bool* grew, Aug aug) {
+    if (Joining)
+        *grew = false;
+    for (Node* parent = node->parent(); parent; node = parent, parent = node->parent()) {
+        auto tag = parent->tag();
+        if(node == parent->left) { // left child
+            if(tag == WLEFT) {
+                auto node_tag = node->tag();
+                if(node_tag == WRIGHT) {
+                    Node* tmp = node->right;
+                    auto tmp_tag = tmp->tag();
+                    rotate_left_as_left_child(node, aug);
+                    parent->set_tag(((tmp_tag & WLEFT) != 0) ? WRIGHT : BALANCE);
+                    node->set_tag(((tmp_tag & WRIGHT) != 0) ? WLEFT : BALANCE);
+                    tmp->set_tag(BALANCE);
+                } else {
+                    parent->set_tag(((node_tag & WLEFT) != 0) ? BALANCE : WLEFT);
+                    node->set_tag((node_tag == WLEFT) ? BALANCE : WRIGHT);
+                }
+
+                rotate_right(parent, root, aug);
+                if (Joining && node_tag == BALANCE) {
+                    parent = node; // node has taken the place of parent
+                    continue;
+                }
+                return root;
+
+            } else if (tag == WRIGHT) {
+                parent->set_tag(BALANCE);
+                return root;
+
+            } else  {
+                parent->set_tag(WLEFT);
+                if (tag == WEAK) {
+                    return root;
+                }
+            }
+        } else {                   // right child
+            if(tag == WRIGHT) {
+                auto node_tag = node->tag();
+                if(node_tag == WLEFT) {
+                    Node* tmp = node->left;
+                    auto tmp_tag = tmp->tag();
+                    rotate_right_as_right_child(node, aug);
+                    parent->set_tag(((tmp_tag & WRIGHT) != 0) ? WLEFT : BALANCE);
+                    node->set_tag(((tmp_tag & WLEFT) != 0) ? WRIGHT : BALANCE);
+                    tmp->set_tag(BALANCE);
+                } else {
+                    parent->set_tag(((node_tag & WRIGHT) != 0) ? BALANCE : WRIGHT);
+                    node->set_tag((node_tag == WRIGHT) ? BALANCE : WLEFT);
+                }
+
+                rotate_left(parent, root, aug);
+                if (Joining && node_tag == BALANCE) {
+                    parent = node; // node has taken the place of parent
+                    continue;
+                }
+                return root;
+
+            } else if (tag == WLEFT) {
+                parent->set_tag(BALANCE);
+                return root;
+
+            } else {
+                parent->set_tag(WRIGHT);
+                if (tag == WEAK) {
+                    return root;
+                }
+            }
+        }
+    }
+    if (Joining)
+        *grew = true;
+    return root;
+}
+
+template<typename Node, typename Aug>
+inline Node* wavl_post_insert(Node* node, Node* root, Aug aug) {
+    node->set_tag(BALANCE);
+    aug.link(node);
+    return wavl_insert_rebalance<false>(node, root, nullptr, aug);
+}
+
+template<typename Node, typename Aug>
+inline Node* wavl_post_erase(Node* node, Node *parent, Node* root, bool left_child, Aug aug) {
+    for(;;) {
+        auto tag = parent->tag();
+        if(left_child) { // left child
+            if(tag == WRIGHT) {
+                Node* sibling = parent->right;
+                auto sibling_tag = sibling->tag();
+
+                if(sibling_tag == WEAK) {
+                    sibling->set_tag(BALANCE);
+
+                } else {
+                    if(sibling_tag == WLEFT) {
+                        Node* tmp = sibling->left;
+                        auto tmp_tag = tmp->tag();
+                        rotate_right_as_right_child(sibling, aug);
+                        parent->set_tag(((tmp_tag & WRIGHT) != 0) ? WLEFT : BALANCE);
+                        sibling->set_tag(((tmp_tag & WLEFT) != 0) ? WRIGHT : BALANCE);
+                        tmp->set_tag(WEAK);
+                    } else {
+                        parent->set_tag((sibling_tag == WRIGHT) ? BALANCE : WRIGHT);
+                        sibling->set_tag((sibling_tag == WRIGHT) ? WEAK : WLEFT);
+                    }
+
+                    rotate_left(parent, root, aug);
+                    return root;
+                }
+
+            } else if (tag == WLEFT) {
+                parent->set_tag(BALANCE);
+
+            } else {
+                parent->set_tag(WRIGHT);
+                if (tag == BALANCE) {
+                    return root;
+                }
+            }
+        } else {                   // right child
+            if(tag == WLEFT) {
+                Node* sibling = parent->left;
+                auto sibling_tag = sibling->tag();
+
+                if(sibling_tag == WEAK) {
+                    sibling->set_tag(BALANCE);
+
+                } else {
+                    if(sibling_tag == WRIGHT) {
+                        Node* tmp = sibling->right;
+                        auto tmp_tag = tmp->tag();
+                        rotate_left_as_left_child(sibling, aug);
+                        parent->set_tag(((tmp_tag & WLEFT) != 0) ? WRIGHT : BALANCE);
+                        sibling->set_tag(((tmp_tag & WRIGHT) != 0) ? WLEFT : BALANCE);
+                        tmp->set_tag(WEAK);
+                    } else {
+                        parent->set_tag((sibling_tag == WLEFT) ? BALANCE : WLEFT);
+                        sibling->set_tag((sibling_tag == WLEFT) ? WEAK : WRIGHT);
+                    }
+
+                    rotate_right(parent, root, aug);
+                    return root;
+                }
+                
+            } else if (tag == WRIGHT) {
+                parent->set_tag(BALANCE);
+
+            } else {
+                parent->set_tag(WLEFT);
+                if (tag == BALANCE) {
+                    return root;
+                }
+            }
+        }
+        node = parent;
+        parent = node->parent();
+        if(parent == nullptr) {
+            break;
+        }
+        left_child = is_left_child(node, parent);
+    }
+    return root;
+}
+
+
+template<typename PostErase, typename Node, typename Aug>
+inline Node* bst_erase(Node *node, Node* root, PostErase post_erase, Aug aug) {
+    Node *child, *parent;
+    if (node->left && node->right) {
+        Node *old = node, *tmp;
+        node = node->right;
+        while ((tmp = node->left) != nullptr) {
+            node = tmp;
+        }
+        child = node->right;
+        parent = node->parent();
+        post_erase.set_color(node->tag());
+        if (child) {
+            child->set_parent(parent);
+        }
+        if (parent == old) {
+            replace_node_as_right_child(child, parent);
+            parent = node;
+            post_erase.set_as_left_child(false);
+        } else {
+            replace_node_as_left_child(child, parent);
+            post_erase.set_as_left_child(true);
+        }
+
+        tmp = old->parent();
+        node->left = old->left;
+        node->right = old->right;
+        node->set_parent(tmp);
+        node->set_tag(old->tag());
+        replace_node(old, node, tmp, root);
+        old->left->set_parent(node);
+        if (old->right) {
+            old->right->set_parent(node);
+        }
+    }
+    else {
+        if (node->left == nullptr) 
+            child = node->right;
+        else
+            child = node->left;
+        parent = node->parent();
+        post_erase.set_color(node->tag());
+        post_erase.set_as_left_child((parent != nullptr) && is_left_child(node, parent));
+        replace_node(node, child, parent, root);
+        
+        if (child) {
+            child->set_parent(parent);
+        }
+    }
+    aug.propagate(parent);
+    return post_erase(child, parent, root);
+}
+
+template<typename Node, typename Aug>
+inline Node* rb_erase(Node* node, Node* root, Aug aug) {
+    struct {
+        Aug aug;
+        int color;
+        void set_color(int c) { color = c; }
+        void set_as_left_child(bool) const {}
+        Node* operator()(Node* child, Node* parent, Node* root) {
+            if(color == BLACK) {
+                return rb_post_erase(child, parent, root, aug);
+            } else {
+                return root;
+            }
+        }
+    } post_erase;
+
+    post_erase.aug = aug;
+    return bst_erase(node, root, post_erase, aug);
+}
+
+template<typename Node, typename Aug>
+inline Node* avl_erase(Node* node, Node* root, Aug aug) {
+    struct {
+        Aug aug;
+        bool flag;
+        void set_color(int) const {}
+        void set_as_left_child(bool f) {
+            flag = f;
+        }
+        Node* operator()(Node* child, Node* parent, Node* root) {
+            if(parent != nullptr) {
+                return avl_post_erase(child, parent, root, flag, aug);
+            } else {
+                return root;
+            }
+        }
+    } post_erase;
+
+    post_erase.aug = aug;
+    return bst_erase(node, root, post_erase, aug);
+}
+
+template<typename Node, typename Aug>
+inline Node* wavl_erase(Node* node, Node* root, Aug aug) {
+    struct {
+        Aug aug;
+        bool flag;
+        void set_color(int) const {}
+        void set_as_left_child(bool f) {
+            flag = f;
+        }
+        Node* operator()(Node* child, Node* parent, Node* root) {
+            if(parent != nullptr) {
+                return wavl_post_erase(child, parent, root, flag, aug);
+            } else {
+                return root;
+            }
+        }
+    } post_erase;
+
+    post_erase.aug = aug;
+    return bst_erase(node, root, post_erase, aug);
+}
+
+// Join and split. The height is measured by the black height (counting the node itself)
+// for red-black trees, by the height for AVL and by the rank for WAVL, the *Join structs
+// below tell how to compute it and how the height of a child differs from its parent.
+
+template<typename Node>
+inline void link_children(Node* node, Node* left, Node* right) {
+    node->left = left;
+    node->right = right;
+    if (left)
+        left->set_parent(node);
+    if (right)
+        right->set_parent(node);
+}
+
+struct RBJoin {
+    static const int null_height = 0;
+    template<typename Node>
+    static int height(Node* node) {
+        int h = 0;
+        for (; node; node = node->left)
+            h += (node->tag() == BLACK);
+        return h;
+    }
+    template<typename Node>
+    static int left_diff(Node* node) {
+        return node->tag() == BLACK;
+    }
+    template<typename Node>
+    static int right_diff(Node* node) {
+        return node->tag() == BLACK;
+    }
+    // make root the root of a tree, return how much its height has grown
+    template<typename Node>
+    static int finish(Node* root) {
+        root->set_parent(nullptr);
+        if (root->tag() == BLACK)
+            return 0;
+        root->set_tag(BLACK);
+        return 1;
+    }
+
+    template<typename Node, typename Aug>
+    static Node* join(Node* left, int hl, Node* pivot, Node* right, int hr, int& h, Aug aug) {
+        if (left && left->tag() == RED) {
+            left->set_tag(BLACK);
+            ++hl;
+        }
+        if (right && right->tag() == RED) {
+            right->set_tag(BLACK);
+            ++hr;
+        }
+        if (hl == hr) {
+            link_children(pivot, left, right);
+            aug.update(pivot);
+            pivot->set_parent(nullptr);
+            pivot->set_tag(BLACK);
+            h = hl + 1;
+            return pivot;
+        }
+
+        // hang pivot as a red node in place of a black node of the same black height
+        // on the inner spine of the higher tree, then fix it as if it were inserted
+        Node *root, *parent = nullptr, *node;
+        if (hl > hr) {
+            int hn = hl;
+            for (node = left; hn > hr || (node && node->tag() == RED); node = node->right) {
+                hn -= (node->tag() == BLACK);
+                parent = node;
+            }
+            link_children(pivot, node, right);
+            parent->right = pivot;
+            root = left;
+            h = hl;
+        } else {
+            int hn = hr;
+            for (node = right; hn > hl || (node && node->tag() == RED); node = node->left) {
+                hn -= (node->tag() == BLACK);
+                parent = node;
+            }
+            link_children(pivot, left, node);
+            parent->left = pivot;
+            root = right;
+            h = hr;
+        }
+        pivot->set_parent(parent);
+        pivot->set_tag(RED);
+        root->set_parent(nullptr);
+        aug.propagate(pivot);
+        root = rb_insert_rebalance(pivot, root, aug);
+        if (root->tag() == RED) {
+            root->set_tag(BLACK);
+            ++h;
+        }
+        return root;
+    }
+};
+
+struct AVLJoin {
+    static const int null_height = 0;
+    template<typename Node>
+    static int height(Node* node) {
+        int h = 0;
+        for (; node; node = (node->tag() == RIGHT) ? node->right : node->left)
+            ++h;
+        return h;
+    }
+    template<typename Node>
+    static int left_diff(Node* node) {
+        return (node->tag() == RIGHT) ? 2 : 1;
+    }
+    template<typename Node>
+    static int right_diff(Node* node) {
+        return (node->tag() == LEFT) ? 2 : 1;
+    }
+    template<typename Node>
+    static int finish(Node* root) {
+        root->set_parent(nullptr);
+        return 0;
+    }
+
+    template<typename Node, typename Aug>
+    static Node* join(Node* left, int hl, Node* pivot, Node* right, int hr, int& h, Aug aug) {
+        if (hl <= hr + 1 && hr <= hl + 1) {
+            link_children(pivot, left, right);
+            aug.update(pivot);
+            pivot->set_parent(nullptr);
+            pivot->set_tag((hl == hr) ? BALANCE : ((hl > hr) ? LEFT : RIGHT));
+            h = ((hl > hr) ? hl : hr) + 1;
+            return pivot;
+        }
+
+        // hang pivot in place of a node of about the same height on the inner spine
+        // of the higher tree, the subtree there grows one higher
+        Node *root, *parent = nullptr, *node;
+        bool grew;
+        if (hl > hr) {
+            int hn = hl;
+            for (node = left; hn > hr + 1; node = node->right) {
+                hn -= right_diff(node);
+                parent = node;
+            }
+            link_children(pivot, node, right);
+            pivot->set_tag((hn > hr) ? LEFT : BALANCE);
+            parent->right = pivot;
+            root = left;
+            h = hl;
+        } else {
+            int hn = hr;
+            for (node = right; hn > hl + 1; node = node->left) {
+                hn -= left_diff(node);
+                parent = node;
+            }
+            link_children(pivot, left, node);
+            pivot->set_tag((hn > hl) ? RIGHT : BALANCE);
+            parent->left = pivot;
+            root = right;
+            h = hr;
+        }
+        pivot->set_parent(parent);
+        root->set_parent(nullptr);
+        aug.propagate(pivot);
+        root = avl_insert_rebalance<true>(pivot, root, &grew, aug);
+        h += grew;
+        return root;
+    }
+};
+
+struct WAVLJoin {
+    static const int null_height = -1;
+    template<typename Node>
+    static int height(Node* node) {
+        int h = -1;
+        for (; node; node = node->left)
+            h += left_diff(node);
+        return h;
+    }
+    template<typename Node>
+    static int left_diff(Node* node) {
+        return ((node->tag() & WRIGHT) != 0) ? 2 : 1;
+    }
+    template<typename Node>
+    static int right_diff(Node* node) {
+        return ((node->tag() & WLEFT) != 0) ? 2 : 1;
+    }
+    template<typename Node>
+    static int finish(Node* root) {
+        root->set_parent(nullptr);
+        return 0;
+    }
+
+    template<typename Node, typename Aug>
+    static Node* join(Node* left, int hl, Node* pivot, Node* right, int hr, int& h, Aug aug) {
+        if (hl <= hr + 1 && hr <= hl + 1) {
+            link_children(pivot, left, right);
+            aug.update(pivot);
+            pivot->set_parent(nullptr);
+            pivot->set_tag((hl == hr) ? BALANCE : ((hl > hr) ? WLEFT : WRIGHT));
+            h = ((hl > hr) ? hl : hr) + 1;
+            return pivot;
+        }
+
+        // same as AVL, pivot gets rank 1 higher than the node it replaces
+        Node *root, *parent = nullptr, *node;
+        bool grew;
+        if (hl > hr) {
+            int hn = hl;
+            for (node = left; hn > hr + 1; node = node->right) {
+                hn -= right_diff(node);
+                parent = node;
+            }
+            link_children(pivot, node, right);
+            pivot->set_tag((hn > hr) ? WLEFT : BALANCE);
+            parent->right = pivot;
+            root = left;
+            h = hl;
+        } else {
+            int hn = hr;
+            for (node = right; hn > hl + 1; node = node->left) {
+                hn -= left_diff(node);
+                parent = node;
+            }
+            link_children(pivot, left, node);
+            pivot->set_tag((hn > hl) ? WRIGHT : BALANCE);
+            parent->left = pivot;
+            root = right;
+            h = hr;
+        }
+        pivot->set_parent(parent);
+        root->set_parent(nullptr);
+        aug.propagate(pivot);
+        root = wavl_insert_rebalance<true>(pivot, root, &grew, aug);
+        h += grew;
+        return root;
+    }
+};
+
+// Split along the path from node up to the root. Node is the last node on a search path,
+// where < 0 (> 0) if it goes to the left (right) part, or where == 0 if it is removed from
+// both. Going up, every node on the path is joined with its subtree on the other side of
+// the path and the part collected so far, the heights are derived from the tags on the
+// way, so the joins cost O(log n) in total.
+template<typename Join, typename Node, typename Aug>
+inline void bst_split(Node* node, int where, Node*& left, int& left_h, Node*& right, int& right_h, Aug aug) {
+    Node *l = nullptr, *r = nullptr;
+    int hl = Join::null_height, hr = Join::null_height, h;
+    bool to_left = false;
+    if (where == 0) {
+        h = Join::height(node);
+        l = node->left;
+        r = node->right;
+        hl = h - Join::left_diff(node);
+        hr = h - Join::right_diff(node);
+        Node* parent = node->parent();
+        if (parent) {
+            to_left = !is_left_child(node, parent);
+            h += to_left ? Join::right_diff(parent) : Join::left_diff(parent);
+        }
+        node = parent;
+    } else {
+        to_left = (where < 0);
+        h = Join::null_height + (to_left ? Join::right_diff(node) : Join::left_diff(node));
+    }
+
+    while (node) {
+        // h is the height of node, read everything needed above before node is relinked
+        Node* parent = node->parent();
+        bool parent_to_left = false;
+        int parent_h = 0;
+        if (parent) {
+            parent_to_left = !is_left_child(node, parent);
+            parent_h = h + (parent_to_left ? Join::right_diff(parent) : Join::left_diff(parent));
+        }
+        if (to_left) {
+            l = Join::join(static_cast<Node*>(node->left), h - Join::left_diff(node), node, l, hl, hl, aug);
+        } else {
+            r = Join::join(r, hr, node, static_cast<Node*>(node->right), h - Join::right_diff(node), hr, aug);
+        }
+        node = parent;
+        to_left = parent_to_left;
+        h = parent_h;
+    }
+    if (l)
+        hl += Join::finish(l);
+    if (r)
+        hr += Join::finish(r);
+    left = l;
+    left_h = hl;
+    right = r;
+    right_h = hr;
+}
+
+// Split a tree of height h at its root: the children become the roots of the two parts, their
+// heights follow from h and the tag of the root, so no path is walked. The aggregates of the
+// children are unchanged, so aug is not called.
+template<typename Join, typename Node, typename Aug>
+inline void bst_split_root(Node* root, int h, Node*& left, int& left_h, Node*& right, int& right_h, Aug) {
+    left = root->left;
+    right = root->right;
+    left_h = h - Join::left_diff(root);
+    right_h = h - Join::right_diff(root);
+    if (left)
+        left_h += Join::finish(left);
+    if (right)
+        right_h += Join::finish(right);
+}
+
+// join without a pivot, the last node of left is taken out as the pivot
+template<typename Join, typename Node, typename Aug>
+inline Node* bst_join2(Node* left, int hl, Node* right, int hr, int& h, Aug aug) {
+    if (left == nullptr) {
+        h = hr;
+        if (right)
+            h += Join::finish(right);
+        return right;
+    }
+    if (right == nullptr) {
+        h = hl + Join::finish(left);
+        return left;
+    }
+    Node *pivot = left, *empty;
+    int he;
+    while (pivot->right)
+        pivot = pivot->right;
+    left->set_parent(nullptr);
+    bst_split<Join>(pivot, 0, left, hl, empty, he, aug);
+    return Join::join(left, hl, pivot, right, hr, h, aug);
+}
+
+// Link n nodes chained through their right pointers into a perfectly balanced
+// tree: the sizes of the two subtrees of every node differ by at most 1.
+template<typename SetTag, typename Node, typename Aug>
+Node* bst_build(Node*& head, std::size_t n, int depth, SetTag set_tag, Aug aug) {
+    if (n == 0)
+        return nullptr;
+    std::size_t nl = (n - 1) / 2, nr = n - 1 - nl;
+    Node* left = bst_build(head, nl, depth + 1, set_tag, aug);
+    Node* node = head;
+    head = head->right;
+    Node* right = bst_build(head, nr, depth + 1, set_tag, aug);
+    node->left = left;
+    node->right = right;
+    if (left)
+        left->set_parent(node);
+    if (right)
+        right->set_parent(node);
+    set_tag(node, nl, nr, depth);
+    aug.update(node);
+    return node;
+}
+
+// nr == nl or nr == nl + 1, the right subtree is higher iff nr is a power of 2
+inline bool right_higher(std::size_t nl, std::size_t nr) {
+    return nl != nr && (nr & (nr - 1)) == 0;
+}
+
+template<typename Node, typename Aug>
+inline Node* rb_build(Node* head, std::size_t n, Aug aug) {
+    // all null links are at depth h - 1 or h, paint the nodes of the last level red
+    int red_depth = bit_length(n) - 1;
+    Node* root = bst_build(head, n, 0, [=](Node* node, std::size_t, std::size_t, int depth) {
+        if (depth == red_depth && depth != 0)
+            node->set_tag(RED);
+        else
+            node->set_tag(BLACK);
+    }, aug);
+    if (root)
+        root->set_parent(nullptr);
+    return root;
+}
+
+template<typename Node, typename Aug>
+inline Node* avl_build(Node* head, std::size_t n, Aug aug) {
+    Node* root = bst_build(head, n, 0, [](Node* node, std::size_t nl, std::size_t nr, int) {
+        node->set_tag(right_higher(nl, nr) ? RIGHT : BALANCE);
+    }, aug);
+    if (root)
+        root->set_parent(nullptr);
+    return root;
+}
+
+template<typename Node, typename Aug>
+inline Node* wavl_build(Node* head, std::size_t n, Aug aug) {
+    Node* root = bst_build(head, n, 0, [](Node* node, std::size_t nl, std::size_t nr, int) {
+        node->set_tag(right_higher(nl, nr) ? WRIGHT : BALANCE);
+    }, aug);
+    if (root)
+        root->set_parent(nullptr);
+    return root;
+}
+
+// Splay trees. The tags are unused, a node is brought up by rotations on every access:
+// zig-zig rotates the parent first, zig-zag the node twice. Semi-splaying continues from
+// the parent after a zig-zig, which halves the depth of the path with fewer rotations but
+// does not bring the node to the root.
+
+template<typename Node, typename Aug>
+inline void splay_rotate_up(Node* node, Node*& root, Aug aug) {
+    Node* parent = node->parent();
+    if (is_left_child(node, parent))
+        rotate_right(parent, root, aug);
+    else
+        rotate_left(parent, root, aug);
+}
+
+template<bool Semi, typename Node, typename Aug>
+inline Node* bst_splay(Node* node, Node* root, Aug aug) {
+    Node* parent;
+    while ((parent = node->parent()) != nullptr) {
+        Node* grand = parent->parent();
+        if (grand == nullptr) {
+            if (!Semi)
+                splay_rotate_up(node, root, aug);
+            break;
+        }
+        if (is_left_child(parent, grand) == is_left_child(node, parent)) {
+            splay_rotate_up(parent, root, aug);
+            if (Semi)
+                node = parent;
+            else
+                splay_rotate_up(node, root, aug);
+        } else {
+            splay_rotate_up(node, root, aug);
+            splay_rotate_up(node, root, aug);
+        }
+    }
+    return root;
+}
+
+template<typename Node, typename Aug>
+inline Node* splay_erase(Node* node, Node* root, Aug aug) {
+    struct {
+        void set_color(int) const {}
+        void set_as_left_child(bool) const {}
+        Node* operator()(Node*, Node*, Node* root) const {
+            return root;
+        }
+    } post_erase;
+    return bst_erase(node, root, post_erase, aug);
+}
+
+// in-order iteration
+
+template<typename Node>
+inline Node* first_node(Node* root) {
+    auto p = root;
+    if (p == nullptr)
+        return nullptr; // empty
+    while (p->left)
+        p = p->left;
+    return p;
+}
+
+template<typename Node>
+inline Node* last_node(Node* root) {
+    auto p = root;
+    if (p == nullptr)
+        return nullptr; // empty
+    while (p->right)
+        p = p->right;
+    return p;
+}
+
+template<typename Node>
+inline Node* next_node(Node* node) {
+    if (node->right) {
+        node = node->right; 
+        while (node->left)
+            node = node->left;
+        return node;
+    }
+
+    Node* parent;
+    while ((parent = node->parent()) && !is_left_child(node, parent))
+        node = parent;
+    return parent;
+}
+
+template<typename Node>
+inline Node* prev_node(Node* node) {
+    if (node->left) {
+        node = node->left; 
+        while (node->right)
+            node = node->right;
+        return node;
+    }
+
+    Node* parent;
+    while ((parent = node->parent()) && is_left_child(node, parent))
+        node = parent;
+    return parent;
+}
+
+// A user-defined aggregate called directly, where the exported functions go through the
+// function pointer of augment_callback.
+template<typename Augment>
+struct DirectAugment {
+    void update(NodeBase* node) const {
+        Augment::update_node(node);
+    }
+    void propagate(NodeBase* node) const {
+        Augment::propagate(node);
+    }
+    void link(NodeBase* node) const {
+        Augment::propagate(node);
+    }
+};
+
+// the augmentation of the algorithms for the tag passed to the balancing operations
+template<typename ... Aug>
+struct inline_augment {
+    using type = NoAugment;
+};
+
+template<>
+struct inline_augment<count_nodes> {
+    using type = CountAugment;
+};
+
+template<typename NodeType, typename Policy>
+struct inline_augment<augment_with<NodeType, Policy>> {
+    using type = DirectAugment<augment_with<NodeType, Policy>>;
+};
+
+}
+
+// Policies for the Balance argument of rbtree, avl and wavl: the balancing operations of the
+// scheme instantiated in the including translation unit, the constants are those of the
+// out-of-line operations. A policy of one's own may derive its ops from one of these and
+// hide some of the functions.
+#define BST_INLINE_BALANCE(name, Join) \
+struct inline_##name { \
+    template<typename Hook, typename ... Aug> \
+    struct ops : impl::name##_ops<Hook, Aug...> { \
+        using augment = typename impl::inline_augment<Aug...>::type; \
+        static Hook* post_insert(Hook* node, Hook* root) { \
+            return impl::name##_post_insert(node, root, augment()); \
+        } \
+        static Hook* erase(Hook* node, Hook* root) { \
+            return impl::name##_erase(node, root, augment()); \
+        } \
+        static Hook* build(Hook* head, std::size_t n) { \
+            return impl::name##_build(head, n, augment()); \
+        } \
+        static int height(Hook* root) { \
+            return impl::Join::height(root); \
+        } \
+        static Hook* join(Hook* left, int hl, Hook* pivot, Hook* right, int hr, int& h) { \
+            return impl::Join::join(left, hl, pivot, right, hr, h, augment()); \
+        } \
+        static Hook* join2(Hook* left, int hl, Hook* right, int hr, int& h) { \
+            return impl::bst_join2<impl::Join>(left, hl, right, hr, h, augment()); \
+        } \
+        static void split(Hook* node, int where, Hook*& left, int& hl, Hook*& right, int& hr) { \
+            impl::bst_split<impl::Join>(node, where, left, hl, right, hr, augment()); \
+        } \
+        static void split_root(Hook* root, int h, Hook*& left, int& hl, Hook*& right, int& hr) { \
+            impl::bst_split_root<impl::Join>(root, h, left, hl, right, hr, augment()); \
+        } \
+    }; \
+};
+
+BST_INLINE_BALANCE(rb, RBJoin)
+BST_INLINE_BALANCE(avl, AVLJoin)
+BST_INLINE_BALANCE(wavl, WAVLJoin)
+#undef BST_INLINE_BALANCE
+
+}
+
+#endif
@@ -1,653 +1,427 @@
-#include"bstree.h"
-
-/* The red-black tree code is modified from linux kernel
- */
+#include"bstree_inline.h"
 
 namespace bst {
 namespace impl {
 
-using Node = NodeBase;
+// The exported entry points, each in a plain, a counted and a user-augmented version. Param
+// is the extra parameter declared by bstree.h, aug the augmentation it stands for.
+#define BST_EXPORT_BALANCE(Hook, name, Join, Param, aug) \
+Hook* name##_post_insert(Hook* node, Hook* root Param) { \
+    return name##_post_insert(node, root, aug); \
+} \
+Hook* name##_erase(Hook* node, Hook* root Param) { \
+    return name##_erase(node, root, aug); \
+} \
+Hook* name##_build(Hook* head, std::size_t n Param) { \
+    return name##_build(head, n, aug); \
+} \
+Hook* name##_join(Hook* left, int hl, Hook* pivot, Hook* right, int hr, int& h Param) { \
+    return Join::join(left, hl, pivot, right, hr, h, aug); \
+} \
+Hook* name##_join2(Hook* left, int hl, Hook* right, int hr, int& h Param) { \
+    return bst_join2<Join>(left, hl, right, hr, h, aug); \
+} \
+void name##_split(Hook* node, int where, Hook*& left, int& hl, Hook*& right, int& hr Param) { \
+    bst_split<Join>(node, where, left, hl, right, hr, aug); \
+} \
+void name##_split_root(Hook* root, int h, Hook*& left, int& hl, Hook*& right, int& hr Param) { \
+    bst_split_root<Join>(root, h, left, hl, right, hr, aug); \
+}
+
+// iteration and the plain balancing functions of every scheme for Hook
+#define BST_EXPORT_HOOK(Hook) \
+Hook* bst_first(Hook* root) { \
+    return first_node(root); \
+} \
+Hook* bst_last(Hook* root) { \
+    return last_node(root); \
+} \
+Hook* bst_next(Hook* node) { \
+    return next_node(node); \
+} \
+Hook* bst_prev(Hook* node) { \
+    return prev_node(node); \
+} \
+int rb_height(Hook* root) { \
+    return RBJoin::height(root); \
+} \
+int avl_height(Hook* root) { \
+    return AVLJoin::height(root); \
+} \
+int wavl_height(Hook* root) { \
+    return WAVLJoin::height(root); \
+} \
+BST_EXPORT_BALANCE(Hook, rb, RBJoin, , NoAugment()) \
+BST_EXPORT_BALANCE(Hook, avl, AVLJoin, , NoAugment()) \
+BST_EXPORT_BALANCE(Hook, wavl, WAVLJoin, , NoAugment())
+
+#define BST_COUNTED , count_nodes
+#define BST_AUGMENTED , augment_callback aug
 
-#define RED     0
-#define BLACK   3
-#define LEFT    3 // left  higher
-#define RIGHT   2 // right higher
-#define BALANCE 0
-#define WEAK    3
-#define WLEFT   1
-#define WRIGHT  2
+using Node = NodeBase;
 
+BST_EXPORT_HOOK(Node)
 
-inline void replace_node_as_left_child(Node* newnode, Node* parent) {
-    parent->left = newnode;
+Node* splay(Node* node, Node* root) {
+    return bst_splay<false>(node, root, NoAugment());
 }
-inline void replace_node_as_right_child(Node* newnode, Node* parent) {
-    parent->right = newnode;
+
+Node* semi_splay(Node* node, Node* root) {
+    return bst_splay<true>(node, root, NoAugment());
 }
 
-inline void replace_node(Node* oldnode, Node* newnode, Node* parent, Node*& root) {
-    if (parent) {
-        if (parent->left == oldnode) {
-            replace_node_as_left_child(newnode, parent);
-        } else  {
-            replace_node_as_right_child(newnode, parent);
-        }
-    } else {
-        root = newnode;
-    }
+Node* splay_erase(Node* node, Node* root) {
+    return splay_erase(node, root, NoAugment());
 }
 
+BST_EXPORT_BALANCE(Node, rb, RBJoin, BST_COUNTED, CountAugment())
+BST_EXPORT_BALANCE(Node, avl, AVLJoin, BST_COUNTED, CountAugment())
+BST_EXPORT_BALANCE(Node, wavl, WAVLJoin, BST_COUNTED, CountAugment())
+BST_EXPORT_BALANCE(Node, rb, RBJoin, BST_AUGMENTED, CallbackAugment{aug.update})
+BST_EXPORT_BALANCE(Node, avl, AVLJoin, BST_AUGMENTED, CallbackAugment{aug.update})
+BST_EXPORT_BALANCE(Node, wavl, WAVLJoin, BST_AUGMENTED, CallbackAugment{aug.update})
 
-inline void rotate_left_as_left_child(Node* node) {
-    auto right = node->right;
-    auto parent = node->parent();
-    node->right = right->left;
-    if (right->left)
-        right->left->set_parent(node);
-    right->left = node;
-    right->set_parent(parent);
-    replace_node_as_left_child(right, parent);
-    node->set_parent(right);
-}
+// The plain entry points for compact hooks.
 
-inline void rotate_right_as_right_child(Node* node) {
-    auto left = node->left;
-    auto parent = node->parent();
-    node->left = left->right;
-    if (left->right) 
-        left->right->set_parent(node);
-    left->right = node;
-    left->set_parent(parent);
-    replace_node_as_right_child(left, parent);
-    node->set_parent(left);
-}
+BST_EXPORT_HOOK(CompactNodeBase)
 
-inline void rotate_left(Node* node, Node*& root) {
-    auto right = node->right;
-    auto parent = node->parent();
-    node->right = right->left;
-    if (right->left)
-        right->left->set_parent(node);
-    right->left = node;
-    right->set_parent(parent);
-    replace_node(node, right, parent, root);
-    node->set_parent(right);
-}
+// The plain entry points for offset hooks.
 
-inline void rotate_right(Node* node, Node*& root) {
-    auto left = node->left;
-    auto parent = node->parent();
-    node->left = left->right;
-    if (left->right) 
-        left->right->set_parent(node);
-    left->right = node;
-    left->set_parent(parent);
-    replace_node(node, left, parent, root);
-    node->set_parent(left);
-}
+BST_EXPORT_HOOK(OffsetNodeBase)
 
-Node* rb_post_insert(Node* node, Node* root) {
-    Node *parent, *gparent;
-    node->set_tag<RED>();
-
-    while ((parent = node->parent()) && parent->tag() == RED) {
-        gparent = parent->parent();
-
-        if (parent == gparent->left) {
-            {
-                Node *uncle = gparent->right;
-                if (uncle && uncle->tag() == RED) {
-                    uncle->set_tag<BLACK>();
-                    parent->set_tag<BLACK>();
-                    gparent->set_tag<RED>();
-                    node = gparent;
-                    continue;
-                }
-            }
+// The plain entry points for sided hooks.
 
-            if (parent->right == node) {
-                Node *tmp;
-                rotate_left_as_left_child(parent);
-                tmp = parent;
-                parent = node;
-                node = tmp;
-            }
+BST_EXPORT_HOOK(SidedNodeBase)
 
-            parent->set_tag<BLACK>();
-            gparent->set_tag<RED>();
-            rotate_right(gparent, root);
-        } else {
-            {
-                Node *uncle = gparent->left;
-                if (uncle && uncle->tag() == RED) {
-                    uncle->set_tag<BLACK>();
-                    parent->set_tag<BLACK>();
-                    gparent->set_tag<RED>();
-                    node = gparent;
-                    continue;
-                }
-            }
+// The plain entry points for atomic hooks.
 
-            if (parent->left == node) {
-                Node *tmp;
-                rotate_right_as_right_child(parent);
-                tmp = parent;
-                parent = node;
-                node = tmp;
-            }
+BST_EXPORT_HOOK(AtomicNodeBase)
 
-            parent->set_tag<BLACK>();
-            gparent->set_tag<RED>();
-            rotate_left(gparent, root);
-        }
-    }
+#undef BST_AUGMENTED
+#undef BST_COUNTED
+#undef BST_EXPORT_HOOK
+#undef BST_EXPORT_BALANCE
 
-    root->set_tag<BLACK>();
-    return root;
+// Trees of nodes without parent pointers. The path from the root stands in for the parent
+// pointers, the rotations return the new root of the subtree for the caller to link.
+
+using Lean = LeanNodeBase;
+
+inline Lean* lean_child(Lean* node, bool right) {
+    return right ? node->right : node->left();
 }
 
-inline Node *rb_post_erase(Node *node, Node *parent, Node *root) {
-    Node *other;
-
-    while ((!node || node->tag() == BLACK) && node != root) {
-        if (parent->left == node) {
-            other = parent->right;
-            if (other->tag() == RED) {
-                other->set_tag<BLACK>();
-                parent->set_tag<RED>();
-                rotate_left(parent, root);
-                other = parent->right;
-            }
-            if ((!other->left || other->left->tag() == BLACK) && (!other->right || other->right->tag() == BLACK)) {
-                other->set_tag<RED>();
-                node = parent;
-                parent = node->parent();
-            } else {
-                if (!other->right || other->right->tag() == BLACK) {
-                    Node *o_left;
-                    if ((o_left = other->left))
-                        o_left->set_tag<BLACK>();
-                    other->set_tag<RED>();
-                    rotate_right_as_right_child(other);
-                    other = parent->right;
-                }
-                other->set_tag(parent->tag());
-                parent->set_tag<BLACK>();
-                if (other->right)
-                    other->right->set_tag<BLACK>();
-                rotate_left(parent, root);
-                node = root;
-                break;
-            }
-        } else {
-            other = parent->left;
-            if (other->tag() == RED) {
-                other->set_tag<BLACK>();
-                parent->set_tag<RED>();
-                rotate_right(parent, root);
-                other = parent->left;
-            }
-            if ((!other->left || other->left->tag() == BLACK) && (!other->right || other->right->tag() == BLACK)) {
-                other->set_tag<RED>();
-                node = parent;
-                parent = node->parent();
-            } else {
-                if (!other->left || other->left->tag() == BLACK) {
-                    Node *o_right;
-                    if ((o_right = other->right))
-                        o_right->set_tag<BLACK>();
-                    other->set_tag<RED>();
-                    rotate_left_as_left_child(other);
-                    other = parent->left;
-                }
-                other->set_tag(parent->tag());
-                parent->set_tag<BLACK>();
-                if (other->left)
-                    other->left->set_tag<BLACK>();
-                rotate_right(parent, root);
-                node = root;
-                break;
-            }
-        }
-    }
-    if (node)
-        node->set_tag<BLACK>();
-    return root;
+inline void lean_set_child(Lean* node, bool right, Lean* child) {
+    if (right)
+        node->right = child;
+    else
+        node->set_left(child);
 }
 
-Node* avl_post_insert(Node* node, Node* root) {
-    node->set_tag<BALANCE>();
-    for (Node* parent = node->parent(); parent; node = parent, parent = node->parent()) {
-        auto tag = parent->tag();
-        if(node == parent->left) { // left child
-            if(tag == LEFT) {
-                auto node_tag = node->tag();
-                if(node_tag == RIGHT) {
-                    auto tmp = node->right;
-                    auto tmp_tag = tmp->tag();
-                    rotate_left_as_left_child(node);
-                    parent->set_tag((tmp_tag == LEFT) ? RIGHT : BALANCE);
-                    node->set_tag((tmp_tag == RIGHT) ? LEFT : BALANCE);
-                    tmp->set_tag<BALANCE>();
-                } else {
-                    parent->set_tag((node_tag == LEFT) ? BALANCE : LEFT);
-                    node->set_tag((node_tag == LEFT) ? BALANCE : RIGHT);
-                }
-
-                rotate_right(parent, root);
-                return root;
+// link the new root of the subtree at path.node[i] in its place
+inline void lean_replace(LeanPath& path, int i, Lean* node, Lean*& root) {
+    if (i > 0)
+        lean_set_child(path.node[i - 1], path.right[i - 1], node);
+    else
+        root = node;
+}
 
-            } else if (tag == BALANCE) {
-                parent->set_tag<LEFT>();
+inline Lean* lean_rotate_left(Lean* node) {
+    Lean* right = node->right;
+    node->right = right->left();
+    right->set_left(node);
+    return right;
+}
 
-            } else {
-                parent->set_tag<BALANCE>();
-                return root;
-            }
-        } else {                   // right child
-            if(tag == RIGHT) {
-                auto node_tag = node->tag();
-                if(node_tag == LEFT) {
-                    auto tmp = node->left;
-                    auto tmp_tag = tmp->tag();
-                    rotate_right_as_right_child(node);
-                    parent->set_tag((tmp_tag == RIGHT) ? LEFT : BALANCE);
-                    node->set_tag((tmp_tag == LEFT) ? RIGHT : BALANCE);
-                    tmp->set_tag<BALANCE>();
-                } else {
-                    parent->set_tag((node_tag == RIGHT) ? BALANCE : RIGHT);
-                    node->set_tag((node_tag == RIGHT) ? BALANCE : LEFT);
-                }
-
-                rotate_left(parent, root);
-                return root;
+inline Lean* lean_rotate_right(Lean* node) {
+    Lean* left = node->left();
+    node->set_left(left->right);
+    left->right = node;
+    return left;
+}
 
-            } else if (tag == BALANCE) {
-                parent->set_tag<RIGHT>();
+inline Lean* lean_rotate(Lean* node, bool right) {
+    return right ? lean_rotate_right(node) : lean_rotate_left(node);
+}
 
-            } else {
-                parent->set_tag<BALANCE>();
-                return root;
-            }
+// Unlink path.node[depth - 1]. A node with two children is replaced by its successor, which
+// takes its tag, and the path is extended down to the place the successor left. Return the
+// tag of the place taken out; *place is its index on the path, the subtree on the
+// path.right[*place - 1] side of path.node[*place - 1] has lost it.
+inline int lean_unlink(LeanPath& path, Lean*& root, int* place) {
+    int i = path.depth - 1;
+    Lean* node = path.node[i];
+    int tag = node->tag();
+    if (node->left() && node->right) {
+        // take the successor out of its place and put it in the place of node
+        int k = i + 1;
+        path.right[i] = true;
+        Lean* next = node->right;
+        for (path.node[k] = next; next->left(); path.node[++k] = next) {
+            path.right[k] = false;
+            next = next->left();
         }
+        tag = next->tag();
+        lean_set_child(path.node[k - 1], path.right[k - 1], next->right);
+        path.node[i] = next;
+        next->set_left(node->left());
+        next->right = node->right;
+        next->set_tag(node->tag());
+        lean_replace(path, i, next, root);
+        i = k;
+    } else {
+        lean_replace(path, i, node->left() ? node->left() : node->right, root);
     }
-    return root;
+    *place = i;
+    return tag;
 }
 
-inline Node* avl_post_erase(Node* node, Node *parent, Node* root, bool left_child) {
-    for(;;) {
-        auto tag = parent->tag();
-        if(left_child) { // left child
-            if(tag == RIGHT) {
-                auto sibling = parent->right;
-                auto sibling_tag = sibling->tag();
-                if(sibling_tag == LEFT) {
-                    auto tmp = sibling->left;
-                    auto tmp_tag = tmp->tag();
-                    rotate_right_as_right_child(sibling);
-                    parent->set_tag((tmp_tag == RIGHT) ? LEFT : BALANCE);
-                    sibling->set_tag((tmp_tag == LEFT) ? RIGHT : BALANCE);
-                    tmp->set_tag<BALANCE>();
-                    node = tmp;
-                } else {
-                    parent->set_tag((sibling_tag == BALANCE) ? RIGHT : BALANCE);
-                    sibling->set_tag((sibling_tag == BALANCE) ? LEFT : BALANCE);
-                    node = sibling;
-                }
-
-                rotate_left(parent, root);
-                if(sibling_tag == BALANCE) {
-                    return root;
-                }
-
-            } else if (tag == BALANCE) {
-                parent->set_tag<RIGHT>();
-                return root;
+// Rotate the subtree of node, whose right subtree is 2 higher than its left one. Return
+// the new root of the subtree; *shorter tells whether the subtree is now 1 lower.
+inline Lean* lean_fix_right(Lean* node, bool* shorter) {
+    Lean* right = node->right;
+    if (right->tag() != LEFT) {
+        bool balanced = right->tag() == BALANCE; // only after an erase
+        lean_rotate_left(node);
+        node->set_tag(balanced ? RIGHT : BALANCE);
+        right->set_tag(balanced ? LEFT : BALANCE);
+        *shorter = !balanced;
+        return right;
+    }
+    Lean* top = right->left();
+    node->right = lean_rotate_right(right);
+    lean_rotate_left(node);
+    node->set_tag(top->tag() == RIGHT ? LEFT : BALANCE);
+    right->set_tag(top->tag() == LEFT ? RIGHT : BALANCE);
+    top->set_tag(BALANCE);
+    *shorter = true;
+    return top;
+}
 
-            } else {
-                parent->set_tag<BALANCE>();
-                node = parent;
-            }
-        } else {                   // right child
-            if(tag == LEFT) {
-                auto sibling = parent->left;
-                auto sibling_tag = sibling->tag();
-                if(sibling_tag == RIGHT) {
-                    auto tmp = sibling->right;
-                    auto tmp_tag = tmp->tag();
-                    rotate_left_as_left_child(sibling);
-                    parent->set_tag((tmp_tag == LEFT) ? RIGHT : BALANCE);
-                    sibling->set_tag((tmp_tag == RIGHT) ? LEFT : BALANCE);
-                    tmp->set_tag<BALANCE>();
-                    node = tmp;
-                } else {
-                    parent->set_tag((sibling_tag == BALANCE) ? LEFT : BALANCE);
-                    sibling->set_tag((sibling_tag == BALANCE) ? RIGHT : BALANCE);
-                    node = sibling;
-                }
-
-                rotate_right(parent, root);
-                if(sibling_tag == BALANCE) {
-                    return root;
-                }
-
-            } else if (tag == BALANCE) {
-                parent->set_tag<LEFT>();
-                return root;
+inline Lean* lean_fix_left(Lean* node, bool* shorter) {
+    Lean* left = node->left();
+    if (left->tag() != RIGHT) {
+        bool balanced = left->tag() == BALANCE;
+        lean_rotate_right(node);
+        node->set_tag(balanced ? LEFT : BALANCE);
+        left->set_tag(balanced ? RIGHT : BALANCE);
+        *shorter = !balanced;
+        return left;
+    }
+    Lean* top = left->right;
+    node->set_left(lean_rotate_left(left));
+    lean_rotate_right(node);
+    node->set_tag(top->tag() == LEFT ? RIGHT : BALANCE);
+    left->set_tag(top->tag() == RIGHT ? LEFT : BALANCE);
+    top->set_tag(BALANCE);
+    *shorter = true;
+    return top;
+}
 
-            } else {
-                parent->set_tag<BALANCE>();
-                node = parent;
-            }
+Lean* avl_post_insert(LeanPath& path, Lean* root) {
+    bool shorter;
+    for (int i = path.depth - 2; i >= 0; --i) {
+        Lean* node = path.node[i];
+        int grown = path.right[i] ? RIGHT : LEFT;
+        if (node->tag() == BALANCE) {
+            node->set_tag(grown);
+            continue;
         }
-        parent = node->parent();
-        if(parent == nullptr) {
+        if (node->tag() != grown) {
+            node->set_tag(BALANCE);
             break;
         }
-        left_child = (node == parent->left);
+        lean_replace(path, i, grown == RIGHT ? lean_fix_right(node, &shorter) : lean_fix_left(node, &shorter), root);
+        break;
     }
     return root;
 }
 
-Node* wavl_post_insert(Node* node, Node* root) {
-    node->set_tag<BALANCE>();
-    for (Node* parent = node->parent(); parent; node = parent, parent = node->parent()) {
-        auto tag = parent->tag();
-        if(node == parent->left) { // left child
-            if(tag == WLEFT) {
-                auto node_tag = node->tag();
-                if(node_tag == WRIGHT) {
-                    auto tmp = node->right;
-                    auto tmp_tag = tmp->parent_with_tag;
-                    rotate_left_as_left_child(node);
-                    parent->set_tag(((tmp_tag & WLEFT) != 0) ? WRIGHT : BALANCE);
-                    node->set_tag(((tmp_tag & WRIGHT) != 0) ? WLEFT : BALANCE);
-                    tmp->set_tag<BALANCE>();
-                } else {
-                    parent->set_tag(((node_tag & WLEFT) != 0) ? BALANCE : WLEFT);
-                    node->set_tag((node_tag == WLEFT) ? BALANCE : WRIGHT);
-                }
-
-                rotate_right(parent, root);
-                return root;
-
-            } else if (tag == WRIGHT) {
-                parent->set_tag<BALANCE>();
-                return root;
-
-            } else  {
-                parent->set_tag<WLEFT>();
-                if (tag == WEAK) {
-                    return root;
-                }
-            }
-        } else {                   // right child
-            if(tag == WRIGHT) {
-                auto node_tag = node->tag();
-                if(node_tag == WLEFT) {
-                    auto tmp = node->left;
-                    auto tmp_tag = tmp->parent_with_tag;
-                    rotate_right_as_right_child(node);
-                    parent->set_tag(((tmp_tag & WRIGHT) != 0) ? WLEFT : BALANCE);
-                    node->set_tag(((tmp_tag & WLEFT) != 0) ? WRIGHT : BALANCE);
-                    tmp->set_tag<BALANCE>();
-                } else {
-                    parent->set_tag(((node_tag & WRIGHT) != 0) ? BALANCE : WRIGHT);
-                    node->set_tag((node_tag == WRIGHT) ? BALANCE : WLEFT);
-                }
-
-                rotate_left(parent, root);
-                return root;
-
-            } else if (tag == WLEFT) {
-                parent->set_tag<BALANCE>();
-                return root;
-
-            } else {
-                parent->set_tag<WRIGHT>();
-                if (tag == WEAK) {
-                    return root;
-                }
-            }
+Lean* avl_erase(LeanPath& path, Lean* root) {
+    int i;
+    lean_unlink(path, root, &i);
+    // the subtree on the path.right[i] side of path.node[i] is 1 lower
+    bool shorter = true;
+    for (--i; i >= 0 && shorter; --i) {
+        Lean* parent = path.node[i];
+        int shrunk = path.right[i] ? RIGHT : LEFT;
+        if (parent->tag() == BALANCE) {
+            parent->set_tag(shrunk == RIGHT ? LEFT : RIGHT);
+            shorter = false;
+        } else if (parent->tag() == shrunk) {
+            parent->set_tag(BALANCE);
+        } else {
+            lean_replace(path, i, shrunk == RIGHT ? lean_fix_left(parent, &shorter) : lean_fix_right(parent, &shorter), root);
         }
     }
     return root;
 }
 
-inline Node* wavl_post_erase(Node* node, Node *parent, Node* root, bool left_child) {
-    for(;;) {
-        auto tag = parent->tag();
-        if(left_child) { // left child
-            if(tag == WRIGHT) {
-                auto sibling = parent->right;
-                auto sibling_tag = sibling->tag();
-
-                if(sibling_tag == WEAK) {
-                    sibling->set_tag<BALANCE>();
-
-                } else {
-                    if(sibling_tag == WLEFT) {
-                        auto tmp = sibling->left;
-                        auto tmp_tag = tmp->tag();
-                        rotate_right_as_right_child(sibling);
-                        parent->set_tag(((tmp_tag & WRIGHT) != 0) ? WLEFT : BALANCE);
-                        sibling->set_tag(((tmp_tag & WLEFT) != 0) ? WRIGHT : BALANCE);
-                        tmp->set_tag<WEAK>();
-                    } else {
-                        parent->set_tag((sibling_tag == WRIGHT) ? BALANCE : WRIGHT);
-                        sibling->set_tag((sibling_tag == WRIGHT) ? WEAK : WLEFT);
-                    }
-
-                    rotate_left(parent, root);
-                    return root;
-                }
-
-            } else if (tag == WLEFT) {
-                parent->set_tag<BALANCE>();
-
-            } else {
-                parent->set_tag<WRIGHT>();
-                if (tag == BALANCE) {
-                    return root;
-                }
-            }
-        } else {                   // right child
-            if(tag == WLEFT) {
-                auto sibling = parent->left;
-                auto sibling_tag = sibling->tag();
-
-                if(sibling_tag == WEAK) {
-                    sibling->set_tag<BALANCE>();
-
-                } else {
-                    if(sibling_tag == WRIGHT) {
-                        auto tmp = sibling->right;
-                        auto tmp_tag = tmp->tag();
-                        rotate_left_as_left_child(sibling);
-                        parent->set_tag(((tmp_tag & WLEFT) != 0) ? WRIGHT : BALANCE);
-                        sibling->set_tag(((tmp_tag & WRIGHT) != 0) ? WLEFT : BALANCE);
-                        tmp->set_tag<WEAK>();
-                    } else {
-                        parent->set_tag((sibling_tag == WLEFT) ? BALANCE : WLEFT);
-                        sibling->set_tag((sibling_tag == WLEFT) ? WEAK : WRIGHT);
-                    }
-
-                    rotate_right(parent, root);
-                    return root;
-                }
-                
-            } else if (tag == WRIGHT) {
-                parent->set_tag<BALANCE>();
-
-            } else {
-                parent->set_tag<WLEFT>();
-                if (tag == BALANCE) {
-                    return root;
-                }
-            }
+// Red-black trees, as rb_insert_rebalance and rb_post_erase with the path for the parents.
+// The new leaf is red, the root is left black.
+
+Lean* rb_post_insert(LeanPath& path, Lean* root) {
+    // path.node[i] is red, so must not be its parent
+    for (int i = path.depth - 1; i >= 2 && path.node[i - 1]->tag() == RED; ) {
+        Lean* parent = path.node[i - 1];
+        Lean* gparent = path.node[i - 2];
+        bool right = path.right[i - 2];
+        Lean* uncle = lean_child(gparent, !right);
+        if (uncle && uncle->tag() == RED) {
+            uncle->set_tag(BLACK);
+            parent->set_tag(BLACK);
+            gparent->set_tag(RED);
+            i -= 2;
+            continue;
         }
-        node = parent;
-        parent = node->parent();
-        if(parent == nullptr) {
-            break;
+        Lean* top = parent;
+        if (path.right[i - 1] != right) {
+            top = path.node[i];
+            lean_set_child(gparent, right, lean_rotate(parent, right));
         }
-        left_child = (node == parent->left);
+        top->set_tag(BLACK);
+        gparent->set_tag(RED);
+        lean_replace(path, i - 2, lean_rotate(gparent, !right), root);
+        break;
     }
+    root->set_tag(BLACK);
     return root;
 }
 
-
-template<typename PostErase>
-inline Node* bst_erase(Node *node, Node* root, PostErase post_erase) {
-    Node *child, *parent;
-    if (node->left && node->right) {
-        Node *old = node, *tmp;
-        node = node->right;
-        while ((tmp = node->left) != nullptr) {
-            node = tmp;
+Lean* rb_erase(LeanPath& path, Lean* root) {
+    int i;
+    if (lean_unlink(path, root, &i) == RED)
+        return root;
+    // the subtree on the path.right[i] side of path.node[i] is one black short
+    for (--i; i >= 0; --i) {
+        Lean* parent = path.node[i];
+        bool right = path.right[i];
+        Lean* node = lean_child(parent, right);
+        if (node && node->tag() == RED) {
+            node->set_tag(BLACK);
+            return root;
         }
-        child = node->right;
-        parent = node->parent();
-        post_erase.set_color(node->tag());
-        if (child) {
-            child->set_parent(parent);
+        Lean* other = lean_child(parent, !right);
+        // a red sibling is rotated above parent, which turns red and ends the loop below
+        Lean* above = nullptr;
+        if (other->tag() == RED) {
+            other->set_tag(BLACK);
+            parent->set_tag(RED);
+            lean_replace(path, i, lean_rotate(parent, right), root);
+            above = other;
+            other = lean_child(parent, !right);
         }
-        if (parent == old) {
-            replace_node_as_right_child(child, parent);
-            parent = node;
-            post_erase.set_as_left_child(false);
-        } else {
-            replace_node_as_left_child(child, parent);
-            post_erase.set_as_left_child(true);
+        Lean* near = lean_child(other, right);
+        Lean* far = lean_child(other, !right);
+        if ((!near || near->tag() == BLACK) && (!far || far->tag() == BLACK)) {
+            other->set_tag(RED);
+            if (above) {
+                parent->set_tag(BLACK);
+                return root;
+            }
+            continue;
         }
-
-        tmp = old->parent();
-        node->left = old->left;
-        node->right = old->right;
-        node->set_parent(tmp);
-        node->set_tag(old->tag());
-        replace_node(old, node, tmp, root);
-        old->left->set_parent(node);
-        if (old->right) {
-            old->right->set_parent(node);
+        if (!far || far->tag() == BLACK) {
+            near->set_tag(BLACK);
+            other->set_tag(RED);
+            lean_set_child(parent, !right, lean_rotate(other, !right));
+            far = other;
+            other = near;
         }
-    }
-    else {
-        if (node->left == nullptr) 
-            child = node->right;
+        other->set_tag(parent->tag());
+        parent->set_tag(BLACK);
+        far->set_tag(BLACK);
+        Lean* top = lean_rotate(parent, right);
+        if (above)
+            lean_set_child(above, right, top);
         else
-            child = node->left;
-        parent = node->parent();
-        post_erase.set_color(node->tag());
-        post_erase.set_as_left_child((parent != nullptr) && (parent->left == node));
-        replace_node(node, child, parent, root);
-        
-        if (child) {
-            child->set_parent(parent);
-        }
+            lean_replace(path, i, top, root);
+        return root;
     }
-    return post_erase(child, parent, root);
+    if (root)
+        root->set_tag(BLACK);
+    return root;
 }
 
-Node* rb_erase(Node* node, Node* root) {
-    struct {
-        int color;
-        void set_color(int c) { color = c; }
-        void set_as_left_child(bool) const {}
-        Node* operator()(Node* child, Node* parent, Node* root) {
-            if(color == BLACK) {
-                return rb_post_erase(child, parent, root);
+// WAVL trees, as wavl_insert_rebalance and wavl_post_erase with the path for the parents.
+// For a change on the right side of a node, high is the tag with that side 1 higher than the
+// other (WRIGHT), low the opposite one (WLEFT), and the other way round on the left side.
+
+Lean* wavl_post_insert(LeanPath& path, Lean* root) {
+    // the rank of path.node[i + 1] has increased by 1
+    for (int i = path.depth - 2; i >= 0; --i) {
+        Lean* parent = path.node[i];
+        Lean* node = path.node[i + 1];
+        bool right = path.right[i];
+        int high = right ? WRIGHT : WLEFT, low = right ? WLEFT : WRIGHT;
+        int tag = parent->tag();
+        if (tag == high) {
+            int node_tag = node->tag();
+            if (node_tag == low) {
+                Lean* tmp = lean_child(node, !right);
+                int tmp_tag = tmp->tag();
+                lean_set_child(parent, right, lean_rotate(node, right));
+                parent->set_tag((tmp_tag & high) ? low : BALANCE);
+                node->set_tag((tmp_tag & low) ? high : BALANCE);
+                tmp->set_tag(BALANCE);
             } else {
-                return root;
+                parent->set_tag((node_tag & high) ? BALANCE : high);
+                node->set_tag(node_tag == high ? BALANCE : low);
             }
+            lean_replace(path, i, lean_rotate(parent, !right), root);
+            break;
         }
-    } post_erase;
-
-    return bst_erase(node, root, post_erase);
-}
-
-Node* avl_erase(Node* node, Node* root) {
-    struct {
-        bool flag;
-        void set_color(int) const {}
-        void set_as_left_child(bool f) {
-            flag = f;
-        }
-        Node* operator()(Node* child, Node* parent, Node* root) {
-            if(parent != nullptr) {
-                return avl_post_erase(child, parent, root, flag);
-            } else {
-                return root;
-            }
+        if (tag == low) {
+            parent->set_tag(BALANCE);
+            break;
         }
-    } post_erase;
-
-    return bst_erase(node, root, post_erase);
+        parent->set_tag(high);
+        if (tag == WEAK)
+            break;
+    }
+    return root;
 }
 
-Node* wavl_erase(Node* node, Node* root) {
-    struct {
-        bool flag;
-        void set_color(int) const {}
-        void set_as_left_child(bool f) {
-            flag = f;
-        }
-        Node* operator()(Node* child, Node* parent, Node* root) {
-            if(parent != nullptr) {
-                return wavl_post_erase(child, parent, root, flag);
+Lean* wavl_erase(LeanPath& path, Lean* root) {
+    int i;
+    lean_unlink(path, root, &i);
+    // the rank of the subtree on the path.right[i] side of path.node[i] has decreased by 1
+    for (--i; i >= 0; --i) {
+        Lean* parent = path.node[i];
+        bool right = path.right[i];
+        int high = right ? WRIGHT : WLEFT, low = right ? WLEFT : WRIGHT;
+        int tag = parent->tag();
+        if (tag == low) {
+            Lean* sibling = lean_child(parent, !right);
+            int sibling_tag = sibling->tag();
+            if (sibling_tag == WEAK) {
+                sibling->set_tag(BALANCE);
+                continue;
+            }
+            if (sibling_tag == high) {
+                Lean* tmp = lean_child(sibling, right);
+                int tmp_tag = tmp->tag();
+                lean_set_child(parent, !right, lean_rotate(sibling, !right));
+                parent->set_tag((tmp_tag & low) ? high : BALANCE);
+                sibling->set_tag((tmp_tag & high) ? low : BALANCE);
+                tmp->set_tag(WEAK);
             } else {
-                return root;
+                parent->set_tag(sibling_tag == low ? BALANCE : low);
+                sibling->set_tag(sibling_tag == low ? WEAK : high);
             }
+            lean_replace(path, i, lean_rotate(parent, right), root);
+            return root;
         }
-    } post_erase;
-
-    return bst_erase(node, root, post_erase);
-}
-
-Node* bst_first(Node* root) {
-    auto p = root;
-    if (p == nullptr)
-        return nullptr; // empty
-    while (p->left)
-        p = p->left;
-    return p;
-}
-
-Node* bst_last(Node* root) {
-    auto p = root;
-    if (p == nullptr)
-        return nullptr; // empty
-    while (p->right)
-        p = p->right;
-    return p;
-}
-
-Node* bst_next(Node* node) {
-    if (node->right) {
-        node = node->right; 
-        while (node->left)
-            node = node->left;
-        return node;
+        if (tag == high) {
+            parent->set_tag(BALANCE);
+            continue;
+        }
+        parent->set_tag(low);
+        if (tag == BALANCE)
+            return root;
     }
-    
-    while (node->parent() && node == node->parent()->right)
-        node = node->parent();
-    return node->parent();
+    return root;
 }
 
-Node* bst_prev(Node* node) {
-    if (node->left) {
-        node = node->left; 
-        while (node->right)
-            node = node->right;
-        return node;
-    }
-
-    while (node->parent() && node == node->parent()->left)
-        node = node->parent();
-
-    return node->parent();
 }
-
 }
-}
\ No newline at end of file
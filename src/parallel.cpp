@@ -0,0 +1,191 @@
+#include<atomic>
+#include<condition_variable>
+#include<deque>
+#include<memory>
+#include<mutex>
+#include<thread>
+#include<vector>
+#include"bstree.h"
+
+/* A small work-stealing pool for the fork-join algorithms. Every worker owns a
+ * deque, forked tasks are pushed to the back of the owner's deque and popped
+ * from the back by the owner, idle threads steal from the front of the others.
+ * Threads outside the pool share the deque with index 0.
+ */
+
+namespace bst {
+namespace impl {
+
+namespace {
+
+struct Task {
+    void (*fn)(void*);
+    void* arg;
+    std::atomic<bool> done;
+    Task(void (*f)(void*), void* a) : fn(f), arg(a), done(false) {}
+    void run() {
+        fn(arg);
+        done.store(true, std::memory_order_release);
+    }
+};
+
+class TaskQueue {
+    std::mutex m;
+    std::deque<Task*> q;
+public:
+    void push(Task* t) {
+        std::lock_guard<std::mutex> lock(m);
+        q.push_back(t);
+    }
+    Task* pop() {
+        std::lock_guard<std::mutex> lock(m);
+        if (q.empty())
+            return nullptr;
+        auto t = q.back();
+        q.pop_back();
+        return t;
+    }
+    bool pop(Task* t) {
+        std::lock_guard<std::mutex> lock(m);
+        if (q.empty() || q.back() != t)
+            return false;
+        q.pop_back();
+        return true;
+    }
+    Task* steal() {
+        std::lock_guard<std::mutex> lock(m);
+        if (q.empty())
+            return nullptr;
+        auto t = q.front();
+        q.pop_front();
+        return t;
+    }
+};
+
+thread_local unsigned worker_id = 0;
+
+class Pool {
+    std::vector<TaskQueue> queues;
+    std::vector<std::thread> threads;
+    std::atomic<int> queued;
+    std::mutex idle_mutex;
+    std::condition_variable idle;
+    bool stopping;
+
+    Task* find(unsigned self) {
+        if (queued.load(std::memory_order_acquire) == 0)
+            return nullptr;
+        auto t = queues[self].pop();
+        for (std::size_t i = 1; t == nullptr && i < queues.size(); ++i) {
+            t = queues[(self + i) % queues.size()].steal();
+        }
+        if (t)
+            queued.fetch_sub(1, std::memory_order_relaxed);
+        return t;
+    }
+
+    void work(unsigned self) {
+        worker_id = self;
+        for (;;) {
+            if (auto t = find(self)) {
+                t->run();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(idle_mutex);
+            idle.wait(lock, [this]() { return stopping || queued.load(std::memory_order_acquire) > 0; });
+            if (stopping)
+                return;
+        }
+    }
+
+public:
+    explicit Pool(unsigned n) : queues(n), queued(0), stopping(false) {
+        for (unsigned i = 1; i < n; ++i)
+            threads.emplace_back(&Pool::work, this, i);
+    }
+    ~Pool() {
+        {
+            std::lock_guard<std::mutex> lock(idle_mutex);
+            stopping = true;
+        }
+        idle.notify_all();
+        for (auto& t : threads)
+            t.join();
+    }
+    unsigned size() const {
+        return static_cast<unsigned>(queues.size());
+    }
+
+    void fork_join(void (*f)(void*), void* a, void (*g)(void*), void* b) {
+        unsigned self = worker_id;
+        Task task(g, b);
+        queues[self].push(&task);
+        queued.fetch_add(1, std::memory_order_release);
+        {
+            std::lock_guard<std::mutex> lock(idle_mutex);
+        }
+        idle.notify_one();
+
+        f(a);
+
+        if (queues[self].pop(&task)) {
+            queued.fetch_sub(1, std::memory_order_relaxed);
+            g(b);
+            return;
+        }
+        // stolen, help the others until it is done
+        while (!task.done.load(std::memory_order_acquire)) {
+            if (auto t = find(self))
+                t->run();
+            else
+                std::this_thread::yield();
+        }
+    }
+};
+
+std::mutex pool_mutex;
+std::unique_ptr<Pool> pool;
+std::atomic<Pool*> current_pool(nullptr);
+
+Pool* get_pool() {
+    auto p = current_pool.load(std::memory_order_acquire);
+    if (p)
+        return p;
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    if (!pool) {
+        unsigned n = std::thread::hardware_concurrency();
+        pool.reset(new Pool(n > 0 ? n : 1));
+        current_pool.store(pool.get(), std::memory_order_release);
+    }
+    return pool.get();
+}
+
+}
+
+void fork_join(void (*f)(void*), void* a, void (*g)(void*), void* b) {
+    auto p = get_pool();
+    if (p->size() <= 1) {
+        f(a);
+        g(b);
+    } else {
+        p->fork_join(f, a, g, b);
+    }
+}
+
+}
+
+unsigned set_parallelism(unsigned threads) {
+    if (threads == 0) {
+        threads = std::thread::hardware_concurrency();
+        if (threads == 0)
+            threads = 1;
+    }
+    std::lock_guard<std::mutex> lock(impl::pool_mutex);
+    impl::current_pool.store(nullptr, std::memory_order_release);
+    impl::pool.reset();
+    impl::pool.reset(new impl::Pool(threads));
+    impl::current_pool.store(impl::pool.get(), std::memory_order_release);
+    return threads;
+}
+
+}
@@ -0,0 +1,110 @@
+#include<random>
+#include<algorithm>
+#include<vector>
+#include<iostream>
+#include"bstree.h"
+
+// every node keeps the total weight and the latest end time of its subtree
+struct Task : public bst::counted_node_hook {
+    int start, end, weight;
+    long total_weight;
+    int max_end;
+};
+
+struct GetStart {
+    int operator()(const Task& t) const { return t.start; }
+};
+
+struct Aggregate {
+    static void update(Task& t) {
+        t.total_weight = t.weight;
+        t.max_end = t.end;
+        for(auto child : {t.left, t.right}) {
+            if(child != nullptr) {
+                auto& c = static_cast<Task&>(*child);
+                t.total_weight += c.total_weight;
+                t.max_end = std::max(t.max_end, c.max_end);
+            }
+        }
+    }
+};
+
+// the total weight of the tasks starting before value
+template<typename Tree>
+long weight_before(const Tree& tree, int value) {
+    long w = 0;
+    for(auto p = tree.root(); p != nullptr; ) {
+        if(p->start < value) {
+            w += p->weight;
+            if(p->left) {
+                w += static_cast<Task*>(p->left)->total_weight;
+            }
+            p = static_cast<Task*>(p->right);
+        } else {
+            p = static_cast<Task*>(p->left);
+        }
+    }
+    return w;
+}
+
+// compare the aggregates at the root with a walk of the tree, return the number of mismatches
+template<typename Tree>
+int check(Tree& tree, const char* name) {
+    std::size_t size = 0;
+    long total = 0, before = 0;
+    int max_end = 0;
+    for(auto& t : bst::range(tree)) {
+        ++size;
+        total += t.weight;
+        before += (t.start < 5000) ? t.weight : 0;
+        max_end = std::max(max_end, t.end);
+    }
+    auto root = tree.root();
+    long root_total = root ? root->total_weight : 0;
+    int root_max_end = root ? root->max_end : 0;
+    std::cout << name << ": size " << tree.size() << ", total weight " << root_total << ", latest end "
+              << root_max_end << ", weight before 5000 " << weight_before(tree, 5000);
+    int wrong = (tree.size() != size) + (root_total != total) + (root_max_end != max_end) + (weight_before(tree, 5000) != before);
+    std::cout << (wrong != 0 ? " Wrong" : "") << std::endl;
+    return wrong;
+}
+
+int main() {
+    using Tree = bst::wavl<Task, int, GetStart, std::less<int>, Aggregate>;
+    std::mt19937 gen(1);
+    std::vector<Task> tasks(1000);
+    Tree tree;
+    for(auto& t : tasks) {
+        t.start = gen() % 10000;
+        t.end = t.start + gen() % 100;
+        t.weight = gen() % 10;
+        tree.insert(&t);
+    }
+    for(std::size_t i = 0; i < tasks.size(); i += 3) {
+        tree.erase(&tasks[i]);
+    }
+    // change a weight in place
+    tasks[1].weight += 100;
+    tree.update_path(&tasks[1]);
+
+    int wrong = check(tree, "tree");
+    if(tree.size() != tasks.size() - (tasks.size() + 2) / 3) {
+        std::cout << "size Wrong" << std::endl;
+        ++wrong;
+    }
+
+    auto parts = tree.split(5000);
+    wrong += check(parts.first, "before 5000");
+    wrong += check(parts.second, "from 5000");
+    for(auto& t : bst::range(parts.first)) {
+        wrong += (t.start >= 5000);
+    }
+    for(auto& t : bst::range(parts.second)) {
+        wrong += (t.start < 5000);
+    }
+    if(wrong != 0) {
+        std::cout << "Wrong" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,231 @@
+#include<algorithm>
+#include<random>
+#include<vector>
+#include<iostream>
+#include"bstree_inline.h"
+
+using bst::impl::NodeBase;
+
+struct IntNode : public bst::node_hook {
+    int val;
+};
+
+struct GetValue {
+    int operator()(const IntNode& n) const { return n.val; }
+};
+
+// The height of a subtree in the measure of each scheme, as RBJoin, AVLJoin and WAVLJoin
+// take it; every broken rule of the scheme counts in wrong.
+struct RBRules {
+    static const char* name() { return "RB-Tree"; }
+    static int height(const NodeBase* p, std::size_t& wrong) {
+        if(p == nullptr) {
+            return 0;
+        }
+        bool red = p->tag() == bst::impl::RED;
+        wrong += !red && p->tag() != bst::impl::BLACK;
+        for(auto child : {p->left, p->right}) {
+            wrong += red && child != nullptr && child->tag() == bst::impl::RED;
+        }
+        int l = height(p->left, wrong), r = height(p->right, wrong);
+        wrong += l != r;
+        return l + !red;
+    }
+    static bool root_ok(const NodeBase* root) {
+        return root == nullptr || root->tag() == bst::impl::BLACK;
+    }
+};
+
+struct AVLRules {
+    static const char* name() { return "AVL    "; }
+    static int height(const NodeBase* p, std::size_t& wrong) {
+        if(p == nullptr) {
+            return 0;
+        }
+        int l = height(p->left, wrong), r = height(p->right, wrong);
+        int tag = p->tag();
+        wrong += !((tag == bst::impl::BALANCE && l == r) || (tag == bst::impl::LEFT && l == r + 1) || (tag == bst::impl::RIGHT && r == l + 1));
+        return std::max(l, r) + 1;
+    }
+    static bool root_ok(const NodeBase*) {
+        return true;
+    }
+};
+
+// WLEFT marks a right child of rank difference 2, WRIGHT a left one
+struct WAVLRules {
+    static const char* name() { return "WAVL   "; }
+    static int height(const NodeBase* p, std::size_t& wrong) {
+        if(p == nullptr) {
+            return -1;
+        }
+        int l = height(p->left, wrong), r = height(p->right, wrong);
+        int tag = p->tag();
+        int rank = l + ((tag & bst::impl::WRIGHT) ? 2 : 1);
+        wrong += rank != r + ((tag & bst::impl::WLEFT) ? 2 : 1);
+        wrong += p->left == nullptr && p->right == nullptr && rank != 0;
+        return rank;
+    }
+    static bool root_ok(const NodeBase*) {
+        return true;
+    }
+};
+
+std::size_t failures = 0;
+
+// the links to the parents, the order, the keys against expect (sorted) and the rules
+template<typename Rules, typename BST>
+void check(BST& tree, const std::vector<int>& expect, const char* stage) {
+    std::size_t wrong = 0;
+    auto root = tree.root();
+    wrong += root != nullptr && root->parent() != nullptr;
+    std::vector<int> keys;
+    for(auto& n : bst::range(tree)) {
+        keys.push_back(n.val);
+        for(auto child : {n.left, n.right}) {
+            wrong += child != nullptr && child->parent() != &n;
+        }
+    }
+    wrong += keys != expect;
+    Rules::height(root, wrong);
+    wrong += !Rules::root_ok(root);
+    if(wrong != 0) {
+        std::cout << Rules::name() << " Wrong after " << stage << std::endl;
+        ++failures;
+    }
+}
+
+template<typename Rules, typename BST>
+void check(BST& tree, std::vector<int> expect, int lo, int hi, const char* stage) {
+    expect.erase(std::remove_if(expect.begin(), expect.end(), [&](int k) { return k < lo || k >= hi; }), expect.end());
+    check<Rules>(tree, expect, stage);
+}
+
+// Split trees of random keys with repeats at random values and join them back, join trees of
+// independent shapes and sizes around a pivot, and run the set operations, which split and
+// join with and without a pivot.
+template<typename BST, typename Rules>
+void test_split_join(std::mt19937& gen) {
+    for(int round = 0; round < 300; ++round) {
+        int n = round * 2, range = (round % 2) ? n + 1 : n / 4 + 1;
+        std::vector<IntNode> nodes(n);
+        std::vector<int> all;
+        BST a;
+        for(auto& node : nodes) {
+            node.val = gen() % range;
+            all.push_back(node.val);
+            a.insert(&node);
+        }
+        std::sort(all.begin(), all.end());
+        check<Rules>(a, all, "insert");
+
+        int value = int(gen() % (range + 2)) - 1;
+        auto parts = a.split(value);
+        check<Rules>(parts.first, all, -1, value, "split (front)");
+        check<Rules>(parts.second, all, value, range + 1, "split (back)");
+        if(parts.second.root() != nullptr) {
+            auto pivot = parts.second.first();
+            parts.second.erase(pivot);
+            a.join(parts.first, pivot, parts.second);
+            check<Rules>(a, all, "join");
+        }
+
+        // keys [0, k) and (k, k + m] built by insert, the pivot k
+        int k = gen() % (n + 1), m = gen() % (n + 1);
+        std::vector<IntNode> left(k), right(m);
+        IntNode pivot;
+        pivot.val = k;
+        BST l, r, joined;
+        std::vector<int> expect;
+        for(int i = 0; i < k + m + 1; ++i) {
+            expect.push_back(i);
+        }
+        std::vector<int> order(expect);
+        std::shuffle(order.begin(), order.end(), gen);
+        for(int key : order) {
+            if(key < k) {
+                left[key].val = key;
+                l.insert(&left[key]);
+            } else if(key > k) {
+                right[key - k - 1].val = key;
+                r.insert(&right[key - k - 1]);
+            }
+        }
+        joined.join(l, &pivot, r);
+        check<Rules>(joined, expect, "join of independent trees");
+
+        // unique keys for the set operations: the even ones below 2n and random ones
+        std::vector<IntNode> na(n), nb(n);
+        BST sa, sb;
+        std::vector<int> ka, kb;
+        for(int i = 0; i < n; ++i) {
+            na[i].val = 2 * i;
+            if(sa.insert_unique(&na[i])) {
+                ka.push_back(na[i].val);
+            }
+            nb[i].val = gen() % (2 * n + 1);
+            if(sb.insert_unique(&nb[i])) {
+                kb.push_back(nb[i].val);
+            }
+        }
+        std::sort(kb.begin(), kb.end());
+        std::vector<int> expect_op;
+        if(round % 2) {
+            std::set_difference(ka.begin(), ka.end(), kb.begin(), kb.end(), std::back_inserter(expect_op));
+            bst::set_difference(sa, sb);
+            check<Rules>(sa, expect_op, "set_difference");
+        } else {
+            std::set_intersection(ka.begin(), ka.end(), kb.begin(), kb.end(), std::back_inserter(expect_op));
+            bst::set_intersection(sa, sb);
+            check<Rules>(sa, expect_op, "set_intersection");
+        }
+    }
+}
+
+// build_sorted of every size up to a few hundred, so that each shape of the partial bottom
+// level is built, from nodes and from pointers
+template<typename BST, typename Rules>
+void test_build() {
+    for(int n = 0; n <= 400; ++n) {
+        std::vector<IntNode> nodes(n);
+        std::vector<IntNode*> ptrs;
+        std::vector<int> expect;
+        for(int i = 0; i < n; ++i) {
+            nodes[i].val = i / 3;
+            ptrs.push_back(&nodes[i]);
+            expect.push_back(i / 3);
+        }
+        BST a;
+        a.build_sorted(nodes.begin(), nodes.end());
+        check<Rules>(a, expect, "build_sorted");
+        BST b;
+        b.build_sorted(ptrs.begin(), ptrs.end());
+        check<Rules>(b, expect, "build_sorted of pointers");
+        // the built tree takes inserts and erases as any other
+        IntNode extra;
+        extra.val = n / 2;
+        b.insert(&extra);
+        expect.insert(std::upper_bound(expect.begin(), expect.end(), extra.val), extra.val);
+        check<Rules>(b, expect, "insert after build_sorted");
+        if(n > 0) {
+            b.erase(&nodes[0]);
+            expect.erase(expect.begin());
+            check<Rules>(b, expect, "erase after build_sorted");
+        }
+    }
+}
+
+int main() {
+    std::mt19937 gen(1);
+    std::cout << "Testing the balance rules after build_sorted, split, join and the set operations" << std::endl;
+    test_build<bst::rbtree<IntNode, int, GetValue>, RBRules>();
+    test_build<bst::avl<IntNode, int, GetValue>, AVLRules>();
+    test_build<bst::wavl<IntNode, int, GetValue>, WAVLRules>();
+    test_split_join<bst::rbtree<IntNode, int, GetValue>, RBRules>(gen);
+    test_split_join<bst::avl<IntNode, int, GetValue>, AVLRules>(gen);
+    test_split_join<bst::wavl<IntNode, int, GetValue>, WAVLRules>(gen);
+    if(failures == 0) {
+        std::cout << "    passed" << std::endl;
+    }
+    return failures != 0;
+}
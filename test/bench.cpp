@@ -1,3 +1,4 @@
+#include<cmath>
 #include<random>
 #include<vector>
 #include<algorithm>
@@ -57,7 +58,206 @@ void test_bst(int size, int n_mod, int n_sch, Nodes& nodes, const Indices& searc
     std::cout << "    " << name << ":\t" << t11 << " ms, " << t12 << " ms, " << t13 << " ms" << std::endl;
 }
 
-void test_raw(int size, int n_mod, int n_sch, std::uint64_t seed) {
+template<typename BST, typename Nodes>
+void test_build(int size, Nodes& nodes, const char* name) {
+    double t21, t22;
+    timeval start, stop;
+
+    BST a, b;
+
+    gettimeofday(&start, nullptr);
+    for(int i = 0; i < size; ++i) {
+        a.insert(&nodes[i]);
+    }
+    gettimeofday(&stop, nullptr);
+    t21 = TIME_DIFF(start, stop);
+
+    gettimeofday(&start, nullptr);
+    b.build_sorted(nodes.begin(), nodes.begin() + size);
+    gettimeofday(&stop, nullptr);
+    t22 = TIME_DIFF(start, stop);
+
+    if(b.first() != &nodes[0] || b.last() != &nodes[size - 1]) {
+        std::cout << name << " Wrong" << std::endl;
+    }
+    std::cout << "    " << name << ":\t" << t21 << " ms, " << t22 << " ms" << std::endl;
+}
+
+// insert the nodes in the given order, by insert and by insert with the previous node as the hint
+template<typename BST, typename Nodes>
+void test_hint(const std::vector<int>& order, Nodes& nodes, const char* name) {
+    double t31, t32;
+    timeval start, stop;
+
+    BST a, b;
+
+    gettimeofday(&start, nullptr);
+    for(auto i : order) {
+        a.insert(&nodes[i]);
+    }
+    gettimeofday(&stop, nullptr);
+    t31 = TIME_DIFF(start, stop);
+
+    gettimeofday(&start, nullptr);
+    IntNode* hint = nullptr;
+    for(auto i : order) {
+        b.insert(hint, &nodes[i]);
+        hint = &nodes[i];
+    }
+    gettimeofday(&stop, nullptr);
+    t32 = TIME_DIFF(start, stop);
+
+    if(b.first() != &nodes[0] || b.last() != &nodes[order.size() - 1]) {
+        std::cout << name << " Wrong" << std::endl;
+    }
+    std::cout << "    " << name << ":\t" << t31 << " ms, " << t32 << " ms" << std::endl;
+}
+
+// std::less that counts its calls
+struct CountingLess {
+    static std::size_t calls;
+    bool operator()(int a, int b) const {
+        ++calls;
+        return a < b;
+    }
+};
+
+std::size_t CountingLess::calls = 0;
+
+// insert a batch of nodes into a tree of the even nodes, by insert and by insert_batch, and
+// count the comparisons per node of the batch
+template<typename BST, typename Nodes>
+void test_batch(int size, const std::vector<int>& batch, Nodes& nodes, const char* name) {
+    double t41, t42;
+    timeval start, stop;
+    std::vector<IntNode*> even, ptrs;
+    for(int i = 0; i < size; i += 2) {
+        even.push_back(&nodes[i]);
+    }
+    for(auto i : batch) {
+        ptrs.push_back(&nodes[i]);
+    }
+
+    // the same nodes are relinked into b after the loop
+    BST a, b;
+    a.build_sorted(even.begin(), even.end());
+    std::size_t calls = CountingLess::calls;
+    gettimeofday(&start, nullptr);
+    for(auto p : ptrs) {
+        a.insert(p);
+    }
+    gettimeofday(&stop, nullptr);
+    t41 = TIME_DIFF(start, stop);
+    double c41 = double(CountingLess::calls - calls) / ptrs.size();
+
+    b.build_sorted(even.begin(), even.end());
+    calls = CountingLess::calls;
+    gettimeofday(&start, nullptr);
+    b.insert_batch(ptrs.data(), ptrs.size());
+    gettimeofday(&stop, nullptr);
+    t42 = TIME_DIFF(start, stop);
+    double c42 = double(CountingLess::calls - calls) / ptrs.size();
+
+    std::size_t n = 0;
+    int prev = -1;
+    bool sorted = true;
+    for(auto& node : bst::range(b)) {
+        sorted = sorted && prev < node.val;
+        prev = node.val;
+        ++n;
+    }
+    if(!sorted || n != even.size() + batch.size()) {
+        std::cout << name << " Wrong" << std::endl;
+    }
+    std::cout << "    " << name << ":\t" << t41 << " ms, " << t42 << " ms\t(" << c41 << ", " << c42
+              << " comparisons per node)" << std::endl;
+}
+
+// lookups per microsecond of search, search_many, lower_bound and lower_bound_many
+template<typename BST, typename Nodes, typename Indices>
+void test_search_many(int size, Nodes& nodes, const Indices& search_idx, const char* name) {
+    double t51, t52, t53, t54;
+    timeval start, stop;
+    std::size_t n = search_idx.size(), wrong = 0;
+    std::vector<int> keys;
+    std::vector<IntNode*> out(n);
+    for(auto& i : search_idx) {
+        keys.push_back(nodes[i].val);
+    }
+
+    BST a;
+    for(int i = 0; i < size; ++i) {
+        a.insert(&nodes[i]);
+    }
+
+    gettimeofday(&start, nullptr);
+    for(std::size_t i = 0; i < n; ++i) {
+        out[i] = a.search(keys[i]);
+    }
+    gettimeofday(&stop, nullptr);
+    t51 = TIME_DIFF(start, stop);
+
+    gettimeofday(&start, nullptr);
+    a.search_many(keys.data(), n, out.data());
+    gettimeofday(&stop, nullptr);
+    t52 = TIME_DIFF(start, stop);
+    for(std::size_t i = 0; i < n; ++i) {
+        wrong += (out[i] == nullptr || out[i]->val != keys[i]);
+    }
+
+    gettimeofday(&start, nullptr);
+    for(std::size_t i = 0; i < n; ++i) {
+        out[i] = a.lower_bound(keys[i]);
+    }
+    gettimeofday(&stop, nullptr);
+    t53 = TIME_DIFF(start, stop);
+
+    gettimeofday(&start, nullptr);
+    a.lower_bound_many(keys.data(), n, out.data());
+    gettimeofday(&stop, nullptr);
+    t54 = TIME_DIFF(start, stop);
+    for(std::size_t i = 0; i < n; ++i) {
+        wrong += (out[i] == nullptr || out[i]->val != keys[i]);
+    }
+
+    if(wrong != 0) {
+        std::cout << name << " Wrong" << std::endl;
+    }
+    std::cout << "    " << name << ":\t" << 1e-3 * n / t51 << ", " << 1e-3 * n / t52 << ", "
+              << 1e-3 * n / t53 << ", " << 1e-3 * n / t54 << std::endl;
+}
+
+// searches with Zipf-distributed keys, set configures the tree before the inserts
+template<typename BST, typename Nodes, typename Indices, typename Setup>
+void test_skewed(int size, Nodes& nodes, const Indices& skewed_idx, Setup set, const char* name) {
+    double t61;
+    timeval start, stop;
+
+    BST a;
+    set(a);
+    for(int i = 0; i < size; ++i) {
+        a.insert(&nodes[i]);
+    }
+
+    gettimeofday(&start, nullptr);
+    for(auto& i : skewed_idx) {
+        auto val = nodes[i].val;
+        auto p = a.search(val);
+        if(p->val != val) {
+            std::cout << name << " Wrong" << std::endl;
+        }
+    }
+    gettimeofday(&stop, nullptr);
+    t61 = TIME_DIFF(start, stop);
+    std::cout << "    " << name << ":\t" << t61 << " ms" << std::endl;
+}
+
+struct no_setup {
+    template<typename BST>
+    void operator()(BST&) const {}
+};
+
+void test_raw(int size, int n_mod, int n_sch, std::uint64_t seed, double zipf) {
     std::vector<IntNode> nodes (size);
 
     std::mt19937_64 g(seed);
@@ -81,6 +281,48 @@ void test_raw(int size, int n_mod, int n_sch, std::uint64_t seed) {
     std::cout << "Testing with intrusive tree: maximum size = " << size << ", #insert = " << n_mod << \
         ", #search = " << n_sch << ", #erase = " << erase_idx.size() << ", random seed = " << seed << std::endl;
 
+    std::cout << "Bulk construction (insert, build_sorted):" << std::endl;
+    test_build<bst::rbtree<IntNode, int, GetValue>>(size, nodes, "RB-Tree");
+    test_build<bst::avl<IntNode, int, GetValue>>(size, nodes, "AVL    ");
+    test_build<bst::wavl<IntNode, int, GetValue>>(size, nodes, "WAVL   ");
+
+    // near-ascending: about 1 in 8 keys is swapped with one of the next 4
+    std::vector<int> ascending(size), near(size);
+    for(int i = 0; i < size; ++i) {
+        ascending[i] = near[i] = i;
+    }
+    for(int i = 0; i + 4 < size; ++i) {
+        if(g() % 8 == 0) {
+            std::swap(near[i], near[i + 1 + g() % 4]);
+        }
+    }
+    std::cout << "Ascending stream (insert, hinted insert):" << std::endl;
+    test_hint<bst::rbtree<IntNode, int, GetValue>>(ascending, nodes, "RB-Tree");
+    test_hint<bst::avl<IntNode, int, GetValue>>(ascending, nodes, "AVL    ");
+    test_hint<bst::wavl<IntNode, int, GetValue>>(ascending, nodes, "WAVL   ");
+
+    std::cout << "Near-ascending stream (insert, hinted insert):" << std::endl;
+    test_hint<bst::rbtree<IntNode, int, GetValue>>(near, nodes, "RB-Tree");
+    test_hint<bst::avl<IntNode, int, GetValue>>(near, nodes, "AVL    ");
+    test_hint<bst::wavl<IntNode, int, GetValue>>(near, nodes, "WAVL   ");
+
+    // random odd nodes, a small batch and all of them
+    std::vector<int> odd;
+    for(int i = 1; i < size; i += 2) {
+        odd.push_back(i);
+    }
+    std::shuffle(odd.begin(), odd.end(), g);
+    std::vector<int> small_batch(odd.begin(), odd.begin() + std::min<std::size_t>(n_mod, odd.size()));
+    std::cout << "Batch insert of " << small_batch.size() << " nodes (insert, insert_batch):" << std::endl;
+    test_batch<bst::rbtree<IntNode, int, GetValue, CountingLess>>(size, small_batch, nodes, "RB-Tree");
+    test_batch<bst::avl<IntNode, int, GetValue, CountingLess>>(size, small_batch, nodes, "AVL    ");
+    test_batch<bst::wavl<IntNode, int, GetValue, CountingLess>>(size, small_batch, nodes, "WAVL   ");
+
+    std::cout << "Batch insert of " << odd.size() << " nodes (insert, insert_batch):" << std::endl;
+    test_batch<bst::rbtree<IntNode, int, GetValue, CountingLess>>(size, odd, nodes, "RB-Tree");
+    test_batch<bst::avl<IntNode, int, GetValue, CountingLess>>(size, odd, nodes, "AVL    ");
+    test_batch<bst::wavl<IntNode, int, GetValue, CountingLess>>(size, odd, nodes, "WAVL   ");
+
     std::cout << "Worst test (Insert an ordered sequence):" << std::endl;
     test_bst<bst::rbtree<IntNode, int, GetValue>>(size, n_mod, n_sch, nodes, search_idx, erase_idx, "RB-Tree");
     test_bst<bst::avl<IntNode, int, GetValue>>(size, n_mod, n_sch, nodes, search_idx, erase_idx, "AVL    ");
@@ -92,6 +334,38 @@ void test_raw(int size, int n_mod, int n_sch, std::uint64_t seed) {
     test_bst<bst::rbtree<IntNode, int, GetValue>>(size, n_mod, n_sch, nodes, search_idx, erase_idx, "RB-Tree");
     test_bst<bst::avl<IntNode, int, GetValue>>(size, n_mod, n_sch, nodes, search_idx, erase_idx, "AVL    ");
     test_bst<bst::wavl<IntNode, int, GetValue>>(size, n_mod, n_sch, nodes, search_idx, erase_idx, "WAVL   ");
+
+    // run with a size well above the last-level cache, e.g. 10000000, to see the latency hidden
+    std::cout << "Grouped lookups, M/s (search, search_many, lower_bound, lower_bound_many):" << std::endl;
+    test_search_many<bst::rbtree<IntNode, int, GetValue>>(size, nodes, search_idx, "RB-Tree");
+    test_search_many<bst::avl<IntNode, int, GetValue>>(size, nodes, search_idx, "AVL    ");
+    test_search_many<bst::wavl<IntNode, int, GetValue>>(size, nodes, search_idx, "WAVL   ");
+
+    // the nodes are inserted in the order of the vector, the k-th most frequent is a random
+    // one of them, not the k-th inserted, and is searched with probability ~ 1/k^zipf
+    std::vector<int> by_rank(size);
+    for(int k = 0; k < size; ++k) {
+        by_rank[k] = k;
+    }
+    std::shuffle(by_rank.begin(), by_rank.end(), g);
+    std::vector<double> cdf(size);
+    double sum = 0;
+    for(int k = 0; k < size; ++k) {
+        cdf[k] = sum += std::pow(k + 1, -zipf);
+    }
+    std::uniform_real_distribution<double> ru (0, sum);
+    std::vector<int> skewed_idx (n_sch);
+    for(auto& i : skewed_idx) {
+        i = by_rank[std::min<int>(size - 1, std::upper_bound(cdf.begin(), cdf.end(), ru(g)) - cdf.begin())];
+    }
+    using Splay = bst::splay<IntNode, int, GetValue>;
+    std::cout << "Skewed test (Zipf searches, s = " << zipf << "):" << std::endl;
+    test_skewed<bst::rbtree<IntNode, int, GetValue>>(size, nodes, skewed_idx, no_setup(), "RB-Tree");
+    test_skewed<bst::avl<IntNode, int, GetValue>>(size, nodes, skewed_idx, no_setup(), "AVL    ");
+    test_skewed<bst::wavl<IntNode, int, GetValue>>(size, nodes, skewed_idx, no_setup(), "WAVL   ");
+    test_skewed<Splay>(size, nodes, skewed_idx, no_setup(), "Splay  ");
+    test_skewed<Splay>(size, nodes, skewed_idx, [](Splay& a) { a.set_semi_splay(true); }, "Semi   ");
+    test_skewed<Splay>(size, nodes, skewed_idx, [](Splay& a) { a.set_splay_period(16); }, "Splay16");
 }
 
 int main(int argc, char **argv) {
@@ -99,6 +373,7 @@ int main(int argc, char **argv) {
     int n_mod = 5000;
     int n_sch = 10000;
     int seed = 123241233;
+    double zipf = 1.2;
 
     if(argc > 1) {
         int t = n_mod, s = atoi(argv[1]);
@@ -121,7 +396,14 @@ int main(int argc, char **argv) {
         seed = atoi(argv[4]);
     }
 
-    test_raw(size, n_mod, n_sch, seed);
+    if(argc > 5) {
+        double z = atof(argv[5]);
+        if(z > 0) {
+            zipf = z;
+        }
+    }
+
+    test_raw(size, n_mod, n_sch, seed, zipf);
 
     return 0;
 }
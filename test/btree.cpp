@@ -0,0 +1,161 @@
+#include<algorithm>
+#include<cstdint>
+#include<limits>
+#include<random>
+#include<vector>
+#include<iostream>
+#include<sys/time.h>
+#include"bstree.h"
+
+#define TIME_DIFF(start, stop) 1e3 * (stop.tv_sec - start.tv_sec) + 1e-3 * (stop.tv_usec - start.tv_usec)
+
+struct IntNode : public bst::node_hook {
+    int val;
+};
+
+struct GetValue {
+    int operator()(const IntNode& n) const { return n.val; }
+};
+
+using Tree = bst::wavl<IntNode, int, GetValue>;
+
+template<typename K>
+struct KeyNode : public bst::node_hook {
+    K val;
+};
+
+template<typename K>
+struct GetKey {
+    K operator()(const KeyNode<K>& n) const { return n.val; }
+};
+
+// lower_bound, search and lower_bound_many of a frozen B-tree of K keys against the tree,
+// with the extremes of K among the keys and the probes
+template<typename K>
+bool check_keys(std::mt19937& g) {
+    using KeyTree = bst::wavl<KeyNode<K>, K, GetKey<K>>;
+    std::vector<KeyNode<K>> nodes(1000);
+    std::vector<K> probes = {std::numeric_limits<K>::min(), std::numeric_limits<K>::max(), K(0), K(1), K(-1)};
+    for(std::size_t i = 0; i < nodes.size(); ++i) {
+        nodes[i].val = i < probes.size() ? probes[i] : K(std::uint64_t(g()) << 32 | g());
+        probes.push_back(K(nodes[i].val + K(i % 3)));
+    }
+    KeyTree tree;
+    std::size_t inserted = 0;
+    for(auto& n : nodes) {
+        inserted += tree.insert_unique(&n);
+    }
+    auto btree = bst::freeze_btree(tree);
+    std::vector<KeyNode<K>*> many(probes.size());
+    btree.lower_bound_many(probes.data(), probes.size(), many.data());
+    for(std::size_t i = 0; i < probes.size(); ++i) {
+        auto expect = tree.lower_bound(probes[i]);
+        if(btree.lower_bound(probes[i]) != expect || many[i] != expect || btree.search(probes[i]) != tree.search(probes[i])) {
+            return false;
+        }
+    }
+    return btree.size() == inserted;
+}
+
+// nanoseconds per lookup of the keys
+template<typename Index>
+double run(const Index& index, const std::vector<int>& lookups, std::size_t& found) {
+    timeval start, stop;
+    found = 0;
+    gettimeofday(&start, nullptr);
+    for(int key : lookups) {
+        found += index.search(key) != nullptr;
+    }
+    gettimeofday(&stop, nullptr);
+    return 1e6 * (TIME_DIFF(start, stop)) / lookups.size();
+}
+
+double run_many(const bst::frozen_btree<Tree>& index, const std::vector<int>& lookups, std::size_t& found) {
+    std::vector<IntNode*> out(lookups.size());
+    timeval start, stop;
+    gettimeofday(&start, nullptr);
+    index.search_many(lookups.data(), lookups.size(), out.data());
+    gettimeofday(&stop, nullptr);
+    found = lookups.size() - std::count(out.begin(), out.end(), nullptr);
+    return 1e6 * (TIME_DIFF(start, stop)) / lookups.size();
+}
+
+int main(int argc, char **argv) {
+    int max_size = 1 << 24;
+    int count = 2000000;
+
+    if(argc > 1) {
+        int s = atoi(argv[1]);
+        if(s > 0) {
+            max_size = s;
+        }
+    }
+    if(argc > 2) {
+        int c = atoi(argv[2]);
+        if(c > 0) {
+            count = c;
+        }
+    }
+
+#if defined(__AVX2__)
+    const char* simd = "AVX2";
+#elif defined(__SSE4_2__)
+    const char* simd = "SSE4.2";
+#elif defined(__SSE2__)
+    const char* simd = "SSE2";
+#else
+    const char* simd = "scalar";
+#endif
+    std::mt19937 g(1);
+    bool keys_ok = check_keys<std::int8_t>(g) && check_keys<std::uint8_t>(g) && check_keys<std::int16_t>(g) && check_keys<std::uint16_t>(g)
+                && check_keys<std::int32_t>(g) && check_keys<std::uint32_t>(g) && check_keys<std::int64_t>(g) && check_keys<std::uint64_t>(g);
+    if(!keys_ok) {
+        std::cout << "Keys Wrong" << std::endl;
+    }
+    std::cout << "Testing search in a tree, a frozen snapshot and a frozen B-tree (" << simd << "): "
+              << count << " lookups per size" << std::endl;
+    std::cout << "(ns per lookup: tree, frozen, frozen_btree, frozen_btree search_many)" << std::endl;
+    for(int size = 1 << 10; size <= max_size; size *= 4) {
+        std::vector<IntNode> nodes(size);
+        std::vector<int> keys(size);
+        for(int i = 0; i < size; ++i) {
+            keys[i] = 2 * i;
+        }
+        std::shuffle(keys.begin(), keys.end(), g);
+        Tree tree;
+        for(int i = 0; i < size; ++i) {
+            nodes[i].val = keys[i];
+            tree.insert(&nodes[i]);
+        }
+        auto snapshot = bst::freeze(tree);
+        timeval start, stop;
+        gettimeofday(&start, nullptr);
+        auto btree = bst::freeze_btree(tree);
+        gettimeofday(&stop, nullptr);
+        double t0 = TIME_DIFF(start, stop);
+
+        // half of the lookups miss
+        std::vector<int> lookups(count);
+        for(auto& key : lookups) {
+            key = g() % (2 * size);
+        }
+        std::size_t f1, f2, f3, f4;
+        double t1 = run(tree, lookups, f1);
+        double t2 = run(snapshot, lookups, f2);
+        double t3 = run(btree, lookups, f3);
+        double t4 = run_many(btree, lookups, f4);
+        // copies keep their keys aligned in storage of their own
+        auto copy = btree;
+        auto assigned = bst::freeze_btree(Tree());
+        assigned = btree;
+        std::size_t f5, f6;
+        run(copy, lookups, f5);
+        run(assigned, lookups, f6);
+        if(f1 != f2 || f1 != f3 || f1 != f4 || f1 != f5 || f1 != f6 || copy.size() != btree.size()) {
+            std::cout << "Wrong" << std::endl;
+        }
+        std::cout << "    " << size << " nodes:\t" << t1 << ", " << t2 << ", " << t3 << ", " << t4
+                  << "\t(freeze_btree " << t0 << " ms)" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,180 @@
+#include<algorithm>
+#include<random>
+#include<vector>
+#include<iostream>
+#include<sys/time.h>
+#include"bstree.h"
+
+#define TIME_DIFF(start, stop) 1e3 * (stop.tv_sec - start.tv_sec) + 1e-3 * (stop.tv_usec - start.tv_usec)
+
+struct IntNode : public bst::node_hook {
+    int val;
+};
+
+struct GetValue {
+    int operator()(const IntNode& n) const { return n.val; }
+};
+
+template<typename Node>
+int value_of(const Node* n) {
+    return n == nullptr ? -1 : n->val;
+}
+
+// the ends and the order of the cached tree against a plain one with the same keys
+template<typename Cached, typename Tree>
+bool same(const Cached& a, Tree& b) {
+    if(value_of(a.first()) != value_of(b.first()) || value_of(a.last()) != value_of(b.last())) {
+        return false;
+    }
+    auto r = bst::range(b);
+    auto j = r.begin();
+    for(auto i = a.begin(); i != a.end(); ++i, ++j) {
+        if(j == r.end() || i->val != j->val) {
+            return false;
+        }
+    }
+    if(j != r.end()) {
+        return false;
+    }
+    auto e = a.end();
+    return a.empty() || &*--e == a.last();
+}
+
+// Check cached_ends against the plain tree through inserts, erases of the ends and of random
+// nodes, pops, split_front and join_front, then time popping all the nodes in order.
+template<template<typename, typename, typename, typename...> class Tree>
+void run(const std::vector<int>& keys, const std::vector<int>& order, const char* name) {
+    using tree_type = Tree<IntNode, int, GetValue>;
+    std::size_t size = keys.size();
+    std::vector<IntNode> na(size), nb(size);
+    for(std::size_t i = 0; i < size; ++i) {
+        na[i].val = nb[i].val = keys[i];
+    }
+    bst::cached_ends<tree_type> a;
+    tree_type b;
+    bool ok = true;
+    // whether each node is in its tree, the equal keys need not be at the same index
+    std::vector<bool> ina(size, true), inb(size, true);
+
+    // plain, hinted and unique inserts, hinted or not, checking the ends after every insert
+    for(std::size_t i = 0; i < size; ++i) {
+        if(i % 3 == 0) {
+            a.insert(&na[i]);
+            b.insert(&nb[i]);
+        } else if(i % 3 == 1) {
+            a.insert(nullptr, &na[i]);
+            b.insert(nullptr, &nb[i]);
+        } else if(i % 6 == 2) {
+            ina[i] = a.insert_unique(&na[i]);
+            inb[i] = b.insert_unique(&nb[i]);
+            ok = ok && ina[i] == inb[i];
+        } else {
+            ina[i] = a.insert_unique(nullptr, &na[i]);
+            inb[i] = b.insert_unique(nullptr, &nb[i]);
+            ok = ok && ina[i] == inb[i];
+        }
+        ok = ok && value_of(a.first()) == value_of(b.first()) && value_of(a.last()) == value_of(b.last());
+    }
+    ok = ok && same(a, b);
+
+    // erase the first, the last and random nodes
+    for(std::size_t i = 0; i < size / 4; ++i) {
+        IntNode *x, *y;
+        if(i % 3 == 0) {
+            x = a.first();
+            y = b.first();
+        } else if(i % 3 == 1) {
+            x = a.last();
+            y = b.last();
+        } else {
+            x = &na[order[i]];
+            y = &nb[order[i]];
+            if(!ina[x - &na[0]] || !inb[y - &nb[0]]) {
+                continue;
+            }
+        }
+        ina[x - &na[0]] = inb[y - &nb[0]] = false;
+        a.erase(x);
+        b.erase(y);
+        ok = ok && value_of(a.first()) == value_of(b.first()) && value_of(a.last()) == value_of(b.last());
+    }
+    ok = ok && same(a, b);
+
+    // pop from both ends
+    for(std::size_t i = 0; i < size / 8; ++i) {
+        auto y = i % 2 == 0 ? b.first() : b.last();
+        auto x = i % 2 == 0 ? a.pop_front() : a.pop_back();
+        if(y != nullptr) {
+            b.erase(y);
+        }
+        ok = ok && value_of(x) == value_of(y);
+    }
+    ok = ok && same(a, b);
+
+    // split at the median and join again with a pivot of the same key
+    if(!a.empty()) {
+        int mid = std::next(a.begin(), std::distance(a.begin(), a.end()) / 2)->val;
+        auto front = a.split_front(mid);
+        auto parts = b.split(mid);
+        b = parts.second;
+        ok = ok && same(a, b) && value_of(front.last()) == value_of(parts.first.last());
+        IntNode pa, pb;
+        pa.val = pb.val = mid;
+        a.join_front(front, &pa);
+        b.join(parts.first, &pb, b);
+        ok = ok && same(a, b) && front.root() == nullptr;
+        a.erase(&pa);
+        b.erase(&pb);
+    }
+
+    // pop all the nodes in order
+    timeval start, stop;
+    gettimeofday(&start, nullptr);
+    std::size_t n = 0;
+    for(int prev = -1; auto x = a.pop_front(); ++n) {
+        ok = ok && x->val >= prev;
+        prev = x->val;
+    }
+    gettimeofday(&stop, nullptr);
+    double t1 = TIME_DIFF(start, stop);
+
+    gettimeofday(&start, nullptr);
+    std::size_t m = 0;
+    for(auto y = b.first(); y != nullptr; y = b.first(), ++m) {
+        b.erase(y);
+    }
+    gettimeofday(&stop, nullptr);
+    double t2 = TIME_DIFF(start, stop);
+
+    if(!ok || n != m || !a.empty() || a.begin() != a.end()) {
+        std::cout << name << " Wrong" << std::endl;
+    }
+    std::cout << "    " << name << ":\tpop_front " << t1 << " ms, first and erase " << t2 << " ms" << std::endl;
+}
+
+int main(int argc, char **argv) {
+    int size = 1000000;
+
+    if(argc > 1) {
+        int s = atoi(argv[1]);
+        if(s > 0) {
+            size = s;
+        }
+    }
+
+    // every key appears twice, so the unique inserts are refused for some nodes
+    std::mt19937 g(1);
+    std::vector<int> keys(size), order(size);
+    for(int i = 0; i < size; ++i) {
+        keys[i] = i / 2;
+        order[i] = i;
+    }
+    std::shuffle(keys.begin(), keys.end(), g);
+    std::shuffle(order.begin(), order.end(), g);
+
+    std::cout << "Testing cached_ends against the plain tree: size = " << size << std::endl;
+    run<bst::rbtree>(keys, order, "RB");
+    run<bst::avl>(keys, order, "AVL");
+    run<bst::wavl>(keys, order, "WAVL");
+    return 0;
+}
@@ -0,0 +1,125 @@
+#include<algorithm>
+#include<mutex>
+#include<random>
+#include<thread>
+#include<vector>
+#include<iostream>
+#include<sys/time.h>
+#include"bstree_concurrent.h"
+
+#define TIME_DIFF(start, stop) 1e3 * (stop.tv_sec - start.tv_sec) + 1e-3 * (stop.tv_usec - start.tv_usec)
+
+struct IntNode : public bst::node_hook {
+    int val;
+};
+
+struct GetValue {
+    int operator()(const IntNode& n) const { return n.val; }
+};
+
+// the same interface with one mutex around every operation
+template<typename Tree>
+class locked {
+    Tree tree;
+    std::mutex m;
+public:
+    void insert(IntNode* node) {
+        std::lock_guard<std::mutex> lock(m);
+        tree.insert(node);
+    }
+    void erase(IntNode* node) {
+        std::lock_guard<std::mutex> lock(m);
+        tree.erase(node);
+    }
+    Tree& unsafe_tree() {
+        return tree;
+    }
+};
+
+// operations per microsecond of threads each inserting and then erasing its own slice of the nodes
+template<typename Wrapper>
+double run(std::vector<IntNode>& nodes, unsigned threads, const char* name) {
+    Wrapper tree;
+    timeval start, stop;
+    gettimeofday(&start, nullptr);
+    std::vector<std::thread> workers;
+    for(unsigned t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t]() {
+            for(std::size_t i = t; i < nodes.size(); i += threads) {
+                tree.insert(&nodes[i]);
+            }
+            for(std::size_t i = t; i < nodes.size(); i += 2 * threads) {
+                tree.erase(&nodes[i]);
+            }
+        });
+    }
+    for(auto& w : workers) {
+        w.join();
+    }
+    gettimeofday(&stop, nullptr);
+
+    std::size_t n = 0;
+    int prev = -1;
+    for(auto& node : bst::range(tree.unsafe_tree())) {
+        if(node.val < prev) {
+            std::cout << name << " Wrong" << std::endl;
+        }
+        prev = node.val;
+        ++n;
+    }
+    std::size_t erased = 0;
+    for(unsigned t = 0; t < threads; ++t) {
+        erased += (nodes.size() + 2 * threads - 1 - t) / (2 * threads);
+    }
+    if(n != nodes.size() - erased) {
+        std::cout << name << " Wrong" << std::endl;
+    }
+    double t = TIME_DIFF(start, stop);
+    return 1e-3 * (nodes.size() + erased) / t;
+}
+
+template<typename Tree>
+void sweep(std::vector<IntNode>& nodes, unsigned max_threads, const char* name) {
+    std::cout << name << " (operations per us: combining, mutex)" << std::endl;
+    for(unsigned p = 1; ; p *= 2) {
+        if(p > max_threads) {
+            p = max_threads;
+        }
+        double t1 = run<bst::combining<Tree>>(nodes, p, "combining");
+        double t2 = run<locked<Tree>>(nodes, p, "mutex");
+        std::cout << "    " << p << " threads:\t" << t1 << ", " << t2 << std::endl;
+        if(p >= max_threads) {
+            break;
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    int size = 1000000;
+    unsigned max_threads = 64;
+
+    if(argc > 1) {
+        int s = atoi(argv[1]);
+        if(s > 0) {
+            size = s;
+        }
+    }
+    if(argc > 2) {
+        int t = atoi(argv[2]);
+        if(t > 0) {
+            max_threads = t;
+        }
+    }
+
+    std::vector<IntNode> nodes(size);
+    for(int i = 0; i < size; ++i) {
+        nodes[i].val = i;
+    }
+    std::shuffle(nodes.begin(), nodes.end(), std::mt19937(1));
+
+    std::cout << "Testing inserts and erases from many threads: size = " << size << std::endl;
+    sweep<bst::rbtree<IntNode, int, GetValue>>(nodes, max_threads, "rbtree");
+    sweep<bst::avl<IntNode, int, GetValue>>(nodes, max_threads, "avl");
+    sweep<bst::wavl<IntNode, int, GetValue>>(nodes, max_threads, "wavl");
+    return 0;
+}
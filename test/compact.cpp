@@ -0,0 +1,88 @@
+#include<algorithm>
+#include<random>
+#include<vector>
+#include<iostream>
+#include<sys/time.h>
+#include"bstree.h"
+
+#define TIME_DIFF(start, stop) 1e3 * (stop.tv_sec - start.tv_sec) + 1e-3 * (stop.tv_usec - start.tv_usec)
+
+template<typename Hook>
+struct IntNode : public Hook {
+    int val;
+};
+
+struct GetValue {
+    template<typename Node>
+    int operator()(const Node& n) const { return n.val; }
+};
+
+// Insert the nodes in random order, search all the keys and erase every node, return the
+// times in ms. All nodes are in one array, as the compact hooks require.
+template<template<typename, typename, typename, typename...> class Tree, typename Hook>
+void run(const std::vector<int>& keys, const char* name) {
+    using Node = IntNode<Hook>;
+    std::vector<Node> nodes(keys.size());
+    for(std::size_t i = 0; i < keys.size(); ++i) {
+        nodes[i].val = keys[i];
+    }
+    Tree<Node, int, GetValue> tree;
+    timeval start, stop;
+
+    gettimeofday(&start, nullptr);
+    for(auto& n : nodes) {
+        tree.insert(&n);
+    }
+    gettimeofday(&stop, nullptr);
+    double t1 = TIME_DIFF(start, stop);
+
+    std::size_t found = 0;
+    gettimeofday(&start, nullptr);
+    for(int key : keys) {
+        found += tree.search(key) != nullptr;
+    }
+    gettimeofday(&stop, nullptr);
+    double t2 = TIME_DIFF(start, stop);
+
+    gettimeofday(&start, nullptr);
+    for(auto& n : nodes) {
+        tree.erase(&n);
+    }
+    gettimeofday(&stop, nullptr);
+    double t3 = TIME_DIFF(start, stop);
+
+    if(found != keys.size() || tree.root() != nullptr) {
+        std::cout << name << " Wrong" << std::endl;
+    }
+    std::cout << "    " << name << " (" << sizeof(Node) << " bytes per node):\tinsert " << t1
+              << " ms, search " << t2 << " ms, erase " << t3 << " ms" << std::endl;
+}
+
+int main(int argc, char **argv) {
+    int size = 10000000;
+
+    if(argc > 1) {
+        int s = atoi(argv[1]);
+        if(s > 0) {
+            size = s;
+        }
+    }
+
+    std::vector<int> keys(size);
+    for(int i = 0; i < size; ++i) {
+        keys[i] = i;
+    }
+    std::shuffle(keys.begin(), keys.end(), std::mt19937(1));
+
+    std::cout << "Testing node_hook against compact_node_hook: size = " << size << std::endl;
+    std::cout << "rbtree" << std::endl;
+    run<bst::rbtree, bst::node_hook>(keys, "node_hook");
+    run<bst::rbtree, bst::compact_node_hook>(keys, "compact_node_hook");
+    std::cout << "avl" << std::endl;
+    run<bst::avl, bst::node_hook>(keys, "node_hook");
+    run<bst::avl, bst::compact_node_hook>(keys, "compact_node_hook");
+    std::cout << "wavl" << std::endl;
+    run<bst::wavl, bst::node_hook>(keys, "node_hook");
+    run<bst::wavl, bst::compact_node_hook>(keys, "compact_node_hook");
+    return 0;
+}
@@ -0,0 +1,194 @@
+#include<algorithm>
+#include<cstdio>
+#include<random>
+#include<string>
+#include<vector>
+#include<iostream>
+#include<sys/time.h>
+#include"bstree.h"
+
+#define TIME_DIFF(start, stop) 1e3 * (stop.tv_sec - start.tv_sec) + 1e-3 * (stop.tv_usec - start.tv_usec)
+
+// string keys with a long common prefix, as paths or URLs
+struct StringNode : public bst::node_hook {
+    std::string key;
+};
+
+struct GetString {
+    const std::string& operator()(const StringNode& n) const { return n.key; }
+};
+
+// three-way, as is_three_way tells the tree
+struct StringCompare {
+    using is_three_way = void;
+    int operator()(const std::string& a, const std::string& b) const { return a.compare(b); }
+};
+
+// a key still in the input buffer
+struct Chars {
+    const char* data;
+    std::size_t size;
+};
+
+// compares Chars with the keys directly, as is_transparent tells the tree
+struct CharsCompare : StringCompare {
+    using is_transparent = void;
+    using StringCompare::operator();
+    int operator()(const std::string& a, const Chars& b) const { return a.compare(0, a.size(), b.data, b.size); }
+    int operator()(const Chars& a, const std::string& b) const { return -b.compare(0, b.size(), a.data, a.size); }
+};
+
+// keys behind a virtual call, as in test/poly.cpp
+struct PolyNode : public bst::node_hook {
+    virtual int value() const = 0;
+};
+
+struct IntNode : public PolyNode {
+    int val;
+    virtual int value() const override { return val; }
+};
+
+struct GetValue {
+    int operator()(const PolyNode& n) const { return n.value(); }
+};
+
+struct IntCompare {
+    using is_three_way = void;
+    int operator()(int a, int b) const { return (a > b) - (a < b); }
+};
+
+// a less-than predicate returning int, still a predicate without is_three_way
+struct IntLess {
+    int operator()(int a, int b) const { return a < b; }
+};
+
+// Insert the nodes with insert_unique, search every key, then search for the lower bound
+// of keys that are absent; print the times in ms.
+template<typename Tree, typename Node, typename Key>
+void run(std::vector<Node>& nodes, const std::vector<Key>& keys, const std::vector<Key>& misses, const char* name) {
+    Tree tree;
+    timeval start, stop;
+
+    gettimeofday(&start, nullptr);
+    std::size_t inserted = 0;
+    for(auto& n : nodes) {
+        inserted += tree.insert_unique(&n);
+    }
+    gettimeofday(&stop, nullptr);
+    double t1 = TIME_DIFF(start, stop);
+
+    gettimeofday(&start, nullptr);
+    std::size_t found = 0;
+    for(auto& key : keys) {
+        found += tree.search(key) != nullptr;
+    }
+    gettimeofday(&stop, nullptr);
+    double t2 = TIME_DIFF(start, stop);
+
+    gettimeofday(&start, nullptr);
+    std::size_t bounded = 0;
+    for(auto& key : misses) {
+        bounded += tree.lower_bound(key) != nullptr;
+    }
+    gettimeofday(&stop, nullptr);
+    double t3 = TIME_DIFF(start, stop);
+
+    if(inserted != nodes.size() || found != keys.size() || bounded == 0) {
+        std::cout << name << " Wrong" << std::endl;
+    }
+    std::cout << "    " << name << ":\tinsert_unique " << t1 << " ms, search " << t2 << " ms, lower_bound " << t3 << " ms" << std::endl;
+}
+
+// Search the keys on the lines of a buffer in a small tree, the keys either converted to
+// std::string or given to the tree as they are; print the time in ms.
+template<typename Tree, typename Probe>
+void run_buffer(std::vector<StringNode>& nodes, std::size_t lines, const std::string& buffer, Probe probe, const char* name) {
+    Tree tree;
+    for(auto& n : nodes) {
+        tree.insert(&n);
+    }
+    timeval start, stop;
+    gettimeofday(&start, nullptr);
+    std::size_t found = 0;
+    for(std::size_t pos = 0; pos < buffer.size(); ) {
+        std::size_t end = buffer.find('\n', pos);
+        found += tree.search(probe(buffer.data() + pos, end - pos)) != nullptr;
+        pos = end + 1;
+    }
+    gettimeofday(&stop, nullptr);
+    if(found != lines) {
+        std::cout << name << " Wrong" << std::endl;
+    }
+    std::cout << "    " << name << ":\tsearch " << TIME_DIFF(start, stop) << " ms" << std::endl;
+}
+
+struct ToString {
+    std::string operator()(const char* data, std::size_t size) const { return std::string(data, size); }
+};
+
+struct ToChars {
+    Chars operator()(const char* data, std::size_t size) const { return Chars{data, size}; }
+};
+
+int main(int argc, char **argv) {
+    int size = 1000000;
+
+    if(argc > 1) {
+        int s = atoi(argv[1]);
+        if(s > 0) {
+            size = s;
+        }
+    }
+
+    std::mt19937 g(1);
+    std::vector<int> ids(size);
+    for(int i = 0; i < size; ++i) {
+        ids[i] = 2 * i;
+    }
+    std::shuffle(ids.begin(), ids.end(), g);
+
+    std::cout << "Testing a less-than predicate against a three-way comparator: size = " << size << std::endl;
+    {
+        char buf[64];
+        auto make = [&](int id) {
+            std::snprintf(buf, sizeof(buf), "/srv/data/objects/%010d", id);
+            return std::string(buf);
+        };
+        std::vector<StringNode> nodes(size);
+        std::vector<std::string> keys(size), misses(size);
+        for(int i = 0; i < size; ++i) {
+            nodes[i].key = keys[i] = make(ids[i]);
+            misses[i] = make(ids[i] + 1);
+        }
+        std::cout << "String keys:" << std::endl;
+        run<bst::wavl<StringNode, std::string, GetString>>(nodes, keys, misses, "std::less    ");
+        run<bst::wavl<StringNode, std::string, GetString, StringCompare>>(nodes, keys, misses, "compare()    ");
+
+        // a dictionary of 1000 keys, probed by every line of the buffer
+        std::vector<StringNode> dictionary(std::min(size, 1000));
+        for(std::size_t i = 0; i < dictionary.size(); ++i) {
+            dictionary[i].key = keys[i];
+        }
+        std::string buffer;
+        for(int i = 0; i < size; ++i) {
+            buffer += keys[g() % dictionary.size()];
+            buffer += '\n';
+        }
+        std::cout << "String keys read from a buffer (" << dictionary.size() << " nodes):" << std::endl;
+        run_buffer<bst::wavl<StringNode, std::string, GetString, StringCompare>>(dictionary, size, buffer, ToString(), "std::string  ");
+        run_buffer<bst::wavl<StringNode, std::string, GetString, CharsCompare>>(dictionary, size, buffer, ToChars(), "transparent  ");
+    }
+    {
+        std::vector<IntNode> nodes(size);
+        std::vector<int> misses(size);
+        for(int i = 0; i < size; ++i) {
+            nodes[i].val = ids[i];
+            misses[i] = ids[i] + 1;
+        }
+        std::cout << "Virtual keys:" << std::endl;
+        run<bst::wavl<PolyNode, int, GetValue>>(nodes, ids, misses, "std::less    ");
+        run<bst::wavl<PolyNode, int, GetValue, IntLess>>(nodes, ids, misses, "int less     ");
+        run<bst::wavl<PolyNode, int, GetValue, IntCompare>>(nodes, ids, misses, "three-way int");
+    }
+    return 0;
+}
@@ -0,0 +1,142 @@
+#include<atomic>
+#include<chrono>
+#include<mutex>
+#include<random>
+#include<thread>
+#include<vector>
+#include<iostream>
+#include<sys/time.h>
+#include"bstree_concurrent.h"
+
+#define TIME_DIFF(start, stop) 1e3 * (stop.tv_sec - start.tv_sec) + 1e-3 * (stop.tv_usec - start.tv_usec)
+
+struct IntNode : public bst::atomic_node_hook {
+    int val;
+};
+
+struct GetValue {
+    int operator()(const IntNode& n) const { return n.val; }
+};
+
+// the same interface with one mutex around every operation
+template<typename Tree>
+class locked {
+    Tree tree;
+    mutable std::mutex m;
+public:
+    void insert(IntNode* node) {
+        std::lock_guard<std::mutex> lock(m);
+        tree.insert(node);
+    }
+    void erase(IntNode* node) {
+        std::lock_guard<std::mutex> lock(m);
+        tree.erase(node);
+    }
+    IntNode* search(int value) const {
+        std::lock_guard<std::mutex> lock(m);
+        return tree.search(value);
+    }
+};
+
+// searches per microsecond of all readers while one writer erases and reinserts a node
+// every write_interval microseconds
+template<typename Wrapper>
+double run(std::vector<IntNode>& nodes, unsigned readers, int write_interval, int duration_ms, const char* name) {
+    Wrapper tree;
+    for(auto& n : nodes) {
+        tree.insert(&n);
+    }
+    std::atomic<bool> stop(false);
+    std::atomic<long> searches(0), wrong(0);
+
+    std::thread writer([&]() {
+        std::mt19937 g(1);
+        auto next = std::chrono::steady_clock::now();
+        while(!stop.load(std::memory_order_relaxed)) {
+            auto& n = nodes[g() % nodes.size()];
+            tree.erase(&n);
+            tree.insert(&n);
+            next += std::chrono::microseconds(write_interval);
+            while(std::chrono::steady_clock::now() < next && !stop.load(std::memory_order_relaxed)) {
+                std::this_thread::yield();
+            }
+        }
+    });
+    std::vector<std::thread> threads;
+    for(unsigned t = 0; t < readers; ++t) {
+        threads.emplace_back([&, t]() {
+            std::mt19937 g(t + 2);
+            long n = 0, w = 0;
+            while(!stop.load(std::memory_order_relaxed)) {
+                int value = g() % nodes.size();
+                auto p = tree.search(value);
+                // a node being moved by the writer may be missed, never a wrong one found
+                w += (p != nullptr && p->val != value);
+                ++n;
+            }
+            searches += n;
+            wrong += w;
+        });
+    }
+
+    timeval start, now;
+    gettimeofday(&start, nullptr);
+    std::this_thread::sleep_for(std::chrono::milliseconds(duration_ms));
+    stop = true;
+    writer.join();
+    for(auto& t : threads) {
+        t.join();
+    }
+    gettimeofday(&now, nullptr);
+    if(wrong != 0) {
+        std::cout << name << " Wrong" << std::endl;
+    }
+    double t = TIME_DIFF(start, now);
+    return 1e-3 * searches / t;
+}
+
+int main(int argc, char **argv) {
+    int size = 1000000;
+    unsigned max_threads = std::thread::hardware_concurrency();
+    int write_interval = 10;
+    int duration_ms = 500;
+
+    if(argc > 1) {
+        int s = atoi(argv[1]);
+        if(s > 0) {
+            size = s;
+        }
+    }
+    if(argc > 2) {
+        int t = atoi(argv[2]);
+        if(t > 0) {
+            max_threads = t;
+        }
+    }
+
+    if(argc > 3) {
+        write_interval = atoi(argv[3]);
+    }
+
+    std::vector<IntNode> nodes(size);
+    for(int i = 0; i < size; ++i) {
+        nodes[i].val = i;
+    }
+
+    using Tree = bst::wavl<IntNode, int, GetValue>;
+    std::cout << "Testing concurrent readers with one writer: size = " << size
+              << ", one write per " << write_interval << " us" << std::endl;
+    std::cout << "(searches per us: concurrent, mutex)" << std::endl;
+    for(unsigned p = 1; ; p *= 2) {
+        if(p > max_threads) {
+            p = max_threads > 0 ? max_threads : 1;
+        }
+        double t1 = run<bst::concurrent<Tree>>(nodes, p, write_interval, duration_ms, "concurrent");
+        double t2 = run<locked<Tree>>(nodes, p, write_interval, duration_ms, "mutex");
+        std::cout << "    " << p << " readers:\t" << t1 << ", " << t2 << std::endl;
+        if(p >= max_threads) {
+            break;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,129 @@
+#include<random>
+#include<vector>
+#include<algorithm>
+#include<iostream>
+#include<sys/time.h>
+#include"bstree.h"
+
+#define TIME_DIFF(start, stop) 1e3 * (stop.tv_sec - start.tv_sec) + 1e-3 * (stop.tv_usec - start.tv_usec)
+
+struct IntNode : public bst::counted_node_hook {
+    int val;
+};
+
+struct GetValue {
+    int operator()(const IntNode& n) const { return n.val; }
+};
+
+bool failed = false;
+
+// compare size, select, rank and count_range with a walk of the tree in order
+template<typename BST>
+void check(BST& a, const std::vector<int>& queries, const char* name, const char* stage) {
+    std::vector<const IntNode*> sorted;
+    for(auto& n : bst::range(a)) {
+        sorted.push_back(&n);
+    }
+    std::size_t wrong = (a.size() != sorted.size()) + (a.rank(nullptr) != sorted.size()) + (a.select(sorted.size()) != nullptr);
+    for(std::size_t k = 0; k < sorted.size(); ++k) {
+        wrong += (a.select(k) != sorted[k]) + (a.rank(sorted[k]) != k);
+    }
+    for(std::size_t i = 0; i + 1 < queries.size(); i += 2) {
+        int lo = queries[i], hi = queries[i + 1];
+        std::size_t expect = 0;
+        for(auto p : sorted) {
+            expect += (lo <= p->val && p->val < hi);
+        }
+        wrong += (a.count_range(lo, hi) != expect);
+    }
+    if(wrong != 0) {
+        std::cout << name << " Wrong after " << stage << std::endl;
+        failed = true;
+    }
+}
+
+template<typename BST>
+void test(std::vector<IntNode>& nodes, const std::vector<int>& queries, const char* name) {
+    BST a;
+    for(auto& n : nodes) {
+        a.insert(&n);
+    }
+    check(a, queries, name, "insert");
+
+    for(std::size_t i = 0; i < nodes.size(); i += 3) {
+        a.erase(&nodes[i]);
+    }
+    check(a, queries, name, "erase");
+
+    // cut at the middle key, take the first node of the back as the pivot and join again
+    int middle = a.select(a.size() / 2)->val;
+    auto parts = a.split(middle);
+    check(parts.first, queries, name, "split (front)");
+    check(parts.second, queries, name, "split (back)");
+    auto pivot = parts.second.first();
+    parts.second.erase(pivot);
+    a.join(parts.first, pivot, parts.second);
+    check(a, queries, name, "join");
+
+    std::vector<IntNode*> sorted;
+    for(auto& n : bst::range(a)) {
+        sorted.push_back(&n);
+    }
+    BST b;
+    b.build_sorted(sorted.begin(), sorted.end());
+    check(b, queries, name, "build_sorted");
+
+    // count the nodes in [lo, hi) by count_range and by walking the range
+    timeval start, stop;
+    std::size_t counted = 0, walked = 0;
+    gettimeofday(&start, nullptr);
+    for(std::size_t i = 0; i + 1 < queries.size(); i += 2) {
+        counted += b.count_range(queries[i], queries[i + 1]);
+    }
+    gettimeofday(&stop, nullptr);
+    double t1 = TIME_DIFF(start, stop);
+
+    gettimeofday(&start, nullptr);
+    for(std::size_t i = 0; i + 1 < queries.size(); i += 2) {
+        for(auto& n : bst::range(b.search_range(queries[i], queries[i + 1]))) {
+            (void)n;
+            ++walked;
+        }
+    }
+    gettimeofday(&stop, nullptr);
+    double t2 = TIME_DIFF(start, stop);
+    if(counted != walked) {
+        std::cout << name << " Wrong count_range" << std::endl;
+        failed = true;
+    }
+    std::cout << "    " << name << ":\t" << t1 << " ms, " << t2 << " ms" << std::endl;
+}
+
+int main(int argc, char **argv) {
+    int size = 20000;
+    if(argc > 1) {
+        int s = atoi(argv[1]);
+        if(s > 0) {
+            size = s;
+        }
+    }
+
+    std::mt19937 gen(1);
+    std::vector<IntNode> nodes(size);
+    for(auto& n : nodes) {
+        n.val = gen() % (4 * size);
+    }
+    // pairs of bounds [lo, hi) spanning up to a quarter of the keys
+    std::vector<int> queries(2000);
+    for(std::size_t i = 0; i < queries.size(); i += 2) {
+        queries[i] = gen() % (4 * size);
+        queries[i + 1] = queries[i] + gen() % size;
+    }
+
+    std::cout << "Testing order statistics: " << nodes.size() << " nodes, " << queries.size() / 2 << " range counts" << std::endl;
+    std::cout << "(count_range, walking search_range)" << std::endl;
+    test<bst::rbtree<IntNode, int, GetValue>>(nodes, queries, "RB-Tree");
+    test<bst::avl<IntNode, int, GetValue>>(nodes, queries, "AVL    ");
+    test<bst::wavl<IntNode, int, GetValue>>(nodes, queries, "WAVL   ");
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,106 @@
+#include<algorithm>
+#include<random>
+#include<vector>
+#include<iostream>
+#include<limits>
+#include<sys/time.h>
+#include"bstree.h"
+
+#define TIME_DIFF(start, stop) 1e3 * (stop.tv_sec - start.tv_sec) + 1e-3 * (stop.tv_usec - start.tv_usec)
+
+struct IntNode : public bst::node_hook {
+    int val;
+};
+
+struct GetValue {
+    int operator()(const IntNode& n) const { return n.val; }
+};
+
+using Tree = bst::wavl<IntNode, int, GetValue>;
+
+// nanoseconds per lookup of the keys
+template<typename Index>
+double run(const Index& index, const std::vector<int>& lookups, std::size_t& found) {
+    timeval start, stop;
+    found = 0;
+    gettimeofday(&start, nullptr);
+    for(int key : lookups) {
+        found += index.search(key) != nullptr;
+    }
+    gettimeofday(&stop, nullptr);
+    return 1e6 * (TIME_DIFF(start, stop)) / lookups.size();
+}
+
+// The bounds in the snapshot are those in the tree: for keys between the nodes, on them,
+// below the least and above the greatest.
+bool same_bounds(const Tree& tree, const bst::frozen<Tree>& snapshot, const std::vector<int>& lookups, int size) {
+    std::vector<int> keys(lookups.begin(), lookups.begin() + std::min<std::size_t>(lookups.size(), 100000));
+    for(int key : {std::numeric_limits<int>::min(), -1, 0, 1, 2 * size - 2, 2 * size - 1, 2 * size, std::numeric_limits<int>::max()}) {
+        keys.push_back(key);
+    }
+    for(int key : keys) {
+        if(snapshot.lower_bound(key) != tree.lower_bound(key) || snapshot.upper_bound(key) != tree.upper_bound(key)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    int max_size = 1 << 24;
+    int count = 2000000;
+
+    if(argc > 1) {
+        int s = atoi(argv[1]);
+        if(s > 0) {
+            max_size = s;
+        }
+    }
+    if(argc > 2) {
+        int c = atoi(argv[2]);
+        if(c > 0) {
+            count = c;
+        }
+    }
+
+    std::cout << "Testing search in a tree and in its frozen snapshot: " << count << " lookups per size" << std::endl;
+    std::cout << "(ns per lookup: tree, frozen)" << std::endl;
+    std::mt19937 g(1);
+    for(int size = 1 << 10; size <= max_size; size *= 4) {
+        // the nodes are allocated in random order, as in a tree grown over time
+        std::vector<IntNode> nodes(size);
+        std::vector<int> keys(size);
+        for(int i = 0; i < size; ++i) {
+            keys[i] = 2 * i;
+        }
+        std::shuffle(keys.begin(), keys.end(), g);
+        Tree tree;
+        for(int i = 0; i < size; ++i) {
+            nodes[i].val = keys[i];
+            tree.insert(&nodes[i]);
+        }
+        timeval start, stop;
+        gettimeofday(&start, nullptr);
+        auto snapshot = bst::freeze(tree);
+        gettimeofday(&stop, nullptr);
+        double t0 = TIME_DIFF(start, stop);
+
+        // half of the lookups miss
+        std::vector<int> lookups(count);
+        for(auto& key : lookups) {
+            key = g() % (2 * size);
+        }
+        std::size_t f1, f2;
+        double t1 = run(tree, lookups, f1);
+        double t2 = run(snapshot, lookups, f2);
+        // copies realign their keys, they answer as the snapshot
+        auto copy = snapshot;
+        auto assigned = bst::freeze(Tree());
+        assigned = snapshot;
+        if(f1 != f2 || !same_bounds(tree, snapshot, lookups, size) || !same_bounds(tree, copy, lookups, size) || !same_bounds(tree, assigned, lookups, size)) {
+            std::cout << "Wrong" << std::endl;
+        }
+        std::cout << "    " << size << " nodes:\t" << t1 << ", " << t2 << "\t(freeze " << t0 << " ms)" << std::endl;
+    }
+    return 0;
+}
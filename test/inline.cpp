@@ -0,0 +1,88 @@
+#include<algorithm>
+#include<random>
+#include<vector>
+#include<iostream>
+#include<sys/time.h>
+#include"bstree_inline.h"
+
+#define TIME_DIFF(start, stop) 1e3 * (stop.tv_sec - start.tv_sec) + 1e-3 * (stop.tv_usec - start.tv_usec)
+
+struct Node : public bst::node_hook {
+    int key;
+};
+
+struct GetKey {
+    int operator()(const Node& n) const { return n.key; }
+};
+
+// Insert the nodes in random order, then erase them in another one, rounds times; the tree
+// stays in the cache, so the calls are not hidden behind cache misses. Print the total times
+// in ms.
+template<typename Tree>
+void run(std::vector<Node>& nodes, const std::vector<int>& order, int rounds, const char* name) {
+    Tree tree;
+    timeval start, stop;
+    double t1 = 0, t2 = 0;
+
+    for(int r = 0; r < rounds; ++r) {
+        gettimeofday(&start, nullptr);
+        for(auto& n : nodes) {
+            tree.insert(&n);
+        }
+        gettimeofday(&stop, nullptr);
+        t1 += TIME_DIFF(start, stop);
+
+        gettimeofday(&start, nullptr);
+        for(int i : order) {
+            tree.erase(&nodes[i]);
+        }
+        gettimeofday(&stop, nullptr);
+        t2 += TIME_DIFF(start, stop);
+    }
+
+    if(tree.root() != nullptr) {
+        std::cout << name << " Wrong" << std::endl;
+    }
+    std::cout << "    " << name << ":\tinsert " << t1 << " ms, erase " << t2 << " ms" << std::endl;
+}
+
+int main(int argc, char **argv) {
+    int size = 10000, rounds = 200;
+
+    if(argc > 1) {
+        int s = atoi(argv[1]);
+        if(s > 0) {
+            size = s;
+        }
+    }
+    if(argc > 2) {
+        int r = atoi(argv[2]);
+        if(r > 0) {
+            rounds = r;
+        }
+    }
+
+    std::mt19937 g(1);
+    std::vector<Node> nodes(size);
+    std::vector<int> order(size);
+    for(int i = 0; i < size; ++i) {
+        nodes[i].key = i;
+        order[i] = i;
+    }
+    std::shuffle(nodes.begin(), nodes.end(), g);
+    std::shuffle(order.begin(), order.end(), g);
+
+    // make inline_lto builds this file with link-time optimization, which may inline the
+    // out-of-line functions too
+    std::cout << "Testing out-of-line against inline rebalancing (" << argv[0] << "): size = " << size << ", rounds = " << rounds << std::endl;
+    std::cout << "RB:" << std::endl;
+    run<bst::rbtree<Node, int, GetKey>>(nodes, order, rounds, "out-of-line");
+    run<bst::rbtree<Node, int, GetKey, std::less<int>, void, bst::inline_rb>>(nodes, order, rounds, "inline     ");
+    std::cout << "AVL:" << std::endl;
+    run<bst::avl<Node, int, GetKey>>(nodes, order, rounds, "out-of-line");
+    run<bst::avl<Node, int, GetKey, std::less<int>, void, bst::inline_avl>>(nodes, order, rounds, "inline     ");
+    std::cout << "WAVL:" << std::endl;
+    run<bst::wavl<Node, int, GetKey>>(nodes, order, rounds, "out-of-line");
+    run<bst::wavl<Node, int, GetKey, std::less<int>, void, bst::inline_wavl>>(nodes, order, rounds, "inline     ");
+    return 0;
+}
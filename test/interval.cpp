@@ -0,0 +1,86 @@
+#include<random>
+#include<vector>
+#include<iostream>
+#include<sys/time.h>
+#include"bstree.h"
+
+#define TIME_DIFF(start, stop) 1e3 * (stop.tv_sec - start.tv_sec) + 1e-3 * (stop.tv_usec - start.tv_usec)
+
+struct Interval : public bst::interval_node_hook<int> {
+    int low, high;
+};
+
+struct GetLow {
+    int operator()(const Interval& n) const { return n.low; }
+};
+
+struct GetHigh {
+    int operator()(const Interval& n) const { return n.high; }
+};
+
+template<typename Tree>
+void test(std::vector<Interval>& nodes, const std::vector<int>& queries, const char* name) {
+    Tree tree;
+    timeval start, stop;
+    gettimeofday(&start, nullptr);
+    for(auto& n : nodes) {
+        tree.insert(&n);
+    }
+    for(std::size_t i = 0; i < nodes.size(); i += 2) {
+        tree.erase(&nodes[i]);
+    }
+    gettimeofday(&stop, nullptr);
+    double t_update = TIME_DIFF(start, stop);
+
+    // the intervals overlapping [q, q + 100), found from the tree and by a scan from the beginning
+    std::size_t found = 0, expect = 0;
+    gettimeofday(&start, nullptr);
+    for(auto q : queries) {
+        for(auto& n : tree.overlapping(q, q + 100)) {
+            (void)n;
+            ++found;
+        }
+    }
+    gettimeofday(&stop, nullptr);
+    double t_query = TIME_DIFF(start, stop);
+
+    gettimeofday(&start, nullptr);
+    for(auto q : queries) {
+        for(auto& n : bst::range(tree.first(), tree.lower_bound(q + 100))) {
+            expect += (n.high > q);
+        }
+    }
+    gettimeofday(&stop, nullptr);
+    double t_scan = TIME_DIFF(start, stop);
+
+    std::size_t stabbed = 0, stab_expect = 0;
+    for(auto q : queries) {
+        for(auto& n : tree.stabbing(q)) {
+            stabbed += (n.low <= q && q < n.high);
+        }
+        for(auto& n : bst::range(tree)) {
+            stab_expect += (n.low <= q && q < n.high);
+        }
+    }
+    std::cout << "    " << name << ":\t" << t_update << " ms, " << t_query << " ms, " << t_scan << " ms"
+              << ((found == expect && stabbed == stab_expect) ? "" : " Wrong") << std::endl;
+}
+
+int main() {
+    std::mt19937 gen(1);
+    std::vector<Interval> nodes(20000);
+    for(auto& n : nodes) {
+        n.low = gen() % 1000000;
+        n.high = n.low + 1 + ((gen() % 16 == 0) ? gen() % 100000 : gen() % 1000);
+    }
+    std::vector<int> queries(1000);
+    for(auto& q : queries) {
+        q = gen() % 1000000;
+    }
+
+    std::cout << "Testing interval trees: " << nodes.size() << " intervals, " << queries.size() << " queries" << std::endl;
+    std::cout << "(insert and erase, overlap queries, scan from the first node)" << std::endl;
+    test<bst::interval_tree<Interval, int, GetLow, GetHigh>>(nodes, queries, "WAVL   ");
+    test<bst::interval_tree<Interval, int, GetLow, GetHigh, std::less<int>, bst::rbtree>>(nodes, queries, "RB-Tree");
+    return 0;
+}
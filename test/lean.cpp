@@ -0,0 +1,238 @@
+#include<algorithm>
+#include<random>
+#include<set>
+#include<vector>
+#include<iostream>
+#include<sys/time.h>
+#include"bstree_inline.h"
+
+#define TIME_DIFF(start, stop) 1e3 * (stop.tv_sec - start.tv_sec) + 1e-3 * (stop.tv_usec - start.tv_usec)
+
+template<typename Hook>
+struct IntNode : public Hook {
+    int val;
+};
+
+struct GetValue {
+    template<typename Node>
+    int operator()(const Node& n) const { return n.val; }
+};
+
+// erase by key on the trees with parent pointers
+template<typename Tree>
+typename Tree::node_pointer erase_key(Tree& tree, int key) {
+    auto node = tree.search(key);
+    if(node != nullptr) {
+        tree.erase(node);
+    }
+    return node;
+}
+
+template<typename Node, typename Key, typename GetKey, typename Compare, typename Ops>
+Node* erase_key(bst::lean_tree<Node, Key, GetKey, Compare, Ops>& tree, int key) {
+    return tree.erase(key);
+}
+
+// walk the tree in order
+template<typename Tree>
+long long sum_all(Tree& tree) {
+    long long sum = 0;
+    for(auto& n : bst::range(tree)) {
+        sum += n.val;
+    }
+    return sum;
+}
+
+template<typename Node, typename Key, typename GetKey, typename Compare, typename Ops>
+long long sum_all(bst::lean_tree<Node, Key, GetKey, Compare, Ops>& tree) {
+    long long sum = 0;
+    for(auto& n : tree) {
+        sum += n.val;
+    }
+    return sum;
+}
+
+using bst::impl::LeanNodeBase;
+
+// The height of a subtree in the measure of each scheme, every broken rule counts in wrong.
+struct RBRules {
+    static int height(const LeanNodeBase* p, std::size_t& wrong) {
+        if(p == nullptr) {
+            return 0;
+        }
+        bool red = p->tag() == bst::impl::RED;
+        wrong += !red && p->tag() != bst::impl::BLACK;
+        for(auto child : {p->left(), p->right}) {
+            wrong += red && child != nullptr && child->tag() == bst::impl::RED;
+        }
+        int l = height(p->left(), wrong), r = height(p->right, wrong);
+        wrong += l != r;
+        return l + !red;
+    }
+    static bool root_ok(const LeanNodeBase* root) {
+        return root == nullptr || root->tag() == bst::impl::BLACK;
+    }
+};
+
+struct AVLRules {
+    static int height(const LeanNodeBase* p, std::size_t& wrong) {
+        if(p == nullptr) {
+            return 0;
+        }
+        int l = height(p->left(), wrong), r = height(p->right, wrong);
+        int tag = p->tag();
+        wrong += !((tag == bst::impl::BALANCE && l == r) || (tag == bst::impl::LEFT && l == r + 1) || (tag == bst::impl::RIGHT && r == l + 1));
+        return std::max(l, r) + 1;
+    }
+    static bool root_ok(const LeanNodeBase*) {
+        return true;
+    }
+};
+
+// WLEFT marks a right child of rank difference 2, WRIGHT a left one
+struct WAVLRules {
+    static int height(const LeanNodeBase* p, std::size_t& wrong) {
+        if(p == nullptr) {
+            return -1;
+        }
+        int l = height(p->left(), wrong), r = height(p->right, wrong);
+        int tag = p->tag();
+        int rank = l + ((tag & bst::impl::WRIGHT) ? 2 : 1);
+        wrong += rank != r + ((tag & bst::impl::WLEFT) ? 2 : 1);
+        wrong += p->left() == nullptr && p->right == nullptr && rank != 0;
+        return rank;
+    }
+    static bool root_ok(const LeanNodeBase*) {
+        return true;
+    }
+};
+
+// Interleave inserts and erases by key on small trees with repeated keys, and check the rules
+// of the scheme and the keys against a multiset after every step.
+template<typename Tree, typename Rules>
+bool check_rules(const char* name) {
+    using Node = typename Tree::node_type;
+    std::mt19937 gen(7);
+    std::size_t wrong = 0;
+    for(int round = 0; round < 200 && wrong == 0; ++round) {
+        int n = gen() % 300 + 1, range = (gen() % 2) ? n : n / 4 + 1;
+        std::vector<Node> nodes(n);
+        std::vector<bool> linked(n, false);
+        std::vector<int> free;
+        for(int i = 0; i < n; ++i) {
+            nodes[i].val = gen() % range;
+            free.push_back(i);
+        }
+        Tree tree;
+        std::multiset<int> expect;
+        for(int step = 0; step < 4 * n && wrong == 0; ++step) {
+            if(gen() % 3 != 0 && !free.empty()) {
+                std::size_t j = gen() % free.size();
+                auto& node = nodes[free[j]];
+                free[j] = free.back();
+                free.pop_back();
+                tree.insert(&node);
+                expect.insert(node.val);
+            } else {
+                int key = gen() % range;
+                auto node = tree.erase(key);
+                auto it = expect.find(key);
+                wrong += (node == nullptr) != (it == expect.end());
+                if(node != nullptr) {
+                    wrong += node->val != key;
+                    expect.erase(it);
+                    free.push_back(int(node - nodes.data()));
+                }
+            }
+            Rules::height(tree.root(), wrong);
+            wrong += !Rules::root_ok(tree.root());
+            std::vector<int> keys;
+            for(auto& node : tree) {
+                keys.push_back(node.val);
+            }
+            wrong += keys != std::vector<int>(expect.begin(), expect.end());
+        }
+    }
+    if(wrong != 0) {
+        std::cout << name << " Wrong" << std::endl;
+    }
+    return wrong == 0;
+}
+
+// Insert the nodes in random order, search all the keys, walk the tree and erase every
+// node by its key, print the times in ms.
+template<typename Tree>
+void run(const std::vector<int>& keys, const char* name) {
+    using Node = typename Tree::node_type;
+    std::vector<Node> nodes(keys.size());
+    for(std::size_t i = 0; i < keys.size(); ++i) {
+        nodes[i].val = keys[i];
+    }
+    Tree tree;
+    timeval start, stop;
+
+    gettimeofday(&start, nullptr);
+    for(auto& n : nodes) {
+        tree.insert(&n);
+    }
+    gettimeofday(&stop, nullptr);
+    double t1 = TIME_DIFF(start, stop);
+
+    std::size_t found = 0;
+    gettimeofday(&start, nullptr);
+    for(int key : keys) {
+        found += tree.search(key) != nullptr;
+    }
+    gettimeofday(&stop, nullptr);
+    double t2 = TIME_DIFF(start, stop);
+
+    gettimeofday(&start, nullptr);
+    long long sum = sum_all(tree);
+    gettimeofday(&stop, nullptr);
+    double t3 = TIME_DIFF(start, stop);
+
+    std::size_t erased = 0;
+    gettimeofday(&start, nullptr);
+    for(int key : keys) {
+        erased += erase_key(tree, key) != nullptr;
+    }
+    gettimeofday(&stop, nullptr);
+    double t4 = TIME_DIFF(start, stop);
+
+    long long n = keys.size();
+    if(found != keys.size() || erased != keys.size() || sum != n * (n - 1) / 2 || tree.root() != nullptr) {
+        std::cout << name << " Wrong" << std::endl;
+    }
+    std::cout << "    " << name << " (" << sizeof(Node) << " bytes per node):\tinsert " << t1
+              << " ms, search " << t2 << " ms, iterate " << t3 << " ms, erase " << t4 << " ms" << std::endl;
+}
+
+int main(int argc, char **argv) {
+    int size = 1000000;
+
+    if(argc > 1) {
+        int s = atoi(argv[1]);
+        if(s > 0) {
+            size = s;
+        }
+    }
+
+    std::vector<int> keys(size);
+    for(int i = 0; i < size; ++i) {
+        keys[i] = i;
+    }
+    std::shuffle(keys.begin(), keys.end(), std::mt19937(1));
+
+    bool ok = check_rules<bst::lean_rbtree<IntNode<bst::lean_node_hook>, int, GetValue>, RBRules>("lean_rbtree rules")
+            & check_rules<bst::lean_avl<IntNode<bst::lean_node_hook>, int, GetValue>, AVLRules>("lean_avl rules")
+            & check_rules<bst::lean_wavl<IntNode<bst::lean_node_hook>, int, GetValue>, WAVLRules>("lean_wavl rules");
+    std::cout << "Testing lean trees against trees with parent pointers: size = " << size << std::endl;
+    run<bst::avl<IntNode<bst::node_hook>, int, GetValue>>(keys, "avl, node_hook");
+    run<bst::avl<IntNode<bst::compact_node_hook>, int, GetValue>>(keys, "avl, compact_node_hook");
+    run<bst::lean_avl<IntNode<bst::lean_node_hook>, int, GetValue>>(keys, "lean_avl, lean_node_hook");
+    run<bst::rbtree<IntNode<bst::node_hook>, int, GetValue>>(keys, "rbtree, node_hook");
+    run<bst::lean_rbtree<IntNode<bst::lean_node_hook>, int, GetValue>>(keys, "lean_rbtree, lean_node_hook");
+    run<bst::wavl<IntNode<bst::node_hook>, int, GetValue>>(keys, "wavl, node_hook");
+    run<bst::lean_wavl<IntNode<bst::lean_node_hook>, int, GetValue>>(keys, "lean_wavl, lean_node_hook");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,178 @@
+#include<algorithm>
+#include<cstdint>
+#include<cstring>
+#include<new>
+#include<random>
+#include<vector>
+#include<iostream>
+#include<fcntl.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<sys/time.h>
+#include<unistd.h>
+#include"bstree.h"
+
+#define TIME_DIFF(start, stop) 1e3 * (stop.tv_sec - start.tv_sec) + 1e-3 * (stop.tv_usec - start.tv_usec)
+
+struct Record : public bst::offset_node_hook {
+    std::uint64_t key;
+    std::uint64_t value;
+};
+
+struct GetKey {
+    std::uint64_t operator()(const Record& r) const { return r.key; }
+};
+
+using Tree = bst::wavl<Record, std::uint64_t, GetKey>;
+
+// The file holds this header followed by the records. The root is kept as its distance
+// from the start of the file, the links between the records are relative to the records.
+struct Header {
+    char magic[8];
+    std::uint64_t count;
+    std::int64_t root;
+};
+
+const char Magic[8] = "bstidx1";
+
+Record* records(void* base) {
+    return reinterpret_cast<Record*>(static_cast<char*>(base) + sizeof(Header));
+}
+
+void* map_file(int fd, std::size_t length) {
+    void* base = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    return base == MAP_FAILED ? nullptr : base;
+}
+
+// build the index of size records in a new file
+bool create(const char* path, std::size_t size) {
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    std::size_t length = sizeof(Header) + size * sizeof(Record);
+    if(fd < 0 || ftruncate(fd, length) != 0) {
+        return false;
+    }
+    void* base = map_file(fd, length);
+    close(fd);
+    if(base == nullptr) {
+        return false;
+    }
+    std::vector<std::uint64_t> keys(size);
+    for(std::size_t i = 0; i < size; ++i) {
+        keys[i] = 2 * i;
+    }
+    std::shuffle(keys.begin(), keys.end(), std::mt19937(1));
+
+    timeval start, stop;
+    gettimeofday(&start, nullptr);
+    Record* r = records(base);
+    Tree tree;
+    for(std::size_t i = 0; i < size; ++i) {
+        new(r + i) Record();
+        r[i].key = keys[i];
+        r[i].value = keys[i] * 3;
+        tree.insert(r + i);
+    }
+    gettimeofday(&stop, nullptr);
+
+    auto header = static_cast<Header*>(base);
+    std::memcpy(header->magic, Magic, sizeof(Magic));
+    header->count = size;
+    header->root = tree.root() ? reinterpret_cast<char*>(tree.root()) - static_cast<char*>(base) : -1;
+    std::cout << "Built " << size << " records at " << base << ":\t" << TIME_DIFF(start, stop) << " ms" << std::endl;
+    msync(base, length, MS_SYNC);
+    munmap(base, length);
+    return true;
+}
+
+// map an existing index and use it as it is
+bool reopen(const char* path) {
+    int fd = open(path, O_RDWR);
+    struct stat st;
+    if(fd < 0 || fstat(fd, &st) != 0 || std::size_t(st.st_size) < sizeof(Header)) {
+        return false;
+    }
+    // keep a mapping in the way, so that the file is unlikely to be mapped where it was
+    void* hole = mmap(nullptr, st.st_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    timeval start, stop;
+    gettimeofday(&start, nullptr);
+    void* base = map_file(fd, st.st_size);
+    close(fd);
+    if(base == nullptr) {
+        return false;
+    }
+    auto header = static_cast<Header*>(base);
+    if(std::memcmp(header->magic, Magic, sizeof(Magic)) != 0) {
+        munmap(base, st.st_size);
+        return false;
+    }
+    Tree tree;
+    if(header->root >= 0) {
+        tree.attach(reinterpret_cast<Record*>(static_cast<char*>(base) + header->root));
+    }
+    gettimeofday(&stop, nullptr);
+    std::cout << "Reopened " << header->count << " records at " << base << ":\t" << TIME_DIFF(start, stop) << " ms" << std::endl;
+
+    // the first searches fault the pages in
+    std::mt19937 g(2);
+    std::size_t found = 0, lookups = std::min<std::size_t>(header->count, 1000000);
+    gettimeofday(&start, nullptr);
+    for(std::size_t i = 0; i < lookups; ++i) {
+        std::uint64_t key = g() % (2 * header->count);
+        auto r = tree.search(key);
+        if(r != nullptr) {
+            found += r->value == key * 3;
+        } else if(key % 2 == 0) {
+            std::cout << "Wrong" << std::endl;
+        }
+    }
+    gettimeofday(&stop, nullptr);
+    std::cout << "    " << lookups << " searches, " << found << " found:\t" << TIME_DIFF(start, stop) << " ms" << std::endl;
+
+    std::size_t n = 0;
+    std::uint64_t prev = 0;
+    for(auto& r : bst::range(tree)) {
+        if(n > 0 && r.key <= prev) {
+            std::cout << "Wrong" << std::endl;
+        }
+        prev = r.key;
+        ++n;
+    }
+    if(n != header->count) {
+        std::cout << "Wrong" << std::endl;
+    }
+    munmap(base, st.st_size);
+    if(hole != MAP_FAILED) {
+        munmap(hole, st.st_size);
+    }
+    return true;
+}
+
+// Build an index in a file, or use the one left by an earlier run: the tree is reopened
+// at a different address without being rebuilt.
+int main(int argc, char **argv) {
+    std::size_t size = 1000000;
+    const char* path = "persist.idx";
+
+    if(argc > 1) {
+        int s = atoi(argv[1]);
+        if(s > 0) {
+            size = s;
+        }
+    }
+    if(argc > 2) {
+        path = argv[2];
+    }
+
+    if(access(path, F_OK) != 0) {
+        std::cout << "Creating " << path << std::endl;
+        if(!create(path, size)) {
+            std::cout << "Cannot create " << path << std::endl;
+            return 1;
+        }
+    }
+    if(!reopen(path)) {
+        std::cout << "Cannot open " << path << std::endl;
+        return 1;
+    }
+    return 0;
+}
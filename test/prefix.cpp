@@ -0,0 +1,195 @@
+#include<algorithm>
+#include<memory>
+#include<random>
+#include<string>
+#include<vector>
+#include<iostream>
+#include<sys/time.h>
+#include"bstree.h"
+
+#define TIME_DIFF(start, stop) 1e3 * (stop.tv_sec - start.tv_sec) + 1e-3 * (stop.tv_usec - start.tv_usec)
+
+// strings kept out of line
+template<typename Hook>
+struct StringNode : public Hook {
+    std::string key;
+};
+
+struct GetString {
+    template<typename Node>
+    const std::string& operator()(const Node& n) const { return n.key; }
+};
+
+// keys behind a virtual call, as in test/poly.cpp, in nodes allocated one by one
+template<typename Hook>
+struct PolyNode : public Hook {
+    virtual ~PolyNode() {}
+    virtual int value() const = 0;
+};
+
+template<typename Hook>
+struct IntNode : public PolyNode<Hook> {
+    int val;
+    IntNode(int v) : val(v) {}
+    virtual int value() const override { return val; }
+};
+
+struct GetValue {
+    template<typename Node>
+    int operator()(const Node& n) const { return n.value(); }
+};
+
+// Insert the nodes, then search every key; print the times in ms.
+template<typename Tree, typename Key>
+void run(const std::vector<typename Tree::node_pointer>& nodes, const std::vector<Key>& keys, const char* name) {
+    Tree tree;
+    timeval start, stop;
+
+    gettimeofday(&start, nullptr);
+    for(auto n : nodes) {
+        tree.insert(n);
+    }
+    gettimeofday(&stop, nullptr);
+    double t1 = TIME_DIFF(start, stop);
+
+    gettimeofday(&start, nullptr);
+    std::size_t found = 0;
+    for(auto& key : keys) {
+        found += tree.search(key) != nullptr;
+    }
+    gettimeofday(&stop, nullptr);
+    double t2 = TIME_DIFF(start, stop);
+
+    if(found != keys.size()) {
+        std::cout << name << " Wrong" << std::endl;
+    }
+    std::cout << "    " << name << " (" << sizeof(typename Tree::node_type) << " bytes per node):\tinsert " << t1
+              << " ms, search " << t2 << " ms" << std::endl;
+}
+
+template<typename Hook>
+void run_strings(const std::vector<std::string>& keys, const std::vector<std::string>& lookups, const char* name) {
+    using Node = StringNode<Hook>;
+    std::vector<Node> nodes(keys.size());
+    std::vector<Node*> pointers;
+    for(std::size_t i = 0; i < keys.size(); ++i) {
+        nodes[i].key = keys[i];
+        pointers.push_back(&nodes[i]);
+    }
+    run<bst::wavl<Node, std::string, GetString>>(pointers, lookups, name);
+}
+
+template<typename Hook>
+void run_poly(const std::vector<int>& keys, const std::vector<int>& lookups, const char* name) {
+    using Node = PolyNode<Hook>;
+    std::vector<std::unique_ptr<Node>> nodes;
+    std::vector<Node*> pointers;
+    for(int key : keys) {
+        nodes.emplace_back(new IntNode<Hook>(key));
+        pointers.push_back(nodes.back().get());
+    }
+    run<bst::wavl<Node, int, GetValue>>(pointers, lookups, name);
+}
+
+// Join the words below and above the median around a fresh pivot, insert the rest after the
+// join, then split at the median: every word must be found in the tree holding it, the
+// pivot among them, so the prefixes of the nodes the join and the split relink stay right.
+template<template<typename, typename, typename, typename ...> class Tree>
+void check_join(std::vector<std::string> words, const char* name) {
+    using Node = StringNode<bst::prefix_node_hook>;
+    using T = Tree<Node, std::string, GetString>;
+    std::sort(words.begin(), words.end());
+    words.erase(std::unique(words.begin(), words.end()), words.end());
+    std::size_t mid = words.size() / 2;
+    std::vector<Node> nodes(words.size());
+    for(std::size_t i = 0; i < words.size(); ++i) {
+        nodes[i].key = words[i];
+    }
+
+    T left, right, rest;
+    for(std::size_t i = 0; i < mid; i += 2) {
+        left.insert(&nodes[i]);
+    }
+    for(std::size_t i = mid + 2; i < words.size(); i += 2) {
+        right.insert(&nodes[i]);
+    }
+    T tree;
+    tree.join(left, &nodes[mid], right);
+    bool ok = tree.search(words[mid]) == &nodes[mid];
+    for(std::size_t i = 1; i < words.size(); i += 2) {
+        if(i != mid) {
+            tree.insert(&nodes[i]);
+        }
+    }
+    for(std::size_t i = 0; i < words.size(); ++i) {
+        ok = ok && tree.search(words[i]) == &nodes[i];
+    }
+
+    auto parts = tree.split(words[mid]);
+    for(std::size_t i = 0; i < words.size(); ++i) {
+        ok = ok && (i < mid ? parts.first : parts.second).search(words[i]) == &nodes[i];
+    }
+    std::cout << "    " << name << ":	" << (ok ? "join and split ok" : "Wrong") << std::endl;
+}
+
+int main(int argc, char **argv) {
+    int size = 1000000;
+
+    if(argc > 1) {
+        int s = atoi(argv[1]);
+        if(s > 0) {
+            size = s;
+        }
+    }
+
+    std::mt19937 g(1);
+    std::vector<int> ids(size);
+    for(int i = 0; i < size; ++i) {
+        ids[i] = i;
+    }
+    std::shuffle(ids.begin(), ids.end(), g);
+    std::vector<int> lookups(ids);
+    std::shuffle(lookups.begin(), lookups.end(), g);
+
+    std::cout << "Testing node_hook against prefix_node_hook: size = " << size << std::endl;
+
+    // words of 12 to 24 letters, their first 8 bytes rarely tie
+    std::vector<std::string> words(size), word_lookups(size);
+    for(auto& w : words) {
+        w.resize(12 + g() % 13);
+        for(auto& c : w) {
+            c = 'a' + g() % 26;
+        }
+    }
+    for(int i = 0; i < size; ++i) {
+        word_lookups[i] = words[lookups[i]];
+    }
+    std::cout << "String keys:" << std::endl;
+    run_strings<bst::node_hook>(words, word_lookups, "node_hook       ");
+    run_strings<bst::prefix_node_hook>(words, word_lookups, "prefix_node_hook");
+
+    // paths with a common first 8 bytes, the prefixes always tie
+    std::vector<std::string> paths(size), path_lookups(size);
+    for(int i = 0; i < size; ++i) {
+        paths[i] = "/srv/data/objects/" + std::to_string(ids[i]);
+    }
+    for(int i = 0; i < size; ++i) {
+        path_lookups[i] = paths[lookups[i]];
+    }
+    std::cout << "String keys with a common prefix:" << std::endl;
+    run_strings<bst::node_hook>(paths, path_lookups, "node_hook       ");
+    run_strings<bst::prefix_node_hook>(paths, path_lookups, "prefix_node_hook");
+
+    std::cout << "Join and split with prefix_node_hook:" << std::endl;
+    words.resize(std::min(size, 10000));
+    check_join<bst::rbtree>(words, "RB  ");
+    check_join<bst::avl>(words, "AVL ");
+    check_join<bst::wavl>(words, "WAVL");
+    paths.resize(std::min(size, 10000));
+    check_join<bst::avl>(paths, "AVL with a common prefix");
+
+    std::cout << "Virtual keys:" << std::endl;
+    run_poly<bst::node_hook>(ids, lookups, "node_hook       ");
+    run_poly<bst::prefix_node_hook>(ids, lookups, "prefix_node_hook");
+    return 0;
+}
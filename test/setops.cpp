@@ -0,0 +1,109 @@
+#include<vector>
+#include<thread>
+#include<iostream>
+#include<sys/time.h>
+#include"bstree.h"
+
+#define TIME_DIFF(start, stop) 1e3 * (stop.tv_sec - start.tv_sec) + 1e-3 * (stop.tv_usec - start.tv_usec)
+
+struct IntNode : public bst::node_hook {
+    int val;
+};
+
+struct GetValue {
+    int operator()(const IntNode& n) const { return n.val; }
+};
+
+// a holds the multiples of 2, b the multiples of 3
+template<typename BST>
+void build(BST& a, BST& b, std::vector<IntNode>& na, std::vector<IntNode>& nb) {
+    for(std::size_t i = 0; i < na.size(); ++i) {
+        na[i].val = 2 * i;
+        nb[i].val = 3 * i;
+    }
+    a.build_sorted(na.begin(), na.end());
+    b.build_sorted(nb.begin(), nb.end());
+}
+
+template<typename BST>
+std::size_t count(BST& a) {
+    std::size_t n = 0;
+    for(auto& node : bst::range(a)) {
+        (void)node;
+        ++n;
+    }
+    return n;
+}
+
+template<typename BST, typename Op>
+double time_op(int size, Op op, std::size_t expect, const char* name) {
+    std::vector<IntNode> na(size), nb(size);
+    BST a, b;
+    timeval start, stop;
+    build(a, b, na, nb);
+    gettimeofday(&start, nullptr);
+    op(a, b);
+    gettimeofday(&stop, nullptr);
+    if(count(a) != expect) {
+        std::cout << name << " Wrong" << std::endl;
+    }
+    return TIME_DIFF(start, stop);
+}
+
+template<typename BST>
+void test_setops(int size, const std::vector<unsigned>& threads, const char* name) {
+    // sizes of the results, the common keys are the multiples of 6
+    std::size_t n = size, common = (2 * (n - 1)) / 6 + 1;
+    std::size_t n_union = 2 * n - common, n_inter = common, n_diff = n - common;
+
+    double t = time_op<BST>(size, [](BST& a, BST& b) {
+        std::vector<IntNode*> nodes;
+        for(auto& node : bst::range(b)) {
+            nodes.push_back(&node);
+        }
+        for(auto p : nodes) {
+            a.insert_unique(p);
+        }
+    }, n_union, name);
+    std::cout << "    " << name << " insert loop:\t" << t << " ms" << std::endl;
+
+    for(auto p : threads) {
+        bst::set_parallelism(p);
+        double t1 = time_op<BST>(size, [](BST& a, BST& b) { bst::set_union(a, b); }, n_union, name);
+        double t2 = time_op<BST>(size, [](BST& a, BST& b) { bst::set_intersection(a, b); }, n_inter, name);
+        double t3 = time_op<BST>(size, [](BST& a, BST& b) { bst::set_difference(a, b); }, n_diff, name);
+        std::cout << "    " << name << " " << p << " threads:\t" << t1 << " ms, " << t2 << " ms, " << t3 << " ms" << std::endl;
+    }
+}
+
+int main(int argc, char **argv) {
+    int size = 1000000;
+    unsigned max_threads = std::thread::hardware_concurrency();
+
+    if(argc > 1) {
+        int s = atoi(argv[1]);
+        if(s > 0) {
+            size = s;
+        }
+    }
+    if(argc > 2) {
+        int t = atoi(argv[2]);
+        if(t > 0) {
+            max_threads = t;
+        }
+    }
+
+    std::vector<unsigned> threads;
+    for(unsigned p = 1; p < max_threads; p *= 2) {
+        threads.push_back(p);
+    }
+    threads.push_back(max_threads > 0 ? max_threads : 1);
+
+    std::cout << "Testing set operations: size = " << size << " + " << size << std::endl;
+    std::cout << "(union, intersection, difference)" << std::endl;
+    test_setops<bst::rbtree<IntNode, int, GetValue>>(size, threads, "RB-Tree");
+    test_setops<bst::avl<IntNode, int, GetValue>>(size, threads, "AVL    ");
+    test_setops<bst::wavl<IntNode, int, GetValue>>(size, threads, "WAVL   ");
+
+    return 0;
+}
@@ -0,0 +1,192 @@
+#include<algorithm>
+#include<mutex>
+#include<random>
+#include<thread>
+#include<vector>
+#include<iostream>
+#include<sys/time.h>
+#include"bstree_concurrent.h"
+
+#define TIME_DIFF(start, stop) 1e3 * (stop.tv_sec - start.tv_sec) + 1e-3 * (stop.tv_usec - start.tv_usec)
+
+struct IntNode : public bst::node_hook {
+    int val;
+};
+
+struct GetValue {
+    int operator()(const IntNode& n) const { return n.val; }
+};
+
+using Tree = bst::wavl<IntNode, int, GetValue>;
+const std::size_t Shards = 16;
+
+// the same interface with one mutex around every operation
+class locked {
+    Tree tree;
+    std::mutex m;
+    std::size_t n = 0;
+public:
+    void insert(IntNode* node) {
+        std::lock_guard<std::mutex> lock(m);
+        tree.insert(node);
+        ++n;
+    }
+    std::size_t size() const {
+        return n;
+    }
+};
+
+// bounds splitting [0, size) evenly
+std::vector<int> even_bounds(int size) {
+    std::vector<int> bounds;
+    for(std::size_t i = 1; i < Shards; ++i) {
+        bounds.push_back(int(size * i / Shards));
+    }
+    return bounds;
+}
+
+bool check_order(const bst::sharded<Tree, Shards>& tree, std::size_t size) {
+    std::size_t n = 0;
+    int prev = -1;
+    for(auto& node : tree.range()) {
+        if(node.val < prev) {
+            return false;
+        }
+        prev = node.val;
+        ++n;
+    }
+    return n == size && tree.size() == size;
+}
+
+// inserts per microsecond of threads inserting disjoint slices of the nodes
+template<typename Wrapper>
+double run(Wrapper& tree, std::vector<IntNode>& nodes, unsigned threads) {
+    timeval start, stop;
+    gettimeofday(&start, nullptr);
+    std::vector<std::thread> workers;
+    for(unsigned t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t]() {
+            for(std::size_t i = t; i < nodes.size(); i += threads) {
+                tree.insert(&nodes[i]);
+            }
+        });
+    }
+    for(auto& w : workers) {
+        w.join();
+    }
+    gettimeofday(&stop, nullptr);
+    double t = TIME_DIFF(start, stop);
+    return 1e-3 * nodes.size() / t;
+}
+
+int main(int argc, char **argv) {
+    int size = 1000000;
+    unsigned max_threads = std::thread::hardware_concurrency();
+
+    if(argc > 1) {
+        int s = atoi(argv[1]);
+        if(s > 0) {
+            size = s;
+        }
+    }
+    if(argc > 2) {
+        int t = atoi(argv[2]);
+        if(t > 0) {
+            max_threads = t;
+        }
+    }
+
+    std::vector<IntNode> nodes(size);
+    for(int i = 0; i < size; ++i) {
+        nodes[i].val = i;
+    }
+    std::shuffle(nodes.begin(), nodes.end(), std::mt19937(1));
+
+    std::cout << "Testing random inserts: size = " << size << ", " << Shards << " shards" << std::endl;
+    std::cout << "(inserts per us: sharded, mutex)" << std::endl;
+    for(unsigned p = 1; ; p *= 2) {
+        if(p > max_threads) {
+            p = max_threads > 0 ? max_threads : 1;
+        }
+        bst::sharded<Tree, Shards> s(even_bounds(size));
+        double t1 = run(s, nodes, p);
+        if(!check_order(s, nodes.size())) {
+            std::cout << "sharded Wrong" << std::endl;
+        }
+        locked l;
+        double t2 = run(l, nodes, p);
+        if(l.size() != nodes.size()) {
+            std::cout << "mutex Wrong" << std::endl;
+        }
+        std::cout << "    " << p << " threads:\t" << t1 << ", " << t2 << std::endl;
+        if(p >= max_threads) {
+            break;
+        }
+    }
+
+    // all keys land in the last shard until repartition() spreads them
+    {
+        bst::sharded<Tree, Shards> s(std::vector<int>(Shards - 1, 0));
+        std::vector<IntNode*> ptrs;
+        for(auto& n : nodes) {
+            ptrs.push_back(&n);
+        }
+        timeval start, stop;
+        gettimeofday(&start, nullptr);
+        s.insert_batch(ptrs.data(), ptrs.size() / 2);
+        gettimeofday(&stop, nullptr);
+        double t = TIME_DIFF(start, stop);
+        std::cout << "Skewed batch of " << ptrs.size() / 2 << ":\t" << t << " ms, skewed = " << s.skewed() << std::endl;
+        gettimeofday(&start, nullptr);
+        s.repartition();
+        gettimeofday(&stop, nullptr);
+        t = TIME_DIFF(start, stop);
+        std::cout << "Repartition:\t" << t << " ms, skewed = " << s.skewed() << std::endl;
+        gettimeofday(&start, nullptr);
+        s.insert_batch(ptrs.data() + ptrs.size() / 2, ptrs.size() - ptrs.size() / 2);
+        gettimeofday(&stop, nullptr);
+        t = TIME_DIFF(start, stop);
+        std::cout << "Spread batch of " << ptrs.size() - ptrs.size() / 2 << ":\t" << t << " ms" << std::endl;
+        if(!check_order(s, nodes.size())) {
+            std::cout << "sharded Wrong" << std::endl;
+        }
+    }
+
+    // the same start, with the writers repartitioning on their own
+    {
+        bst::sharded<Tree, Shards> s(std::vector<int>(Shards - 1, 0));
+        s.auto_repartition(2.0, 4096);
+        unsigned p = max_threads > 0 ? max_threads : 1;
+        double t = run(s, nodes, p);
+        std::cout << "Auto repartition, " << p << " threads:\t" << t << " inserts per us, skewed = " << s.skewed() << std::endl;
+        if(s.skewed() || !check_order(s, nodes.size())) {
+            std::cout << "sharded Wrong" << std::endl;
+        }
+    }
+
+    // a sliding window of ascending keys: every insert lands past the last bound and the
+    // oldest key is erased, the size stays the same while the bounds must keep moving
+    {
+        const int window = 20000, steps = 400000;
+        std::vector<IntNode> ascending(steps);
+        bst::sharded<Tree, Shards> s;
+        s.auto_repartition(2.0, 64);
+        timeval start, stop;
+        gettimeofday(&start, nullptr);
+        for(int i = 0; i < steps; ++i) {
+            ascending[i].val = i;
+            s.insert(&ascending[i]);
+            if(i >= window) {
+                s.erase(&ascending[i - window]);
+            }
+        }
+        gettimeofday(&stop, nullptr);
+        double t = TIME_DIFF(start, stop);
+        // a shard may have grown past twice its share since the last check, not past 4 times
+        std::cout << "Sliding window of " << window << ", " << steps << " inserts:\t" << t << " ms, skewed = " << s.skewed() << std::endl;
+        if(s.skewed(4.0) || !check_order(s, window)) {
+            std::cout << "sharded Wrong" << std::endl;
+        }
+    }
+    return 0;
+}
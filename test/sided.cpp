@@ -0,0 +1,104 @@
+#include<algorithm>
+#include<random>
+#include<vector>
+#include<iostream>
+#include<sys/time.h>
+#include"bstree.h"
+
+#define TIME_DIFF(start, stop) 1e3 * (stop.tv_sec - start.tv_sec) + 1e-3 * (stop.tv_usec - start.tv_usec)
+
+// a key and a payload, so that a node takes a cache line
+template<typename Hook>
+struct Node : public Hook {
+    int key;
+    char payload[28];
+};
+
+struct GetKey {
+    template<typename N>
+    int operator()(const N& n) const { return n.key; }
+};
+
+// Insert the nodes, walk the tree forward and backward, then erase the nodes in another
+// random order; print the times in ms.
+template<typename Tree>
+void run(std::vector<typename Tree::node_type>& nodes, const std::vector<int>& order, const char* name) {
+    using Hook = typename bst::impl::hook_of<typename Tree::node_type>::type;
+    Tree tree;
+    timeval start, stop;
+
+    gettimeofday(&start, nullptr);
+    for(auto& n : nodes) {
+        tree.insert(&n);
+    }
+    gettimeofday(&stop, nullptr);
+    double t1 = TIME_DIFF(start, stop);
+
+    gettimeofday(&start, nullptr);
+    long long sum = 0;
+    for(auto& n : bst::range(tree)) {
+        sum += n.key;
+    }
+    for(Hook* p = bst::impl::bst_last(tree.root()); p; p = bst::impl::bst_prev(p)) {
+        sum -= static_cast<typename Tree::node_pointer>(p)->key;
+    }
+    gettimeofday(&stop, nullptr);
+    double t2 = TIME_DIFF(start, stop);
+
+    gettimeofday(&start, nullptr);
+    for(int i : order) {
+        tree.erase(&nodes[i]);
+    }
+    gettimeofday(&stop, nullptr);
+    double t3 = TIME_DIFF(start, stop);
+
+    if(sum != 0 || tree.root() != nullptr) {
+        std::cout << name << " Wrong" << std::endl;
+    }
+    std::cout << "    " << name << ":\tinsert " << t1 << " ms, iterate both ways " << t2 << " ms, erase " << t3 << " ms" << std::endl;
+}
+
+template<template<typename, typename, typename, typename ...> class Tree>
+void run_both(const std::vector<int>& keys, const std::vector<int>& order, const char* name) {
+    std::cout << name << ":" << std::endl;
+    {
+        std::vector<Node<bst::node_hook>> nodes(keys.size());
+        for(std::size_t i = 0; i < keys.size(); ++i) {
+            nodes[i].key = keys[i];
+        }
+        run<Tree<Node<bst::node_hook>, int, GetKey>>(nodes, order, "node_hook      ");
+    }
+    {
+        std::vector<Node<bst::sided_node_hook>> nodes(keys.size());
+        for(std::size_t i = 0; i < keys.size(); ++i) {
+            nodes[i].key = keys[i];
+        }
+        run<Tree<Node<bst::sided_node_hook>, int, GetKey>>(nodes, order, "sided_node_hook");
+    }
+}
+
+int main(int argc, char **argv) {
+    int size = 1000000;
+
+    if(argc > 1) {
+        int s = atoi(argv[1]);
+        if(s > 0) {
+            size = s;
+        }
+    }
+
+    std::mt19937 g(1);
+    std::vector<int> keys(size), order(size);
+    for(int i = 0; i < size; ++i) {
+        keys[i] = i;
+        order[i] = i;
+    }
+    std::shuffle(keys.begin(), keys.end(), g);
+    std::shuffle(order.begin(), order.end(), g);
+
+    std::cout << "Testing node_hook against sided_node_hook: size = " << size << std::endl;
+    run_both<bst::rbtree>(keys, order, "RB");
+    run_both<bst::avl>(keys, order, "AVL");
+    run_both<bst::wavl>(keys, order, "WAVL");
+    return 0;
+}
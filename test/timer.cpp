@@ -0,0 +1,131 @@
+#include<algorithm>
+#include<cstdint>
+#include<random>
+#include<vector>
+#include<iostream>
+#include<sys/time.h>
+#include"bstree.h"
+
+#define TIME_DIFF(start, stop) 1e3 * (stop.tv_sec - start.tv_sec) + 1e-3 * (stop.tv_usec - start.tv_usec)
+
+struct Connection : public bst::timer_hook<> {
+    int id;
+};
+
+struct GetExpiry {
+    std::uint64_t operator()(const Connection& c) const { return c.expiry; }
+};
+
+// the same workload with one erase per expired timer
+class erase_each {
+    bst::wavl<Connection, std::uint64_t, GetExpiry> tree;
+public:
+    void schedule(Connection* c, std::uint64_t expiry) {
+        c->expiry = expiry;
+        tree.insert(nullptr, c);
+    }
+    void reschedule(Connection* c, std::uint64_t expiry) {
+        tree.erase(c);
+        schedule(c, expiry);
+    }
+    template<typename F>
+    std::size_t expire_until(std::uint64_t now, F f) {
+        std::size_t n = 0;
+        for(auto c = tree.first(); c != nullptr && c->expiry <= now; c = tree.first(), ++n) {
+            tree.erase(c);
+            f(c);
+        }
+        return n;
+    }
+};
+
+// Every tick, active connections push their idle timeouts back and the expired ones are
+// closed and replaced by new connections. Return the run time in ms and the number of expiries.
+template<typename Queue>
+double run(std::vector<Connection>& conns, int ticks, int active, std::uint64_t timeout, std::size_t& expired) {
+    Queue q;
+    std::mt19937 g(1);
+    std::uint64_t now = 0;
+    for(auto& c : conns) {
+        q.schedule(&c, now + 1 + g() % timeout);
+    }
+    expired = 0;
+    timeval start, stop;
+    gettimeofday(&start, nullptr);
+    for(int t = 0; t < ticks; ++t) {
+        now += 1;
+        for(int i = 0; i < active; ++i) {
+            q.reschedule(&conns[g() % conns.size()], now + timeout);
+        }
+        expired += q.expire_until(now, [&](Connection* c) {
+            q.schedule(c, now + timeout);
+        });
+    }
+    gettimeofday(&stop, nullptr);
+    return TIME_DIFF(start, stop);
+}
+
+// Expire n timers at once and cancel a later one from the callback of the first: the cancel
+// finds it already unscheduled, every callback runs once and the queue is left empty.
+bool cancel_in_callback(int n, int victim) {
+    std::vector<Connection> conns(n);
+    bst::timer_queue<Connection> q;
+    for(int i = 0; i < n; ++i) {
+        conns[i].id = i;
+        q.schedule(&conns[i], 1 + i % 8);
+    }
+    std::vector<int> calls(n);
+    bool ok = true;
+    std::size_t expired = q.expire_until(8, [&](Connection* c) {
+        ok = ok && !q.scheduled(c);
+        if(c->id == 0) {
+            ok = ok && !q.cancel(&conns[victim]) && !q.scheduled(&conns[victim]);
+        }
+        ++calls[c->id];
+    });
+    return ok && expired == std::size_t(n) && q.empty() && std::count(calls.begin(), calls.end(), 1) == n;
+}
+
+int main(int argc, char **argv) {
+    int size = 1000000;
+    int ticks = 10000;
+    int active = 100;
+
+    if(argc > 1) {
+        int s = atoi(argv[1]);
+        if(s > 0) {
+            size = s;
+        }
+    }
+    if(argc > 2) {
+        int t = atoi(argv[2]);
+        if(t > 0) {
+            ticks = t;
+        }
+    }
+    if(argc > 3) {
+        active = atoi(argv[3]);
+    }
+
+    for(int victim : {1, 8, 63}) {
+        if(!cancel_in_callback(64, victim)) {
+            std::cout << "Cancel in callback Wrong" << std::endl;
+        }
+    }
+
+    std::vector<Connection> conns(size);
+    for(int i = 0; i < size; ++i) {
+        conns[i].id = i;
+    }
+    std::uint64_t timeout = 1000;
+    std::cout << "Testing timers: connections = " << size << ", ticks = " << ticks
+              << ", active per tick = " << active << ", timeout = " << timeout << std::endl;
+    std::size_t e1, e2;
+    double t1 = run<bst::timer_queue<Connection>>(conns, ticks, active, timeout, e1);
+    double t2 = run<erase_each>(conns, ticks, active, timeout, e2);
+    if(e1 != e2) {
+        std::cout << "Wrong" << std::endl;
+    }
+    std::cout << "    " << e1 << " expiries:\ttimer_queue " << t1 << " ms, erase each " << t2 << " ms" << std::endl;
+    return 0;
+}